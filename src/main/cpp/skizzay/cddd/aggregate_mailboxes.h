@@ -0,0 +1,255 @@
+#pragma once
+
+#include "skizzay/cddd/aggregate_root.h"
+#include "skizzay/cddd/command_executor.h"
+#include "skizzay/cddd/commit_sequence.h"
+#include "skizzay/cddd/concurrent_repository.h"
+#include "skizzay/cddd/event_sourced.h"
+#include "skizzay/cddd/event_store.h"
+#include "skizzay/cddd/event_stream.h"
+#include "skizzay/cddd/executor.h"
+#include "skizzay/cddd/identifier.h"
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace skizzay::cddd {
+
+// Serializes the commands for each aggregate through a mailbox of its own,
+// so commands for a hot aggregate queue up instead of loading, executing
+// and colliding concurrently. Each mailbox is drained on the executor by one
+// task at a time, against an instance of the aggregate kept between
+// commands, while the mailboxes of other aggregates are drained alongside.
+// A mailbox takes one batch per task and posts itself again for the next, so
+// a hot aggregate does not hold up the rest of the executor's work.
+//
+// Mailboxes left idle are kept, aggregate and all, up to max_idle_mailboxes of
+// them; past that, the one idle the longest is dropped and its aggregate is
+// loaded afresh should more commands arrive for it.
+//
+// The commands queued when a mailbox is drained, up to max_batch_size, are
+// committed together: each is executed against the aggregate as the ones
+// before it left it, and their events are committed as one. A command that
+// throws fails alone and adds no events. Collisions with writers outside the
+// mailboxes are retried by the command_executor, which re-executes the whole
+// batch when its conflict rules call for it.
+//
+// Completions are invoked on the executor once the batch has committed, and
+// must not throw. The mailboxes must outlive the work posted to the executor.
+template <concepts::event_store Store, typename Aggregate,
+          concepts::executor Executor, concepts::domain_event... DomainEvents>
+requires concepts::aggregate_root<Aggregate, DomainEvents...> &&
+    std::copy_constructible<Aggregate>
+struct aggregate_mailboxes {
+  using id_type = std::remove_cvref_t<id_t<Aggregate>>;
+  using command_type = std::function<void(Aggregate const &,
+                                          pending_events<DomainEvents...> &)>;
+
+  static constexpr std::size_t default_max_batch_size = 64;
+  static constexpr std::size_t default_max_idle_mailboxes = 1024;
+
+  explicit aggregate_mailboxes(
+      Store &store, Executor &executor,
+      command_executor<DomainEvents...> execute =
+          command_executor<DomainEvents...>{},
+      std::size_t const max_batch_size = default_max_batch_size,
+      std::size_t const max_idle_mailboxes = default_max_idle_mailboxes)
+      : store_{store}, executor_{executor}, execute_{std::move(execute)},
+        max_batch_size_{std::max<std::size_t>(1, max_batch_size)},
+        max_idle_mailboxes_{max_idle_mailboxes} {}
+
+  void submit(id_type const &id, command_type command,
+              commit_completion completed) {
+    for (;;) {
+      std::shared_ptr<mailbox> const box = mailboxes_.get_or_add(
+          id, [&id]() { return std::make_shared<mailbox>(id); });
+      bool idle;
+      {
+        std::lock_guard l_{box->m};
+        // A dropped mailbox is on its way out of the table.
+        if (box->dropped) {
+          continue;
+        }
+        box->queue.push_back({std::move(command), std::move(completed)});
+        idle = not std::exchange(box->scheduled, true);
+      }
+      if (idle) {
+        wake(box);
+        executor_.post([this, box]() { drain(box); });
+      }
+      return;
+    }
+  }
+
+  std::future<void> submit(id_type const &id, command_type command) {
+    return event_stream_details_::future_of(
+        [&, this](commit_completion completed) {
+          submit(id, std::move(command), std::move(completed));
+        });
+  }
+
+  // The number of mailboxes held, busy or idle.
+  std::size_t size() const noexcept { return mailboxes_.size(); }
+
+private:
+  struct queued_command {
+    command_type command;
+    commit_completion completed;
+  };
+
+  struct mailbox;
+  using idle_list = std::list<std::shared_ptr<mailbox>>;
+
+  struct mailbox {
+    explicit mailbox(id_type id) : id{std::move(id)} {}
+
+    id_type const id;
+    std::mutex m;
+    std::deque<queued_command> queue;
+    bool scheduled = false;
+    bool dropped = false;
+    // Guarded by idle_m_.
+    std::optional<typename idle_list::iterator> idle_position;
+    // Only touched by the task draining the mailbox.
+    std::optional<Aggregate> aggregate;
+  };
+
+  void drain(std::shared_ptr<mailbox> const &box) {
+    std::vector<queued_command> batch;
+    {
+      std::lock_guard l_{box->m};
+      auto const last = std::begin(box->queue) +
+                        static_cast<std::ptrdiff_t>(std::min(
+                            std::size(box->queue), max_batch_size_));
+      batch.assign(std::make_move_iterator(std::begin(box->queue)),
+                   std::make_move_iterator(last));
+      box->queue.erase(std::begin(box->queue), last);
+    }
+    run(*box, batch);
+    {
+      std::lock_guard l_{box->m};
+      if (std::empty(box->queue)) {
+        box->scheduled = false;
+      } else {
+        executor_.post([this, box]() { drain(box); });
+        return;
+      }
+    }
+    rest(box);
+  }
+
+  // Takes a mailbox that has been scheduled off the idle list.
+  void wake(std::shared_ptr<mailbox> const &box) {
+    std::lock_guard l_{idle_m_};
+    if (box->idle_position.has_value()) {
+      idle_.erase(*std::exchange(box->idle_position, std::nullopt));
+    }
+  }
+
+  // Puts a drained mailbox on the idle list, unless it has been scheduled
+  // again since, and drops those idle the longest past the bound.
+  void rest(std::shared_ptr<mailbox> const &box) {
+    std::lock_guard l_{idle_m_};
+    {
+      std::lock_guard l_box{box->m};
+      if (box->scheduled || box->idle_position.has_value()) {
+        return;
+      }
+      box->idle_position = idle_.insert(std::end(idle_), box);
+    }
+    while (max_idle_mailboxes_ < std::size(idle_)) {
+      std::shared_ptr<mailbox> const oldest = std::move(idle_.front());
+      idle_.pop_front();
+      oldest->idle_position.reset();
+      std::lock_guard l_oldest{oldest->m};
+      // Scheduled again and waiting to be woken; it is no longer idle.
+      if (oldest->scheduled) {
+        continue;
+      }
+      oldest->dropped = true;
+      mailboxes_.remove_if(oldest->id,
+                           [&oldest](std::shared_ptr<mailbox> const &entry) {
+                             return entry == oldest;
+                           });
+    }
+  }
+
+  void run(mailbox &box, std::vector<queued_command> &batch) {
+    std::vector<std::exception_ptr> results(std::size(batch));
+    try {
+      if (not box.aggregate.has_value()) {
+        box.aggregate.emplace(Aggregate{box.id});
+        auto event_source = get_event_source(store_, box.id);
+        load_from_history(event_source, *box.aggregate);
+      }
+      execute_(store_, *box.aggregate,
+               [&](Aggregate const &aggregate,
+                   pending_events<DomainEvents...> &events) {
+                 execute_batch(batch, aggregate, events, results);
+               });
+    } catch (...) {
+      // The instance may be partly caught up; it is reloaded next time.
+      box.aggregate.reset();
+      std::exception_ptr const error = std::current_exception();
+      for (std::exception_ptr &result : results) {
+        if (nullptr == result) {
+          result = error;
+        }
+      }
+    }
+    for (std::size_t i = 0; i != std::size(batch); ++i) {
+      batch[i].completed(results[i]);
+    }
+  }
+
+  // Only copies the aggregate when there are commands after the first to
+  // execute against it.
+  static void execute_batch(std::vector<queued_command> const &batch,
+                            Aggregate const &aggregate,
+                            pending_events<DomainEvents...> &events,
+                            std::vector<std::exception_ptr> &results) {
+    std::optional<Aggregate> working;
+    Aggregate const *current = &aggregate;
+    for (std::size_t i = 0; i != std::size(batch); ++i) {
+      pending_events<DomainEvents...> own;
+      try {
+        std::invoke(batch[i].command, *current, own);
+        results[i] = nullptr;
+      } catch (...) {
+        results[i] = std::current_exception();
+        continue;
+      }
+      if (i + 1 != std::size(batch)) {
+        if (not working.has_value()) {
+          working.emplace(aggregate);
+          current = &*working;
+        }
+        command_executor_details_::apply_pending(*working, own);
+      }
+      events.append(own);
+    }
+  }
+
+  Store &store_;
+  Executor &executor_;
+  command_executor<DomainEvents...> execute_;
+  std::size_t max_batch_size_;
+  std::size_t max_idle_mailboxes_;
+  concurrent_table<std::shared_ptr<mailbox>, id_type> mailboxes_;
+  std::mutex idle_m_;
+  idle_list idle_;
+};
+
+} // namespace skizzay::cddd
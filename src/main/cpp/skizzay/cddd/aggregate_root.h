@@ -5,6 +5,12 @@
 #include "skizzay/cddd/identifier.h"
 #include "skizzay/cddd/version.h"
 
+#include <cstddef>
+#include <span>
+#include <tuple>
+#include <utility>
+#include <vector>
+
 namespace skizzay::cddd {
 namespace concepts {
 template <typename T, typename... DomainEvents>
@@ -54,4 +60,76 @@ as_event_visitor(AggregateRoot &aggregate) {
   return {aggregate};
 }
 
+template <typename Derived, concepts::domain_event DomainEvent>
+struct event_run_visitor_impl : virtual event_visitor_interface<DomainEvent> {
+  void visit(DomainEvent const &domain_event) override {
+    static_cast<Derived *>(this)->apply(domain_event);
+  }
+};
+
+// Gathers consecutive events of a type the aggregate folds as a range, and
+// hands each run to apply_range once an event of another type arrives or the
+// visitor is flushed. Events of other types are applied as they arrive. Run
+// storage is kept between runs, so a long replay allocates only while runs
+// grow. Callers must flush once the last event has been visited.
+template <typename Aggregate, concepts::domain_event... DomainEvents>
+requires concepts::aggregate_root<Aggregate, DomainEvents...>
+struct event_run_visitor final
+    : virtual event_visitor<DomainEvents...>,
+      event_run_visitor_impl<event_run_visitor<Aggregate, DomainEvents...>,
+                             std::remove_cvref_t<DomainEvents>>... {
+  explicit event_run_visitor(Aggregate &aggregate) noexcept
+      : aggregate_{aggregate} {}
+
+  template <concepts::domain_event DomainEvent>
+  requires(std::same_as<DomainEvent, std::remove_cvref_t<DomainEvents>> ||
+           ...) void apply(DomainEvent const &domain_event) {
+    constexpr std::size_t index =
+        domain_event_details_::index_of<DomainEvent, DomainEvents...>();
+    if constexpr (concepts::range_applicable<Aggregate, DomainEvent>) {
+      if (index != pending_) {
+        flush();
+        pending_ = index;
+      }
+      std::get<index>(runs_).push_back(domain_event);
+    } else {
+      flush();
+      skizzay::cddd::apply(aggregate_, domain_event);
+    }
+  }
+
+  void flush() {
+    if (none != pending_) {
+      flush_run(std::index_sequence_for<DomainEvents...>{});
+      pending_ = none;
+    }
+  }
+
+private:
+  static constexpr std::size_t none = sizeof...(DomainEvents);
+
+  template <std::size_t... Is>
+  void flush_run(std::index_sequence<Is...> const) {
+    ((Is == pending_ ? flush_run(std::get<Is>(runs_)) : void()), ...);
+  }
+
+  template <concepts::domain_event DomainEvent>
+  void flush_run(std::vector<DomainEvent> &run) {
+    skizzay::cddd::apply_range(aggregate_,
+                               std::span<DomainEvent const>{run});
+    run.clear();
+  }
+
+  Aggregate &aggregate_;
+  std::size_t pending_ = none;
+  std::tuple<std::vector<std::remove_cvref_t<DomainEvents>>...> runs_;
+};
+
+template <concepts::domain_event... DomainEvents,
+          concepts::aggregate_root<DomainEvents...> AggregateRoot>
+event_run_visitor<AggregateRoot, DomainEvents...>
+as_event_run_visitor(AggregateRoot &aggregate) {
+  return event_run_visitor<AggregateRoot, DomainEvents...>{aggregate};
+}
+
 } // namespace skizzay::cddd
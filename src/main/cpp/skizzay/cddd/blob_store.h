@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace skizzay::cddd {
+using blob = std::shared_ptr<std::vector<std::byte> const>;
+
+struct blob_not_found : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+// Content-addressed storage for payloads that are too large to keep inline.
+// Keys are expected to be derived from the content, so putting the same key
+// twice must be harmless.
+struct blob_store {
+  virtual ~blob_store() = default;
+  virtual void put_blob(std::string const &key,
+                        std::span<std::byte const> data) = 0;
+  virtual blob get_blob(std::string const &key) = 0;
+};
+
+inline blob make_blob(std::span<std::byte const> const data) {
+  return std::make_shared<std::vector<std::byte> const>(std::begin(data),
+                                                        std::end(data));
+}
+} // namespace skizzay::cddd
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "skizzay/cddd/aggregate_root.h"
+#include "skizzay/cddd/domain_event.h"
+#include "skizzay/cddd/event_sourced.h"
+#include "skizzay/cddd/event_store.h"
+#include "skizzay/cddd/event_stream.h"
+#include "skizzay/cddd/identifier.h"
+#include "skizzay/cddd/optimistic_concurrency_collision.h"
+#include "skizzay/cddd/retry_policy.h"
+#include "skizzay/cddd/version.h"
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace skizzay::cddd {
+
+// The events a command adds, held until they are committed. Added the way
+// events are added to an event stream, so commands are written against
+// add_event alone.
+template <concepts::domain_event... DomainEvents> struct pending_events {
+  using value_type = std::variant<std::remove_cvref_t<DomainEvents>...>;
+
+  template <concepts::domain_event DomainEvent>
+  requires(std::same_as<std::remove_cvref_t<DomainEvent>,
+                        std::remove_cvref_t<DomainEvents>> ||
+           ...) void add_event(DomainEvent &&domain_event) {
+    events_.emplace_back(std::in_place_type<std::remove_cvref_t<DomainEvent>>,
+                         std::forward<DomainEvent>(domain_event));
+  }
+
+  void append(pending_events const &other) {
+    events_.insert(std::end(events_), std::begin(other.events_),
+                   std::end(other.events_));
+  }
+
+  auto begin() const noexcept { return std::begin(events_); }
+  auto end() const noexcept { return std::end(events_); }
+  bool empty() const noexcept { return std::empty(events_); }
+  std::size_t size() const noexcept { return std::size(events_); }
+
+  void clear() noexcept { events_.clear(); }
+
+private:
+  std::vector<value_type> events_;
+};
+
+namespace command_executor_details_ {
+// Stands in for the aggregate while it catches up after a collision, noting
+// the types of the events committed in the meantime.
+template <typename Aggregate, concepts::domain_event... DomainEvents>
+struct catching_up {
+  explicit catching_up(Aggregate &aggregate) noexcept : aggregate_{aggregate} {}
+
+  decltype(auto) id() const noexcept { return skizzay::cddd::id(aggregate_); }
+
+  version_t<Aggregate> version() const noexcept {
+    return skizzay::cddd::version(aggregate_);
+  }
+
+  template <concepts::domain_event DomainEvent>
+  requires(std::same_as<DomainEvent, std::remove_cvref_t<DomainEvents>> ||
+           ...) void apply(DomainEvent const &domain_event) {
+    skizzay::cddd::apply(aggregate_, domain_event);
+    seen[domain_event_details_::index_of<DomainEvent, DomainEvents...>()] =
+        true;
+  }
+
+  std::array<bool, sizeof...(DomainEvents)> seen = {};
+
+private:
+  Aggregate &aggregate_;
+};
+
+// Applies the events as committed after the aggregate's current version.
+template <typename Aggregate, concepts::domain_event... DomainEvents>
+void apply_pending(Aggregate &aggregate,
+                   pending_events<DomainEvents...> const &events) {
+  for (auto const &domain_event : events) {
+    std::visit(
+        [&aggregate](auto domain_event) {
+          set_id(domain_event, id(aggregate));
+          set_version(domain_event, version(aggregate) + 1);
+          skizzay::cddd::apply(aggregate, domain_event);
+        },
+        domain_event);
+  }
+}
+} // namespace command_executor_details_
+
+// Executes commands against an aggregate until their events are committed.
+// A command is invoked with the aggregate and the pending_events to add its
+// events to. On a collision the aggregate catches up on only the events
+// committed since it was loaded; the command's events are then committed
+// again as they are, unless a conflict rule says one of the events caught up
+// on invalidates them, in which case the command is executed again against
+// the caught up aggregate. Every pair of event types conflicts until declared
+// otherwise, so by default a collision re-executes the command.
+template <concepts::domain_event... DomainEvents> struct command_executor {
+  explicit command_executor(retry_policy policy = {}) noexcept
+      : policy_{policy} {
+    for (auto &conflicts : conflicts_) {
+      conflicts.fill(true);
+    }
+  }
+
+  // Events of type Ours remain valid when events of type Theirs were
+  // committed concurrently.
+  template <concepts::domain_event Theirs, concepts::domain_event Ours>
+  command_executor &without_conflict() noexcept {
+    conflicts_[index_of<Theirs>()][index_of<Ours>()] = false;
+    return *this;
+  }
+
+  // The aggregate must have been loaded from the store, to any version; it
+  // is left with the command's events applied, their timestamps unset. Once
+  // the attempts run out, the last collision is rethrown.
+  template <concepts::event_store Store,
+            concepts::aggregate_root<DomainEvents...> Aggregate,
+            std::invocable<Aggregate const &, pending_events<DomainEvents...> &>
+                Command>
+  void operator()(Store &store, Aggregate &aggregate, Command &&command) {
+    pending_events<DomainEvents...> events;
+    std::invoke(command, std::as_const(aggregate), events);
+    auto event_stream = get_event_stream(store, id(aggregate));
+    for (std::size_t attempt = 1;; ++attempt) {
+      for (auto const &domain_event : events) {
+        std::visit(
+            [&event_stream](auto domain_event) {
+              skizzay::cddd::add_event(event_stream, std::move(domain_event));
+            },
+            domain_event);
+      }
+      try {
+        commit_events(event_stream, version(aggregate));
+        break;
+      } catch (optimistic_concurrency_collision const &) {
+        if (policy_.max_attempts <= attempt) {
+          throw;
+        }
+      }
+      back_off(policy_, attempt);
+      if (catch_up(store, aggregate, events)) {
+        events.clear();
+        std::invoke(command, std::as_const(aggregate), events);
+      }
+    }
+    command_executor_details_::apply_pending(aggregate, events);
+  }
+
+private:
+  template <concepts::domain_event DomainEvent>
+  static constexpr std::size_t index_of() noexcept {
+    return domain_event_details_::index_of<std::remove_cvref_t<DomainEvent>,
+                                           DomainEvents...>();
+  }
+
+  // Whether the events caught up on conflict with the pending ones.
+  template <typename Store, typename Aggregate>
+  bool catch_up(Store &store, Aggregate &aggregate,
+                pending_events<DomainEvents...> const &events) const {
+    command_executor_details_::catching_up<Aggregate, DomainEvents...>
+        caught_up{aggregate};
+    auto event_source = get_event_source(store, id(aggregate));
+    load_from_history(event_source, caught_up);
+    for (std::size_t theirs = 0; theirs != sizeof...(DomainEvents); ++theirs) {
+      if (caught_up.seen[theirs] &&
+          std::ranges::any_of(events, [&, this](auto const &domain_event) {
+            return conflicts_[theirs][domain_event.index()];
+          })) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  retry_policy policy_;
+  std::array<std::array<bool, sizeof...(DomainEvents)>,
+             sizeof...(DomainEvents)>
+      conflicts_;
+};
+
+} // namespace skizzay::cddd
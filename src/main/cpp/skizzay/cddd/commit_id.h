@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <random>
+#include <string_view>
+
+namespace skizzay::cddd {
+
+// Identifies one commit across its retries, so a backend can recognise a
+// commit it has already applied. Rendered as 32 lowercase hex digits, which
+// fits DynamoDB's 36 character ClientRequestToken.
+struct commit_id {
+  static constexpr std::size_t size = 32;
+
+  static commit_id generate() {
+    thread_local std::mt19937_64 generator{std::random_device{}()};
+    commit_id result;
+    for (std::size_t i = 0; i != size; i += 16) {
+      std::uint64_t bits = generator();
+      for (std::size_t j = 0; j != 16; ++j, bits >>= 4) {
+        result.digits_[i + j] = "0123456789abcdef"[bits & 0xf];
+      }
+    }
+    return result;
+  }
+
+  // Parses the rendered form; anything else yields nothing.
+  static std::optional<commit_id> from_string(std::string_view const s) {
+    if (size != std::size(s) ||
+        std::string_view::npos != s.find_first_not_of("0123456789abcdef")) {
+      return std::nullopt;
+    }
+    commit_id result;
+    s.copy(result.digits_.data(), size);
+    return result;
+  }
+
+  std::string_view str() const noexcept {
+    return {digits_.data(), std::size(digits_)};
+  }
+
+  friend bool operator==(commit_id const &, commit_id const &) = default;
+
+private:
+  commit_id() = default;
+
+  std::array<char, size> digits_;
+};
+
+} // namespace skizzay::cddd
+
+template <> struct std::hash<skizzay::cddd::commit_id> {
+  std::size_t operator()(skizzay::cddd::commit_id const &id) const noexcept {
+    return std::hash<std::string_view>{}(id.str());
+  }
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace skizzay::cddd {
+
+// Invoked by a backend once the write of an asynchronous commit has been
+// acknowledged, with nullptr on success or the failure otherwise.
+using commit_completion = std::function<void(std::exception_ptr)>;
+
+// Starts the write of an asynchronous commit, completing it exactly once. A
+// start that throws is completed with what it threw, unless it had already
+// completed.
+using commit_start = std::function<void(commit_completion)>;
+
+// Runs the asynchronous commits of one event stream in the order they were
+// issued, each being started once the one before it has completed. Backends
+// only start the write and complete it when it is acknowledged, so the
+// commits of many streams may be in flight at once. Commits keep the sequence
+// alive until they complete, so a stream may go away before its commits do.
+struct commit_sequence final
+    : std::enable_shared_from_this<commit_sequence> {
+  // The commits' completions are invoked one at a time, in the order the
+  // commits were issued, on whichever thread completed the write. They must
+  // not throw.
+  void enqueue(commit_start start, commit_completion completed) {
+    bool idle;
+    {
+      std::lock_guard l_{m_};
+      pending_.push_back({std::move(start), std::move(completed)});
+      idle = not std::exchange(running_, true);
+    }
+    if (idle) {
+      run();
+    }
+  }
+
+private:
+  struct pending_commit {
+    commit_start start;
+    commit_completion completed;
+  };
+
+  // Commits completed while being started are followed by the next one in
+  // this loop rather than from within the completion, so that a backend
+  // completing synchronously does not recurse once per queued commit.
+  void run() {
+    for (;;) {
+      commit_start start;
+      {
+        std::lock_guard l_{m_};
+        start = std::move(pending_.front().start);
+        starting_ = true;
+        completed_while_starting_ = false;
+      }
+      auto const completed = std::make_shared<std::atomic<bool>>(false);
+      try {
+        start([self = shared_from_this(),
+               completed](std::exception_ptr const error) {
+          if (not completed->exchange(true)) {
+            self->complete(error);
+          }
+        });
+      } catch (...) {
+        if (not completed->exchange(true)) {
+          complete(std::current_exception());
+        }
+      }
+      std::lock_guard l_{m_};
+      starting_ = false;
+      if (not completed_while_starting_) {
+        return;
+      } else if (std::empty(pending_)) {
+        running_ = false;
+        return;
+      }
+    }
+  }
+
+  // The next commit is only started once the completion has returned.
+  void complete(std::exception_ptr const error) {
+    commit_completion completed;
+    {
+      std::lock_guard l_{m_};
+      completed = std::move(pending_.front().completed);
+      pending_.pop_front();
+    }
+    completed(error);
+    bool run_next = false;
+    {
+      std::lock_guard l_{m_};
+      if (starting_) {
+        completed_while_starting_ = true;
+      } else if (std::empty(pending_)) {
+        running_ = false;
+      } else {
+        run_next = true;
+      }
+    }
+    if (run_next) {
+      run();
+    }
+  }
+
+  std::mutex m_;
+  std::deque<pending_commit> pending_;
+  bool running_ = false;
+  bool starting_ = false;
+  bool completed_while_starting_ = false;
+};
+
+} // namespace skizzay::cddd
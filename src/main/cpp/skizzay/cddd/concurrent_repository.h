@@ -4,8 +4,12 @@
 #include "skizzay/cddd/nullable.h"
 
 #include <concepts>
+#include <cstddef>
+#include <functional>
 #include <memory>
+#include <memory_resource>
 #include <shared_mutex>
+#include <type_traits>
 #include <unordered_map>
 
 namespace skizzay::cddd {
@@ -43,9 +47,19 @@ struct fn<std::unique_ptr<T, D>> final {
 
 template <typename T> inline constexpr fn<T> default_value = {};
 
+// Entries are allocated from the given memory resource.
 template <typename T, concepts::identifier Id> struct impl {
   using key_type = std::remove_cvref_t<Id>;
 
+  impl() = default;
+
+  explicit impl(std::pmr::memory_resource *const resource)
+      : entries_{resource} {}
+
+  std::pmr::memory_resource *resource() const noexcept {
+    return entries_.get_allocator().resource();
+  }
+
   constexpr nullable_t<T> get(key_type const &key) const
       noexcept(std::is_nothrow_copy_constructible_v<T>) {
     std::shared_lock l_{m_};
@@ -65,6 +79,17 @@ template <typename T, concepts::identifier Id> struct impl {
     }
   }
 
+  // Adds the result of make when there is no entry for the key.
+  template <std::invocable Factory>
+  requires std::convertible_to<std::invoke_result_t<Factory>, T>
+  constexpr T get_or_add(key_type const &key, Factory &&make) {
+    if (auto const result = get(key); null_value<T> != result) {
+      return result;
+    } else {
+      return add(key, T{std::invoke(std::forward<Factory>(make))});
+    }
+  }
+
   constexpr bool contains(key_type const &key) const noexcept {
     std::shared_lock l_{m_};
     return unguarded_find(key) == std::end(entries_);
@@ -84,8 +109,37 @@ template <typename T, concepts::identifier Id> struct impl {
     }
   }
 
+  // Removes the entry for the key if it satisfies the predicate, which is
+  // invoked with the table locked.
+  template <std::predicate<T const &> Predicate>
+  constexpr bool remove_if(key_type const &key, Predicate &&predicate) {
+    std::lock_guard l_{m_};
+    if (auto const entry = unguarded_find(key);
+        std::end(entries_) != entry &&
+        std::invoke(std::forward<Predicate>(predicate), entry->second)) {
+      entries_.erase(entry);
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  // Invokes f with each key and its entry, with the table locked for reading.
+  template <std::invocable<key_type const &, T const &> F>
+  void for_each(F &&f) const {
+    std::shared_lock l_{m_};
+    for (auto const &[key, t] : entries_) {
+      std::invoke(f, key, t);
+    }
+  }
+
+  std::size_t size() const noexcept {
+    std::shared_lock l_{m_};
+    return std::size(entries_);
+  }
+
 private:
-  constexpr typename std::unordered_map<key_type, T>::const_iterator
+  constexpr typename std::pmr::unordered_map<key_type, T>::const_iterator
   unguarded_find(key_type const &key) const noexcept {
     return entries_.find(key);
   }
@@ -95,7 +149,7 @@ private:
   }
 
   mutable std::shared_mutex m_;
-  std::unordered_map<key_type, T> entries_;
+  std::pmr::unordered_map<key_type, T> entries_;
 };
 } // namespace concurrent_table_details_
 
@@ -3,7 +3,10 @@
 #include "skizzay/cddd/identifier.h"
 #include "skizzay/cddd/timestamp.h"
 #include "skizzay/cddd/version.h"
+#include <array>
+#include <cassert>
 #include <concepts>
+#include <cstddef>
 #include <ranges>
 #include <type_traits>
 
@@ -46,6 +49,19 @@ template <concepts::domain_event... DomainEvents>
 struct event_visitor
     : virtual event_visitor_interface<std::remove_cvref_t<DomainEvents>>... {};
 
+namespace domain_event_details_ {
+template <typename DomainEvent, typename... DomainEvents>
+constexpr std::size_t index_of() noexcept {
+  constexpr std::array<bool, sizeof...(DomainEvents)> matches{
+      std::same_as<DomainEvent, std::remove_cvref_t<DomainEvents>>...};
+  std::size_t index = 0;
+  while (index != std::size(matches) && not matches[index]) {
+    ++index;
+  }
+  return index;
+}
+} // namespace domain_event_details_
+
 template <concepts::domain_event... DomainEvents> struct event_holder_impl;
 
 template <concepts::domain_event... DomainEvents> struct event_interface {
@@ -53,6 +69,8 @@ template <concepts::domain_event... DomainEvents> struct event_interface {
   using version_type = version_t<DomainEvents...>;
   using timestamp_type = timestamp_t<DomainEvents...>;
 
+  virtual ~event_interface() = default;
+
   virtual id_type id() const noexcept = 0;
   virtual version_type version() const noexcept = 0;
   virtual timestamp_type timestamp() const noexcept = 0;
@@ -65,6 +83,21 @@ template <concepts::domain_event... DomainEvents> struct event_interface {
     return visitor;
   }
 
+  // Position of the held event's type within DomainEvents. Lets callers
+  // dispatch over the closed set of events without a virtual call.
+  constexpr std::size_t event_index() const noexcept { return event_index_; }
+
+  template <concepts::domain_event DomainEvent>
+  requires(std::same_as<DomainEvent, std::remove_cvref_t<DomainEvents>> ||
+           ...) DomainEvent const &get_event() const noexcept {
+    assert((domain_event_details_::index_of<DomainEvent, DomainEvents...>() ==
+            event_index_) &&
+           "Held event is of another type");
+    return static_cast<event_holder_impl<DomainEvent, DomainEvents...> const &>(
+               *this)
+        .event;
+  }
+
   template <concepts::domain_event DomainEvent>
   requires(
       std::same_as<std::remove_cvref_t<DomainEvent>, DomainEvents> ||
@@ -72,9 +105,15 @@ template <concepts::domain_event... DomainEvents> struct event_interface {
                                            DomainEvents...> from_domain_event(DomainEvent
                                                                                   &&domain_event);
 
+protected:
+  explicit event_interface(std::size_t const event_index) noexcept
+      : event_index_{event_index} {}
+
 private:
   virtual void
   do_accept_event_visitor(event_visitor<DomainEvents...> &) const = 0;
+
+  std::size_t event_index_;
 };
 
 template <concepts::domain_event DomainEvent,
@@ -87,7 +126,9 @@ struct event_holder_impl<DomainEvent, DomainEvents...> final
           &&domain_event) noexcept(std::
                                        is_nothrow_move_constructible_v<
                                            std::remove_cvref_t<DomainEvent>>)
-      : event{std::forward<decltype(domain_event)>(domain_event)} {}
+      : event_interface<DomainEvents...>{domain_event_details_::index_of<
+            std::remove_cvref_t<DomainEvent>, DomainEvents...>()},
+        event{std::forward<decltype(domain_event)>(domain_event)} {}
 
   typename event_interface<DomainEvents...>::id_type
   id() const noexcept override {
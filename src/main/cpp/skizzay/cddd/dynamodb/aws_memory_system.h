@@ -0,0 +1,353 @@
+#pragma once
+
+#include <aws/core/utils/memory/MemorySystemInterface.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace skizzay::cddd::dynamodb {
+
+struct memory_statistics {
+  std::size_t allocations = 0;
+  std::size_t deallocations = 0;
+  std::size_t pooled_allocations = 0;
+  std::size_t large_allocations = 0;
+  std::size_t bytes_requested = 0;
+  std::size_t chunks_reserved = 0;
+};
+
+struct pooled_memory_system;
+
+namespace memory_system_details_ {
+inline constexpr std::size_t block_alignment = alignof(std::max_align_t);
+inline constexpr std::size_t min_block_size = 16;
+inline constexpr std::size_t num_size_classes = 8;
+inline constexpr std::size_t max_pooled_block_size =
+    min_block_size << (num_size_classes - 1);
+inline constexpr std::uint32_t large_size_class = num_size_classes;
+inline constexpr std::size_t default_chunk_size = 64 * 1024;
+// The number of blocks moved at a time between a thread cache and the shared
+// free list of a size class. A cache spills once it holds twice as many.
+inline constexpr std::size_t transfer_batch_size = 64;
+
+// Sits immediately in front of every block handed to the SDK so that
+// FreeMemory, which is not given a size, can find its way back.
+struct alignas(block_alignment) block_header {
+  std::uint32_t size_class;
+  std::uint32_t offset;
+};
+
+struct free_block {
+  free_block *next;
+};
+
+constexpr std::size_t size_class_of(std::size_t const block_size) noexcept {
+  return std::bit_width(
+      (std::max(block_size, min_block_size) - 1) / min_block_size);
+}
+
+constexpr std::size_t payload_size(std::size_t const size_class) noexcept {
+  return min_block_size << size_class;
+}
+
+constexpr std::size_t slot_size(std::size_t const size_class) noexcept {
+  return sizeof(block_header) + payload_size(size_class);
+}
+
+// Hands its blocks back to the shared free lists of its instance when its
+// thread exits, if the instance is still around at the same generation.
+struct thread_cache {
+  ~thread_cache();
+
+  pooled_memory_system *owner = nullptr;
+  std::uint64_t generation = 0;
+  std::array<free_block *, num_size_classes> free_lists = {};
+  std::array<std::size_t, num_size_classes> num_free = {};
+};
+
+struct shared_free_list {
+  std::mutex m;
+  free_block *head = nullptr;
+};
+
+inline thread_local thread_cache local_cache = {};
+
+// Generations are unique across instances so that a thread cache can never be
+// mistaken for one belonging to a later instance at the same address.
+inline std::atomic<std::uint64_t> next_generation = 1;
+
+// The live instances by their current generation.
+inline std::mutex instances_m;
+inline std::unordered_map<std::uint64_t, pooled_memory_system *> instances;
+} // namespace memory_system_details_
+
+// An Aws::Utils::Memory::MemorySystemInterface that serves small requests from
+// per-thread free lists carved out of shared chunks. Requests larger than the
+// largest size class, or with extended alignment, go to the global heap.
+// Blocks are freed to the freeing thread's cache, which spills batches of them
+// to a shared free list per size class once it grows past a bound; caches
+// refill from there before carving a new chunk. Blocks allocated on one thread
+// and freed on another, as the SDK does between callers and its executor,
+// therefore find their way back, as do those cached by a thread that exits.
+// Chunks are only returned when the SDK calls End() (or on destruction), so
+// the instance must outlive Aws::ShutdownAPI. Only one instance should be
+// installed at a time.
+struct pooled_memory_system final
+    : Aws::Utils::Memory::MemorySystemInterface {
+  explicit pooled_memory_system(
+      std::size_t const chunk_size =
+          memory_system_details_::default_chunk_size) noexcept
+      : chunk_size_{std::max(chunk_size,
+                             memory_system_details_::slot_size(
+                                 memory_system_details_::num_size_classes -
+                                 1))} {
+    std::lock_guard l_{memory_system_details_::instances_m};
+    memory_system_details_::instances.emplace(generation_, this);
+  }
+
+  pooled_memory_system(pooled_memory_system const &) = delete;
+  pooled_memory_system &operator=(pooled_memory_system const &) = delete;
+
+  ~pooled_memory_system() override {
+    std::lock_guard l_{memory_system_details_::instances_m};
+    memory_system_details_::instances.erase(generation_);
+    release_chunks();
+  }
+
+  void Begin() override {}
+
+  void End() override {
+    std::lock_guard l_{memory_system_details_::instances_m};
+    memory_system_details_::instances.erase(generation_);
+    release_chunks();
+    memory_system_details_::instances.emplace(generation_, this);
+  }
+
+  void *AllocateMemory(std::size_t const block_size,
+                       std::size_t const alignment,
+                       char const * = nullptr) override {
+    using namespace memory_system_details_;
+    allocations_.fetch_add(1, std::memory_order_relaxed);
+    bytes_requested_.fetch_add(block_size, std::memory_order_relaxed);
+    if (block_size > max_pooled_block_size || alignment > block_alignment) {
+      return allocate_large(block_size, alignment);
+    }
+
+    std::size_t const size_class = size_class_of(block_size);
+    thread_cache &cache = current_cache();
+    if (nullptr == cache.free_lists[size_class]) {
+      refill(cache, size_class);
+    }
+    free_block *const block = cache.free_lists[size_class];
+    cache.free_lists[size_class] = block->next;
+    --cache.num_free[size_class];
+    pooled_allocations_.fetch_add(1, std::memory_order_relaxed);
+
+    auto *const header = ::new (static_cast<void *>(block)) block_header{
+        static_cast<std::uint32_t>(size_class), sizeof(block_header)};
+    return header + 1;
+  }
+
+  void FreeMemory(void *const memory) override {
+    using namespace memory_system_details_;
+    if (nullptr == memory) {
+      return;
+    }
+    deallocations_.fetch_add(1, std::memory_order_relaxed);
+    auto *const header = static_cast<block_header *>(memory) - 1;
+    std::byte *const raw = static_cast<std::byte *>(memory) - header->offset;
+    if (large_size_class == header->size_class) {
+      ::operator delete(raw, std::align_val_t{block_alignment});
+    } else {
+      thread_cache &cache = current_cache();
+      std::uint32_t const size_class = header->size_class;
+      auto *const block = ::new (static_cast<void *>(raw))
+          free_block{cache.free_lists[size_class]};
+      cache.free_lists[size_class] = block;
+      if (2 * transfer_batch_size < ++cache.num_free[size_class]) {
+        spill(cache, size_class);
+      }
+    }
+  }
+
+  memory_statistics statistics() const noexcept {
+    return {allocations_.load(std::memory_order_relaxed),
+            deallocations_.load(std::memory_order_relaxed),
+            pooled_allocations_.load(std::memory_order_relaxed),
+            large_allocations_.load(std::memory_order_relaxed),
+            bytes_requested_.load(std::memory_order_relaxed),
+            chunks_reserved_.load(std::memory_order_relaxed)};
+  }
+
+private:
+  friend memory_system_details_::thread_cache;
+
+  memory_system_details_::thread_cache &current_cache() noexcept {
+    using memory_system_details_::local_cache;
+    std::uint64_t const generation =
+        generation_.load(std::memory_order_acquire);
+    if (this != local_cache.owner || generation != local_cache.generation) {
+      local_cache = {this, generation, {}};
+    }
+    return local_cache;
+  }
+
+  // Takes a batch from the shared free list, or carves a new chunk when it is
+  // empty.
+  void refill(memory_system_details_::thread_cache &cache,
+              std::size_t const size_class) {
+    using namespace memory_system_details_;
+    free_block *head = nullptr;
+    std::size_t num_taken = 0;
+    {
+      shared_free_list &shared = shared_free_lists_[size_class];
+      std::lock_guard l_{shared.m};
+      head = shared.head;
+      free_block *tail = nullptr;
+      for (free_block *block = head;
+           nullptr != block && transfer_batch_size != num_taken;
+           block = block->next, ++num_taken) {
+        tail = block;
+      }
+      if (nullptr != tail) {
+        shared.head = std::exchange(tail->next, nullptr);
+      }
+    }
+    if (0 == num_taken) {
+      std::tie(head, num_taken) = reserve_chunk(size_class);
+    }
+    cache.free_lists[size_class] = head;
+    cache.num_free[size_class] = num_taken;
+  }
+
+  // Hands a batch of the cache's blocks over to the shared free list.
+  void spill(memory_system_details_::thread_cache &cache,
+             std::size_t const size_class) {
+    using namespace memory_system_details_;
+    free_block *const head = cache.free_lists[size_class];
+    free_block *tail = head;
+    for (std::size_t i = 1; i != transfer_batch_size; ++i) {
+      tail = tail->next;
+    }
+    cache.free_lists[size_class] = tail->next;
+    cache.num_free[size_class] -= transfer_batch_size;
+
+    shared_free_list &shared = shared_free_lists_[size_class];
+    std::lock_guard l_{shared.m};
+    tail->next = shared.head;
+    shared.head = head;
+  }
+
+  // Hands all of an exiting thread's blocks over to the shared free lists.
+  void reclaim(memory_system_details_::thread_cache &cache) noexcept {
+    using namespace memory_system_details_;
+    for (std::size_t size_class = 0; size_class != num_size_classes;
+         ++size_class) {
+      free_block *const head = cache.free_lists[size_class];
+      if (nullptr == head) {
+        continue;
+      }
+      free_block *tail = head;
+      while (nullptr != tail->next) {
+        tail = tail->next;
+      }
+      shared_free_list &shared = shared_free_lists_[size_class];
+      std::lock_guard l_{shared.m};
+      tail->next = shared.head;
+      shared.head = head;
+    }
+  }
+
+  void *allocate_large(std::size_t const block_size,
+                       std::size_t const alignment) {
+    using namespace memory_system_details_;
+    large_allocations_.fetch_add(1, std::memory_order_relaxed);
+    std::size_t const offset = std::max(alignment, sizeof(block_header));
+    auto *const raw = static_cast<std::byte *>(
+        ::operator new(offset + block_size +
+                           (alignment > block_alignment ? alignment : 0),
+                       std::align_val_t{block_alignment}));
+    std::byte *memory = raw + offset;
+    if (alignment > block_alignment) {
+      auto const misalignment =
+          reinterpret_cast<std::uintptr_t>(memory) & (alignment - 1);
+      if (0 != misalignment) {
+        memory += alignment - misalignment;
+      }
+    }
+    ::new (static_cast<void *>(memory - sizeof(block_header)))
+        block_header{large_size_class,
+                     static_cast<std::uint32_t>(memory - raw)};
+    return memory;
+  }
+
+  std::pair<memory_system_details_::free_block *, std::size_t>
+  reserve_chunk(std::size_t const size_class) {
+    using namespace memory_system_details_;
+    auto *const chunk = static_cast<std::byte *>(
+        ::operator new(chunk_size_, std::align_val_t{block_alignment}));
+    {
+      std::lock_guard l_{m_};
+      chunks_.push_back(chunk);
+    }
+    chunks_reserved_.fetch_add(1, std::memory_order_relaxed);
+
+    std::size_t const stride = slot_size(size_class);
+    std::size_t const num_blocks = chunk_size_ / stride;
+    free_block *head = nullptr;
+    for (std::size_t offset = num_blocks * stride; offset != 0;) {
+      offset -= stride;
+      head = ::new (static_cast<void *>(chunk + offset)) free_block{head};
+    }
+    return {head, num_blocks};
+  }
+
+  void release_chunks() noexcept {
+    std::lock_guard l_{m_};
+    generation_.store(memory_system_details_::next_generation.fetch_add(1),
+                      std::memory_order_release);
+    for (auto &shared : shared_free_lists_) {
+      std::lock_guard shared_l_{shared.m};
+      shared.head = nullptr;
+    }
+    for (std::byte *const chunk : chunks_) {
+      ::operator delete(chunk, std::align_val_t{
+                                   memory_system_details_::block_alignment});
+    }
+    chunks_.clear();
+  }
+
+  std::size_t const chunk_size_;
+  std::mutex m_;
+  std::vector<std::byte *> chunks_;
+  std::array<memory_system_details_::shared_free_list,
+             memory_system_details_::num_size_classes>
+      shared_free_lists_;
+  std::atomic<std::uint64_t> generation_ =
+      memory_system_details_::next_generation.fetch_add(1);
+  std::atomic<std::size_t> allocations_ = 0;
+  std::atomic<std::size_t> deallocations_ = 0;
+  std::atomic<std::size_t> pooled_allocations_ = 0;
+  std::atomic<std::size_t> large_allocations_ = 0;
+  std::atomic<std::size_t> bytes_requested_ = 0;
+  std::atomic<std::size_t> chunks_reserved_ = 0;
+};
+
+inline memory_system_details_::thread_cache::~thread_cache() {
+  std::lock_guard l_{instances_m};
+  if (auto const instance = instances.find(generation);
+      std::end(instances) != instance && owner == instance->second) {
+    owner->reclaim(*this);
+  }
+}
+} // namespace skizzay::cddd::dynamodb
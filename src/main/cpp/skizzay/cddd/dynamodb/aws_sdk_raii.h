@@ -1,6 +1,7 @@
 #pragma once
 
 #include <aws/core/Aws.h>
+#include <aws/core/utils/memory/MemorySystemInterface.h>
 
 namespace skizzay::cddd::dynamodb {
 struct aws_sdk_raii final {
@@ -8,9 +9,24 @@ struct aws_sdk_raii final {
     Aws::InitAPI(options_);
   }
 
+  // The memory system is only consulted when the SDK is built with custom
+  // memory management, and it must outlive this object.
+  aws_sdk_raii(Aws::SDKOptions const &options,
+               Aws::Utils::Memory::MemorySystemInterface &memory_system)
+      : options_{with_memory_system(options, memory_system)} {
+    Aws::InitAPI(options_);
+  }
+
   ~aws_sdk_raii() { Aws::ShutdownAPI(options_); }
 
 private:
+  static Aws::SDKOptions
+  with_memory_system(Aws::SDKOptions options,
+                     Aws::Utils::Memory::MemorySystemInterface &memory_system) {
+    options.memoryManagementOptions.memoryManager = &memory_system;
+    return options;
+  }
+
   Aws::SDKOptions const options_;
 };
 } // namespace skizzay::cddd::dynamodb
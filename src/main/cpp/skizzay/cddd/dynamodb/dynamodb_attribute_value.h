@@ -14,7 +14,7 @@
 namespace skizzay::cddd::dynamodb {
 
 inline Aws::DynamoDB::Model::AttributeValue attribute_value(bool const value) {
-  return Aws::DynamoDB::Model::AttributeValue{}.SetB(value);
+  return Aws::DynamoDB::Model::AttributeValue{}.SetBool(value);
 }
 
 inline Aws::DynamoDB::Model::AttributeValue
@@ -28,6 +28,12 @@ attribute_value(std::string_view const value) {
       Aws::String{value.data(), value.size()});
 }
 
+// Keeps string literals from converting to bool.
+inline Aws::DynamoDB::Model::AttributeValue
+attribute_value(char const *const value) {
+  return attribute_value(std::string_view{value});
+}
+
 inline Aws::DynamoDB::Model::AttributeValue
 attribute_value(std::floating_point auto const value) {
   return Aws::DynamoDB::Model::AttributeValue{}.SetN(value);
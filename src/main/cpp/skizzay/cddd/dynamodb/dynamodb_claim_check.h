@@ -0,0 +1,299 @@
+#pragma once
+
+#include "skizzay/cddd/blob_store.h"
+#include "skizzay/cddd/domain_event.h"
+#include "skizzay/cddd/dynamodb/dynamodb_deser.h"
+#include "skizzay/cddd/narrow_cast.h"
+#include "skizzay/cddd/thread_pool.h"
+
+#include <aws/core/utils/HashingUtils.h>
+#include <aws/core/utils/crypto/Sha256.h>
+#include <aws/dynamodb/model/AttributeValue.h>
+#include <aws/dynamodb/model/Put.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <initializer_list>
+#include <latch>
+#include <memory>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace skizzay::cddd::dynamodb {
+
+struct claim_check_config {
+  std::string payload_name;
+  std::size_t threshold_in_bytes = 64 * 1024;
+  // The most blobs fetched at once when resolving, the resolving thread
+  // among them.
+  std::size_t max_concurrent_fetches = 8;
+};
+
+namespace claim_check_details_ {
+inline constexpr std::string_view string_reference_prefix = "S:";
+inline constexpr std::string_view binary_reference_prefix = "B:";
+// Payloads are hashed through a buffer of this size, so the hash is only ever
+// handed memory it may write to.
+inline constexpr std::size_t hash_chunk_size = 4096;
+} // namespace claim_check_details_
+
+// Moves oversized payload attributes out of event items and into a blob store.
+// The item keeps a reference attribute holding the payload's SHA-256 content
+// hash, prefixed with the attribute type so it can be restored exactly.
+// Blobs are fetched back on a set of workers kept for the claim check's
+// lifetime, shared by every resolve.
+struct claim_check {
+  using item_type = Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>;
+
+  explicit claim_check(claim_check_config config, blob_store &store)
+      : config_{std::move(config)},
+        reference_name_{config_.payload_name + "_ref_"}, store_{store} {
+    if (1 < config_.max_concurrent_fetches) {
+      fetchers_ =
+          std::make_unique<thread_pool>(config_.max_concurrent_fetches - 1);
+    }
+  }
+
+  std::string const &reference_name() const noexcept { return reference_name_; }
+
+  void offload(Aws::DynamoDB::Model::Put &put) const {
+    using Aws::DynamoDB::Model::ValueType;
+
+    auto const payload = put.GetItem().find(config_.payload_name);
+    if (std::end(put.GetItem()) == payload) {
+      return;
+    }
+    std::span<std::byte const> data;
+    std::string_view prefix;
+    if (ValueType::BYTEBUFFER == payload->second.GetType()) {
+      auto const &buffer = payload->second.GetB();
+      data = std::as_bytes(
+          std::span{buffer.GetUnderlyingData(), buffer.GetLength()});
+      prefix = claim_check_details_::binary_reference_prefix;
+    } else if (ValueType::STRING == payload->second.GetType()) {
+      data = std::as_bytes(std::span{payload->second.GetS()});
+      prefix = claim_check_details_::string_reference_prefix;
+    } else {
+      return;
+    }
+    if (std::size(data) <= config_.threshold_in_bytes) {
+      return;
+    }
+
+    std::string const key = content_hash(data);
+    store_.put_blob(key, data);
+    // Every attribute but the payload is carried over, so the payload itself
+    // is never copied.
+    item_type item;
+    for (auto attribute = std::begin(put.GetItem());
+         std::end(put.GetItem()) != attribute; ++attribute) {
+      if (payload != attribute) {
+        item.emplace(*attribute);
+      }
+    }
+    item.emplace(reference_name_, Aws::DynamoDB::Model::AttributeValue{}.SetS(
+                                      Aws::String{prefix} + key));
+    put.SetItem(std::move(item));
+  }
+
+  template <std::ranges::input_range Items = std::initializer_list<item_type>>
+  bool has_references(Items const &items) const {
+    return std::ranges::any_of(items, [this](item_type const &item) {
+      return item.contains(reference_name_);
+    });
+  }
+
+  // Restores every offloaded payload in place. Each distinct blob is fetched
+  // once, up to max_concurrent_fetches of them at a time, so the blob store
+  // must allow concurrent gets.
+  void resolve(Aws::Vector<item_type> &items) const {
+    auto const blobs = fetch_referenced(items);
+    for (item_type &item : items) {
+      if (auto const reference = item.find(reference_name_);
+          std::end(item) != reference) {
+        auto payload = restored_payload(reference->second.GetS(), blobs);
+        item.erase(reference);
+        item.insert_or_assign(config_.payload_name, std::move(payload));
+      }
+    }
+  }
+
+  // As resolve, leaving the items as they are: only those holding a reference
+  // are copied, less the reference, with their payload put back. The copies
+  // are looked up by the address of the item they restore.
+  std::unordered_map<item_type const *, item_type>
+  resolve_copies(std::ranges::forward_range auto const &items) const {
+    auto const blobs = fetch_referenced(items);
+    std::unordered_map<item_type const *, item_type> result;
+    for (item_type const &item : items) {
+      if (auto const reference = item.find(reference_name_);
+          std::end(item) != reference) {
+        item_type copy;
+        for (auto const &attribute : item) {
+          if (reference_name_ != attribute.first) {
+            copy.emplace(attribute);
+          }
+        }
+        copy.emplace(config_.payload_name,
+                     restored_payload(reference->second.GetS(), blobs));
+        result.emplace(&item, std::move(copy));
+      }
+    }
+    return result;
+  }
+
+private:
+  using blobs_by_key = std::unordered_map<std::string, blob>;
+
+  static std::string_view reference_prefix(Aws::String const &reference) {
+    return std::string_view{reference}.substr(
+        0, std::size(claim_check_details_::binary_reference_prefix));
+  }
+
+  static std::string reference_key(Aws::String const &reference) {
+    return std::string{std::string_view{reference}.substr(
+        std::size(claim_check_details_::binary_reference_prefix))};
+  }
+
+  // Fetches each distinct blob the items refer to once.
+  blobs_by_key
+  fetch_referenced(std::ranges::input_range auto const &items) const {
+    std::vector<std::string> keys;
+    blobs_by_key result;
+    for (item_type const &item : items) {
+      if (auto const reference = item.find(reference_name_);
+          std::end(item) != reference) {
+        std::string key = reference_key(reference->second.GetS());
+        if (result.try_emplace(key).second) {
+          keys.push_back(std::move(key));
+        }
+      }
+    }
+    std::vector<blob> blobs = fetch_all(keys);
+    for (std::size_t i = 0; i != std::size(keys); ++i) {
+      result[keys[i]] = std::move(blobs[i]);
+    }
+    return result;
+  }
+
+  Aws::DynamoDB::Model::AttributeValue
+  restored_payload(Aws::String const &reference,
+                   blobs_by_key const &blobs) const {
+    blob const &data = blobs.at(reference_key(reference));
+    Aws::DynamoDB::Model::AttributeValue payload;
+    if (claim_check_details_::binary_reference_prefix ==
+        reference_prefix(reference)) {
+      payload.SetB(Aws::Utils::ByteBuffer{
+          reinterpret_cast<unsigned char const *>(data->data()),
+          std::size(*data)});
+    } else {
+      payload.SetS(Aws::String{reinterpret_cast<char const *>(data->data()),
+                               std::size(*data)});
+    }
+    return payload;
+  }
+
+  // Fetches the blobs on up to max_concurrent_fetches threads: the calling one
+  // and the claim check's fetch workers. The first failure, by position, is
+  // rethrown once every fetch has finished.
+  std::vector<blob> fetch_all(std::vector<std::string> const &keys) const {
+    std::vector<blob> blobs(std::size(keys));
+    std::vector<std::exception_ptr> errors(std::size(keys));
+    std::atomic<std::size_t> next = 0;
+    auto const fetch = [&, this]() {
+      for (std::size_t i = next.fetch_add(1); i < std::size(keys);
+           i = next.fetch_add(1)) {
+        try {
+          blobs[i] = store_.get_blob(keys[i]);
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      }
+    };
+    std::size_t const num_helpers =
+        (nullptr == fetchers_ || std::empty(keys))
+            ? 0
+            : std::min(std::size(keys) - 1, std::size(*fetchers_));
+    std::latch helped{narrow_cast<std::ptrdiff_t>(num_helpers)};
+    for (std::size_t i = 0; i != num_helpers; ++i) {
+      fetchers_->post([&]() {
+        fetch();
+        helped.count_down();
+      });
+    }
+    fetch();
+    helped.wait();
+    for (std::exception_ptr const &error : errors) {
+      if (nullptr != error) {
+        std::rethrow_exception(error);
+      }
+    }
+    return blobs;
+  }
+
+  static std::string content_hash(std::span<std::byte const> const data) {
+    using claim_check_details_::hash_chunk_size;
+    Aws::Utils::Crypto::Sha256 hash;
+    std::array<unsigned char, hash_chunk_size> chunk;
+    for (std::size_t offset = 0; offset < std::size(data);
+         offset += hash_chunk_size) {
+      std::span<std::byte const> const part = data.subspan(
+          offset, std::min(hash_chunk_size, std::size(data) - offset));
+      std::memcpy(chunk.data(), part.data(), std::size(part));
+      hash.Update(chunk.data(), std::size(part));
+    }
+    return Aws::Utils::HashingUtils::HexEncode(hash.GetHash().GetResult());
+  }
+
+  claim_check_config config_;
+  std::string reference_name_;
+  blob_store &store_;
+  std::unique_ptr<thread_pool> fetchers_;
+};
+
+namespace claim_check_details_ {
+template <typename Derived, concepts::domain_event DomainEvent>
+struct serializer_impl
+    : virtual deser_details_::serializer_interface<DomainEvent> {
+  Aws::DynamoDB::Model::Put serialize(DomainEvent &&domain_event) const override {
+    auto const &derived = *static_cast<Derived const *>(this);
+    auto put =
+        static_cast<deser_details_::serializer_interface<DomainEvent> const &>(
+            derived.inner_)
+            .serialize(std::move(domain_event));
+    derived.claim_check_.offload(put);
+    return put;
+  }
+
+  std::string_view
+  message_type(event_type<DomainEvent> const type) const noexcept override {
+    auto const &derived = *static_cast<Derived const *>(this);
+    return static_cast<deser_details_::serializer_interface<DomainEvent> const
+                           &>(derived.inner_)
+        .message_type(type);
+  }
+};
+} // namespace claim_check_details_
+
+// Decorates a serializer so that oversized payloads are claim-checked before
+// the event is buffered for commit.
+template <concepts::domain_event... DomainEvents>
+struct claim_check_serializer final
+    : serializer<DomainEvents...>,
+      claim_check_details_::serializer_impl<
+          claim_check_serializer<DomainEvents...>, DomainEvents>... {
+  explicit claim_check_serializer(serializer<DomainEvents...> const &inner,
+                                  claim_check const &claim_check) noexcept
+      : inner_{inner}, claim_check_{claim_check} {}
+
+  serializer<DomainEvents...> const &inner_;
+  claim_check const &claim_check_;
+};
+} // namespace skizzay::cddd::dynamodb
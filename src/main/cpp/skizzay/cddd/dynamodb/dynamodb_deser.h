@@ -25,6 +25,17 @@ template <concepts::domain_event DomainEvent> struct deserializer_interface {
 };
 } // namespace deser_details_
 
+// Captures the state of an aggregate in a snapshot item and restores it. The
+// key, sort key and type attributes are managed by the snapshot store;
+// deserialize must leave the aggregate at the version the snapshot was taken.
+template <typename Aggregate> struct snapshot_serializer {
+  virtual Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>
+  serialize(Aggregate const &) const = 0;
+  virtual void deserialize(
+      Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> const &,
+      Aggregate &) const = 0;
+};
+
 template <concepts::domain_event... DomainEvents>
 struct serializer
     : virtual deser_details_::serializer_interface<DomainEvents>... {};
@@ -2,9 +2,12 @@
 
 #include "skizzay/cddd/aggregate_root.h"
 #include "skizzay/cddd/domain_event.h"
+#include "skizzay/cddd/dynamodb/dynamodb_attribute_value.h"
 #include "skizzay/cddd/dynamodb/dynamodb_deser.h"
 #include "skizzay/cddd/dynamodb/dynamodb_event_log_config.h"
+#include "skizzay/cddd/event_view.h"
 #include "skizzay/cddd/history_load_failed.h"
+#include <array>
 #include <concepts>
 #include <functional>
 #include <initializer_list>
@@ -36,12 +39,31 @@ template <translator Translator>
 using domain_event_result_t = std::remove_cvref_t<std::invoke_result_t<
     Translator,
     Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> const &>>;
+
+template <typename DomainEvent, typename... DomainEvents>
+inline constexpr std::size_t index_of = [] {
+  std::size_t index = 0;
+  (void)((std::same_as<DomainEvent, DomainEvents> ? false : (++index, true)) &&
+         ...);
+  return index;
+}();
 } // namespace event_dispatcher_details_
 
+// Events viewed as the item they were stored as.
+struct event_item final {
+  using representation_type =
+      Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>;
+};
+
+template <concepts::domain_event DomainEvent>
+using event_view = skizzay::cddd::event_view<DomainEvent, event_item>;
+
 template <concepts::domain_event... DomainEvents> struct event_dispatcher {
   using item_type = Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>;
   using handler_type =
       std::function<void(item_type const &, event_visitor<DomainEvents...> &)>;
+  using id_type = std::remove_cvref_t<id_t<DomainEvents...>>;
+  using view_visitor_type = event_view_visitor<event_item, DomainEvents...>;
 
   event_dispatcher(event_log_config const &config) noexcept
       : config_{config}, handlers_{} {}
@@ -65,6 +87,36 @@ template <concepts::domain_event... DomainEvents> struct event_dispatcher {
     }
   }
 
+  // Like dispatch, but hands the visitor a view over the item rather than the
+  // translated event. Only the version and timestamp attributes are read up
+  // front; the id is that of the aggregate being loaded.
+  void dispatch(item_type const &item, id_type const &id,
+                view_visitor_type &visitor) {
+    try {
+      std::string const type =
+          safe_get_item_value(item, config_.type_name(),
+                              &Aws::DynamoDB::Model::AttributeValue::GetS);
+      auto const viewer_iter = viewers_.find(type);
+      if (std::end(viewers_) == viewer_iter) {
+        throw std::invalid_argument{"Could not find handler for '" + type +
+                                    "'"};
+      } else {
+        viewer_iter->second(item, id, config_, visitor);
+      }
+    } catch (...) {
+      std::throw_with_nested(event_deserialization_failed{
+          "Event dispatcher failed to dispatch event view to handler."});
+    }
+  }
+
+  template <concepts::domain_event DomainEvent>
+  requires(std::same_as<DomainEvent, DomainEvents> ||
+           ...) std::string const &type_name(event_type<DomainEvent> const)
+  const noexcept {
+    return type_names_[event_dispatcher_details_::index_of<DomainEvent,
+                                                           DomainEvents...>];
+  }
+
   void register_translator(
       std::string event_type_name,
       event_dispatcher_details_::translator_for_one_of<DomainEvents...> auto
@@ -73,6 +125,24 @@ template <concepts::domain_event... DomainEvents> struct event_dispatcher {
       throw std::logic_error{"Handler for event '" + event_type_name +
                              "' already registered"};
     } else {
+      using domain_event_type =
+          event_dispatcher_details_::domain_event_result_t<
+              decltype(translator)>;
+      auto viewer =
+          [translator = typename dynamodb::event_view<
+               domain_event_type>::decoder_type{translator}](
+              item_type const &item, id_type const &id,
+              event_log_config const &config, view_visitor_type &v) {
+            static_cast<event_view_visitor_interface<
+                dynamodb::event_view<domain_event_type>> &>(v)
+                .visit({item, id,
+                        get_value_from_item<version_t<domain_event_type>>(
+                            item, config.version_name()),
+                        get_value_from_item<timestamp_t<domain_event_type>>(
+                            item, config.timestamp_name()),
+                        translator});
+          };
+      viewers_.emplace(event_type_name, std::move(viewer));
       auto handler = [translator = std::move(translator)](
                          item_type const &item,
                          event_visitor<DomainEvents...> &v) {
@@ -81,13 +151,23 @@ template <concepts::domain_event... DomainEvents> struct event_dispatcher {
                 decltype(translator)>> &>(v)
             .visit(std::invoke(translator, item));
       };
+      type_names_[event_dispatcher_details_::index_of<
+          event_dispatcher_details_::domain_event_result_t<
+              decltype(translator)>,
+          DomainEvents...>] = event_type_name;
       handlers_.emplace(std::move(event_type_name), std::move(handler));
     }
   }
 
 private:
   event_log_config const &config_;
+  using viewer_type =
+      std::function<void(item_type const &, id_type const &,
+                         event_log_config const &, view_visitor_type &)>;
+
   std::unordered_map<std::string, handler_type> handlers_;
+  std::unordered_map<std::string, viewer_type> viewers_;
+  std::array<std::string, sizeof...(DomainEvents)> type_names_;
 };
 
 template <event_dispatcher_details_::translator... Translators>
@@ -16,10 +16,11 @@ struct event_log_config {
                             std::string timestamp_name, std::string type_name,
                             std::string table_name)
       : key_name_{std::move(key_name)}, version_name_{std::move(version_name)},
-        max_version_name_{version_name_ + "_max_"}, timestamp_name_{std::move(
-                                                        timestamp_name)},
+        max_version_name_{version_name_ + "_max_"},
+        commit_id_name_{version_name_ + "_commit_"},
+        timestamp_name_{std::move(timestamp_name)},
         type_name_{std::move(type_name)}, table_name_{std::move(table_name)},
-        ttl_attributes_{std::nullopt} {}
+        snapshot_table_name_{table_name_}, ttl_attributes_{std::nullopt} {}
 
   explicit event_log_config(std::string key_name, std::string version_name,
                             std::string timestamp_name, std::string type_name,
@@ -36,6 +37,10 @@ struct event_log_config {
   std::string const &max_version_name() const noexcept {
     return max_version_name_;
   }
+  // The version record holds the id of the latest commit.
+  std::string const &commit_id_name() const noexcept {
+    return commit_id_name_;
+  }
   std::string const &timestamp_name() const noexcept { return timestamp_name_; }
   std::string const &type_name() const noexcept { return type_name_; }
   std::string const &table_name() const noexcept { return table_name_; }
@@ -43,13 +48,32 @@ struct event_log_config {
     return ttl_attributes_;
   }
 
+  // Snapshots are keyed by the negated version of the aggregate they capture,
+  // which keeps them clear of both events (>= 1) and version records (0).
+  // By default they share the event log table.
+  std::string const &snapshot_table_name() const noexcept {
+    return snapshot_table_name_;
+  }
+  bool has_snapshot_table() const noexcept {
+    return snapshot_table_name_ != table_name_;
+  }
+
+  event_log_config
+  with_snapshot_table_name(std::string snapshot_table_name) const {
+    event_log_config result = *this;
+    result.snapshot_table_name_ = std::move(snapshot_table_name);
+    return result;
+  }
+
 private:
   std::string key_name_;
   std::string version_name_;
   std::string max_version_name_;
+  std::string commit_id_name_;
   std::string timestamp_name_;
   std::string type_name_;
   std::string table_name_;
+  std::string snapshot_table_name_;
   std::optional<ttl_attributes> ttl_attributes_;
 };
 
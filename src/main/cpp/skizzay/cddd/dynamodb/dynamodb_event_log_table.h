@@ -17,8 +17,23 @@ struct event_log_table {
   explicit event_log_table(Aws::DynamoDB::DynamoDBClient &client,
                            event_log_config const &config)
       : client_{client}, config_{config} {
+    create_table(config_.table_name());
+    if (config_.has_snapshot_table()) {
+      create_table(config_.snapshot_table_name());
+    }
+  }
+
+  ~event_log_table() noexcept(false) {
+    if (config_.has_snapshot_table()) {
+      delete_table(config_.snapshot_table_name());
+    }
+    delete_table(config_.table_name());
+  }
+
+private:
+  void create_table(std::string const &table_name) {
     auto request = Aws::DynamoDB::Model::CreateTableRequest{}
-                       .WithTableName(config_.table_name())
+                       .WithTableName(table_name)
                        .WithAttributeDefinitions(key_definitions())
                        .WithKeySchema(key_schema())
                        .WithProvisionedThroughput(provisioned_throughput());
@@ -29,9 +44,9 @@ struct event_log_table {
     }
   }
 
-  ~event_log_table() noexcept(false) {
-    auto request = Aws::DynamoDB::Model::DeleteTableRequest{}.WithTableName(
-        config_.table_name());
+  void delete_table(std::string const &table_name) {
+    auto request =
+        Aws::DynamoDB::Model::DeleteTableRequest{}.WithTableName(table_name);
     auto outcome = client_.DeleteTable(request);
 
     if (!outcome.IsSuccess() &&
@@ -41,7 +56,6 @@ struct event_log_table {
     }
   }
 
-private:
   Aws::Vector<Aws::DynamoDB::Model::AttributeDefinition>
   key_definitions() const {
     using Aws::DynamoDB::Model::AttributeDefinition;
@@ -3,24 +3,60 @@
 #include "skizzay/cddd/aggregate_root.h"
 #include "skizzay/cddd/domain_event.h"
 #include "skizzay/cddd/dynamodb/dynamodb_attribute_value.h"
+#include "skizzay/cddd/dynamodb/dynamodb_claim_check.h"
 #include "skizzay/cddd/dynamodb/dynamodb_deser.h"
 #include "skizzay/cddd/dynamodb/dynamodb_event_dispatcher.h"
 #include "skizzay/cddd/dynamodb/dynamodb_event_log_config.h"
 #include "skizzay/cddd/dynamodb/dynamodb_operation_failed_error.h"
+#include "skizzay/cddd/dynamodb/dynamodb_snapshot_store.h"
 #include "skizzay/cddd/factory.h"
 #include "skizzay/cddd/history_load_failed.h"
+#include "skizzay/cddd/narrow_cast.h"
+#include "skizzay/cddd/timestamp.h"
 #include "skizzay/cddd/version.h"
 
 #include <aws/dynamodb/DynamoDBClient.h>
 #include <aws/dynamodb/model/QueryRequest.h>
+#include <algorithm>
+#include <chrono>
 #include <concepts>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <ranges>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace skizzay::cddd::dynamodb {
 template <typename E>
 using history_load_error = operation_failed_error<history_load_failed, E>;
 
 namespace event_source_details_ {
+inline constexpr int default_tail_page_size = 25;
+inline constexpr int default_latest_event_max_pages = 4;
+inline constexpr int default_snapshot_tail_page_size = 100;
+
+template <typename Derived, concepts::domain_event Target,
+          concepts::domain_event DomainEvent>
+struct latest_event_visitor_impl : virtual event_visitor_interface<DomainEvent> {
+  void visit(DomainEvent const &domain_event) override {
+    if constexpr (std::same_as<Target, DomainEvent>) {
+      static_cast<Derived *>(this)->result.emplace(domain_event);
+    }
+  }
+};
+
+template <concepts::domain_event Target, concepts::domain_event... DomainEvents>
+struct latest_event_visitor final
+    : event_visitor<DomainEvents...>,
+      latest_event_visitor_impl<latest_event_visitor<Target, DomainEvents...>,
+                                Target, std::remove_cvref_t<DomainEvents>>... {
+  std::optional<Target> result;
+};
+
 template <concepts::domain_event... DomainEvents> struct impl {
   template <
       typename GetRequest = default_factory<Aws::DynamoDB::Model::QueryRequest>>
@@ -31,19 +67,263 @@ template <concepts::domain_event... DomainEvents> struct impl {
       : event_dispatcher_{dispatcher}, config_{config}, client_{client},
         get_request_{std::move_if_noexcept(get_request)} {}
 
+  // Each page of the query is played back as it is read.
   void
   load_from_history(concepts::aggregate_root<DomainEvents...> auto &aggregate,
                     version_t<decltype(aggregate)> const target_version) {
-    auto const outcome = client_.Query(
-        query_request(id(aggregate), version(aggregate) + 1, target_version));
-    if (outcome.IsSuccess()) {
-      playback_events(outcome.GetResult().GetItems(), aggregate);
-    } else {
-      throw history_load_error{outcome.GetError()};
+    auto request =
+        query_request(id(aggregate), version(aggregate) + 1, target_version);
+    item_type exclusive_start_key;
+    do {
+      if (not std::empty(exclusive_start_key)) {
+        request.SetExclusiveStartKey(std::move(exclusive_start_key));
+      }
+      auto const outcome = client_.Query(request);
+      if (not outcome.IsSuccess()) {
+        throw history_load_error{outcome.GetError()};
+      }
+      with_resolved_items(outcome.GetResult().GetItems(),
+                          [&, this](auto const &items) {
+                            playback_events(items, aggregate);
+                          });
+      exclusive_start_key = outcome.GetResult().GetLastEvaluatedKey();
+    } while (not std::empty(exclusive_start_key));
+  }
+
+  // As load_from_history, without blocking on the query. The aggregate is
+  // played back on the SDK's executor thread, so it must outlive the load and
+  // not be touched until it completes.
+  void load_from_history_async(
+      concepts::aggregate_root<DomainEvents...> auto &aggregate,
+      version_t<decltype(aggregate)> const target_version,
+      std::function<void(std::exception_ptr)> loaded) {
+    load_pages_async(
+        query_request(id(aggregate), version(aggregate) + 1, target_version),
+        aggregate, std::move(loaded));
+  }
+
+  // Queries the events after the aggregate's version, leaving the table to
+  // filter out those committed after the timestamp. Playback stops at the
+  // first one filtered out, as every event after it is newer than the
+  // aggregate as of that time. A page the table filtered any out of is the
+  // last one read, even when they were at its end and left no gap in it.
+  template <concepts::aggregate_root<DomainEvents...> Aggregate>
+  void load_as_of(Aggregate &aggregate, concepts::timestamp auto const as_of) {
+    using version_type = version_t<Aggregate>;
+    using timestamp_type = timestamp_t<DomainEvents...>;
+
+    version_type next_version = version(aggregate) + 1;
+    auto request = query_request(id(aggregate), next_version,
+                                 std::numeric_limits<version_type>::max())
+                       .WithFilterExpression("#ts <= :ts");
+    request.SetExpressionAttributeNames(
+        make_expression_attribute_names({{"#ts", config_.timestamp_name()}}));
+    request.SetExpressionAttributeValues(make_expression_attribute_values(
+        id(aggregate), next_version, std::numeric_limits<version_type>::max(),
+        {{":ts", attribute_value(
+                     std::chrono::floor<typename timestamp_type::duration>(
+                         as_of))}}));
+    auto visitor = playback_visitor(aggregate);
+    auto const playback = [&, this](auto const &items) {
+      for (auto const &item : items) {
+        dispatch_to(aggregate, item, visitor);
+      }
+    };
+    item_type exclusive_start_key;
+    do {
+      if (not std::empty(exclusive_start_key)) {
+        request.SetExclusiveStartKey(std::move(exclusive_start_key));
+      }
+      auto const outcome = client_.Query(request);
+      if (not outcome.IsSuccess()) {
+        throw history_load_error{outcome.GetError()};
+      }
+      auto const &items = outcome.GetResult().GetItems();
+      auto gap = std::begin(items);
+      for (; std::end(items) != gap &&
+             next_version == get_value_from_item<version_type>(
+                                 *gap, config_.version_name());
+           ++gap, ++next_version) {
+      }
+      if (std::end(items) != gap) {
+        with_resolved_items(std::ranges::subrange(std::begin(items), gap),
+                            playback);
+        break;
+      }
+      with_resolved_items(items, playback);
+      if (outcome.GetResult().GetCount() <
+          outcome.GetResult().GetScannedCount()) {
+        break;
+      }
+      exclusive_start_key = outcome.GetResult().GetLastEvaluatedKey();
+    } while (not std::empty(exclusive_start_key));
+    visitor.flush();
+  }
+
+  // Payloads that were claim-checked on the way in are fetched back from the
+  // blob store before the items are dispatched.
+  void use_claim_check(claim_check const &claim_check) noexcept {
+    claim_check_ = &claim_check;
+  }
+
+  // Hydrates the aggregate from its latest snapshot plus the events after it.
+  // The snapshot lookup and a reverse query over the newest events are put in
+  // flight together; older pages are only read until the snapshot is reached.
+  template <concepts::aggregate_root<DomainEvents...> Aggregate>
+  void load_from_snapshot_and_history(
+      snapshot_store<Aggregate> &snapshots, Aggregate &aggregate,
+      version_t<Aggregate> const target_version,
+      int const page_size = default_snapshot_tail_page_size) {
+    using version_type = version_t<Aggregate>;
+
+    version_type const aggregate_version = version(aggregate);
+    if (target_version <= aggregate_version) {
+      return;
+    }
+    auto snapshot_outcome =
+        snapshots.latest_snapshot_callable(id(aggregate), target_version);
+
+    std::vector<Aws::DynamoDB::Model::QueryOutcome> pages;
+    std::optional<version_type> floor_version;
+    item_type exclusive_start_key;
+    do {
+      auto request =
+          query_request(id(aggregate), aggregate_version + 1, target_version)
+              .WithScanIndexForward(false)
+              .WithLimit(page_size);
+      if (not std::empty(exclusive_start_key)) {
+        request.SetExclusiveStartKey(std::move(exclusive_start_key));
+      }
+      auto outcome = client_.Query(request);
+      if (not outcome.IsSuccess()) {
+        throw history_load_error{outcome.GetError()};
+      }
+      exclusive_start_key = outcome.GetResult().GetLastEvaluatedKey();
+      auto const &items = outcome.GetResult().GetItems();
+      version_type const oldest_version =
+          std::empty(items)
+              ? aggregate_version
+              : get_value_from_item<version_type>(items.back(),
+                                                  config_.version_name());
+      pages.emplace_back(std::move(outcome));
+
+      if (not floor_version.has_value()) {
+        floor_version =
+            snapshots.apply_snapshot(snapshot_outcome.get(), aggregate)
+                .value_or(aggregate_version);
+      }
+      if (oldest_version <= *floor_version + 1) {
+        break;
+      }
+    } while (not std::empty(exclusive_start_key));
+
+    auto visitor = playback_visitor(aggregate);
+    for (auto const &page : pages | std::views::reverse) {
+      with_resolved_items(
+          page.GetResult().GetItems(), [&, this](auto const &items) {
+            for (auto const &item : items | std::views::reverse) {
+              if (get_value_from_item<version_type>(
+                      item, config_.version_name()) > *floor_version) {
+                dispatch_to(aggregate, item, visitor);
+              }
+            }
+          });
+    }
+    visitor.flush();
+  }
+
+  // Plays back the latest `count` events of the stream, oldest first. Only the
+  // tail is read; the query walks the sort key in reverse.
+  void load_latest(id_t<DomainEvents...> id, std::size_t const count,
+                   event_visitor<DomainEvents...> &visitor) {
+    std::vector<Aws::DynamoDB::Model::QueryOutcome> pages;
+    std::size_t num_items = 0;
+    item_type exclusive_start_key;
+    while (num_items < count) {
+      auto request = tail_query_request(id, count - num_items);
+      if (not std::empty(exclusive_start_key)) {
+        request.SetExclusiveStartKey(std::move(exclusive_start_key));
+      }
+      auto outcome = client_.Query(request);
+      if (not outcome.IsSuccess()) {
+        throw history_load_error{outcome.GetError()};
+      }
+      num_items += std::size(outcome.GetResult().GetItems());
+      exclusive_start_key = outcome.GetResult().GetLastEvaluatedKey();
+      pages.emplace_back(std::move(outcome));
+      if (std::empty(exclusive_start_key)) {
+        break;
+      }
+    }
+    for (auto const &page : pages | std::views::reverse) {
+      with_resolved_items(page.GetResult().GetItems(),
+                          [&, this](auto const &items) {
+                            for (auto const &item :
+                                 items | std::views::reverse) {
+                              event_dispatcher_.dispatch(item, visitor);
+                            }
+                          });
     }
   }
 
+  // Reads the stream backwards for its latest event of the given type. The
+  // table filters on the type only after reading, so every page costs the
+  // read capacity of page_size events however few of them match. At most
+  // max_pages pages are read: an event of the type older than the latest
+  // page_size * max_pages events of the stream is not found.
+  template <concepts::domain_event DomainEvent>
+  requires(std::same_as<DomainEvent, std::remove_cvref_t<DomainEvents>> ||
+           ...) std::optional<DomainEvent>
+      latest_event(id_t<DomainEvents...> id, event_type<DomainEvent> const type,
+                   int const page_size = default_tail_page_size,
+                   int const max_pages = default_latest_event_max_pages) {
+    latest_event_visitor<DomainEvent, DomainEvents...> visitor;
+    item_type exclusive_start_key;
+    for (int page = 0; page != max_pages; ++page) {
+      auto request =
+          tail_query_request(id, narrow_cast<std::size_t>(page_size))
+              .WithFilterExpression("#type = :type");
+      request.SetExpressionAttributeNames(
+          make_expression_attribute_names({{"#type", config_.type_name()}}));
+      request.SetExpressionAttributeValues(make_expression_attribute_values(
+          id, version_t<DomainEvents...>{1},
+          std::numeric_limits<version_t<DomainEvents...>>::max(),
+          {{":type", attribute_value(event_dispatcher_.type_name(type))}}));
+      if (not std::empty(exclusive_start_key)) {
+        request.SetExclusiveStartKey(std::move(exclusive_start_key));
+      }
+      auto const outcome = client_.Query(request);
+      if (not outcome.IsSuccess()) {
+        throw history_load_error{outcome.GetError()};
+      }
+      auto const &items = outcome.GetResult().GetItems();
+      if (not std::empty(items)) {
+        with_resolved_items(
+            items | std::views::take(1), [&, this](auto const &latest) {
+              event_dispatcher_.dispatch(latest.front(), visitor);
+            });
+        break;
+      }
+      exclusive_start_key = outcome.GetResult().GetLastEvaluatedKey();
+      if (std::empty(exclusive_start_key)) {
+        break;
+      }
+    }
+    return std::move(visitor.result);
+  }
+
 private:
+  using item_type = Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>;
+
+  Aws::DynamoDB::Model::QueryRequest
+  tail_query_request(id_t<DomainEvents...> id, std::size_t const limit) {
+    return query_request(id, 1,
+                         std::numeric_limits<version_t<DomainEvents...>>::max())
+        .WithScanIndexForward(false)
+        .WithLimit(narrow_cast<int>(std::min(
+            limit, narrow_cast<std::size_t>(std::numeric_limits<int>::max()))));
+  }
+
   Aws::DynamoDB::Model::QueryRequest
   query_request(id_t<DomainEvents...> id,
                 version_t<DomainEvents...> const begin_version,
@@ -58,31 +338,117 @@ private:
             id, begin_version, target_version));
   }
 
-  void playback_events(auto const &items, auto &aggregate) {
-    std::ranges::for_each(
-        items, [visitor = as_event_visitor<DomainEvents...>(aggregate),
-                this](auto const &item) mutable {
-          event_dispatcher_.dispatch(item, visitor);
+  // Plays back the page the request reads, then queries the next one from
+  // the page's callback; loaded is only invoked after the last.
+  void load_pages_async(Aws::DynamoDB::Model::QueryRequest const &request,
+                        auto &aggregate,
+                        std::function<void(std::exception_ptr)> loaded) {
+    client_.QueryAsync(
+        request,
+        [this, &aggregate, loaded = std::move(loaded)](
+            Aws::DynamoDB::DynamoDBClient const *,
+            Aws::DynamoDB::Model::QueryRequest const &request,
+            Aws::DynamoDB::Model::QueryOutcome const &outcome,
+            std::shared_ptr<Aws::Client::AsyncCallerContext const> const &) {
+          try {
+            if (not outcome.IsSuccess()) {
+              throw history_load_error{outcome.GetError()};
+            }
+            with_resolved_items(outcome.GetResult().GetItems(),
+                                [&, this](auto const &items) {
+                                  playback_events(items, aggregate);
+                                });
+            if (item_type const &last_evaluated_key =
+                    outcome.GetResult().GetLastEvaluatedKey();
+                not std::empty(last_evaluated_key)) {
+              auto next_request = request;
+              next_request.SetExclusiveStartKey(last_evaluated_key);
+              load_pages_async(next_request, aggregate, loaded);
+              return;
+            }
+          } catch (...) {
+            loaded(std::current_exception());
+            return;
+          }
+          loaded(nullptr);
         });
   }
 
-  Aws::Map<Aws::String, Aws::String> make_expression_attribute_names() const {
-    return {{"#pk", config_.key_name()}, {"#sk", config_.version_name()}};
+  // Hands playback the items with their claim-checked payloads restored. Only
+  // the items holding a reference are copied to have their payload put back;
+  // the rest are read where they are.
+  void with_resolved_items(std::ranges::random_access_range auto const &items,
+                           auto &&playback) const {
+    if (nullptr != claim_check_ && claim_check_->has_references(items)) {
+      auto const resolved = claim_check_->resolve_copies(items);
+      playback(items | std::views::transform(
+                           [&resolved](item_type const &item)
+                               -> item_type const & {
+                             auto const copy = resolved.find(&item);
+                             return std::end(resolved) == copy ? item
+                                                               : copy->second;
+                           }));
+    } else {
+      playback(items);
+    }
+  }
+
+  void playback_events(auto const &items, auto &aggregate) {
+    auto visitor = playback_visitor(aggregate);
+    for (auto const &item : items) {
+      dispatch_to(aggregate, item, visitor);
+    }
+    visitor.flush();
+  }
+
+  // Only aggregates that apply a view of at least one event type are handed
+  // views; the rest have each item translated straight to its event.
+  template <typename Aggregate>
+  static constexpr bool applies_views =
+      (concepts::view_applicable<Aggregate, std::remove_cvref_t<DomainEvents>,
+                                 event_item> ||
+       ...);
+
+  template <typename Aggregate>
+  static auto playback_visitor(Aggregate &aggregate) {
+    if constexpr (applies_views<Aggregate>) {
+      return as_event_view_visitor<event_item, DomainEvents...>(aggregate);
+    } else {
+      return as_event_run_visitor<DomainEvents...>(aggregate);
+    }
+  }
+
+  template <typename Aggregate>
+  void dispatch_to(Aggregate &aggregate, item_type const &item,
+                   auto &visitor) {
+    if constexpr (applies_views<Aggregate>) {
+      event_dispatcher_.dispatch(item, id(aggregate), visitor);
+    } else {
+      event_dispatcher_.dispatch(item, visitor);
+    }
+  }
+
+  Aws::Map<Aws::String, Aws::String> make_expression_attribute_names(
+      Aws::Map<Aws::String, Aws::String> names = {}) const {
+    names.emplace("#pk", config_.key_name());
+    names.emplace("#sk", config_.version_name());
+    return names;
   }
 
-  Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>
-  make_expression_attribute_values(
+  item_type make_expression_attribute_values(
       auto const &id, std::unsigned_integral auto const min_version,
-      decltype(min_version) const max_version) const {
-    return {{":pk", attribute_value(id)},
-            {":sk_min", attribute_value(min_version)},
-            {":sk_max", attribute_value(max_version)}};
+      decltype(min_version) const max_version, item_type values = {}) const {
+    values.emplace(":pk", attribute_value(id));
+    values.emplace(":sk_min", attribute_value(min_version));
+    values.emplace(":sk_max", attribute_value(max_version));
+    return values;
   }
 
   event_dispatcher<DomainEvents...> &event_dispatcher_;
   event_log_config const &config_;
   Aws::DynamoDB::DynamoDBClient &client_;
   std::function<Aws::DynamoDB::Model::QueryRequest()> get_request_;
+  claim_check const *claim_check_ = nullptr;
 };
 
 template <typename GetRequest, concepts::domain_event... DomainEvents>
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "skizzay/cddd/commit_id.h"
 #include "skizzay/cddd/domain_event.h"
 #include "skizzay/cddd/dynamodb/dynamodb_deser.h"
 #include "skizzay/cddd/dynamodb/dynamodb_event_log_config.h"
@@ -11,7 +12,6 @@
 #include "skizzay/cddd/optimistic_concurrency_collision.h"
 #include "skizzay/cddd/timestamp.h"
 #include "skizzay/cddd/version.h"
-#include "skizzay/cddd/views.h"
 
 #include <algorithm>
 #include <aws/dynamodb/DynamoDBClient.h>
@@ -23,9 +23,15 @@
 #include <cassert>
 #include <charconv>
 #include <concepts>
-#include <deque>
+#include <exception>
+#include <functional>
 #include <limits>
+#include <memory>
+#include <memory_resource>
+#include <optional>
 #include <ranges>
+#include <string>
+#include <string_view>
 
 namespace skizzay::cddd::dynamodb {
 namespace event_stream_details_ {
@@ -35,21 +41,166 @@ inline constexpr std::size_t dynamodb_batch_size = 100;
 template <typename T>
 using commit_error = operation_failed_error<commit_failed, T>;
 
+// A failed condition inside TransactWriteItems cancels the whole transaction;
+// the reasons for it are only given in the message.
+bool is_collision(auto const &error) {
+  switch (error.GetErrorType()) {
+  case Aws::DynamoDB::DynamoDBErrors::CONDITIONAL_CHECK_FAILED:
+  case Aws::DynamoDB::DynamoDBErrors::DUPLICATE_ITEM:
+  case Aws::DynamoDB::DynamoDBErrors::TRANSACTION_CONFLICT:
+    return true;
+
+  case Aws::DynamoDB::DynamoDBErrors::TRANSACTION_CANCELED: {
+    std::string_view const message = error.GetMessage();
+    return std::string_view::npos != message.find("ConditionalCheckFailed") ||
+           std::string_view::npos != message.find("TransactionConflict");
+  }
+
+  default:
+    return false;
+  }
+}
+
 template <std::unsigned_integral Version>
-Version parse_version(std::string const &version_string) {
-  Version parsed_value = std::numeric_limits<Version>::max();
-  auto const parse_result = std::from_chars(
-      version_string.data(), version_string.data() + version_string.size(),
-      parsed_value);
-  std::error_code const result_code = std::make_error_code(parse_result.ec);
-  if (result_code || (std::numeric_limits<Version>::max() == parsed_value)) {
-    throw version_validation_error{
-        result_code, "Cannot parse valid version from : " + version_string};
+[[noreturn]] void throw_commit_error(auto const &error,
+                                     Version const expected_version) {
+  if (is_collision(error)) {
+    throw optimistic_concurrency_collision{error.GetMessage(),
+                                           expected_version};
   } else {
-    return parsed_value;
+    throw commit_error{error};
+  }
+}
+
+using transact_write_items =
+    Aws::Vector<Aws::DynamoDB::Model::TransactWriteItem>;
+using transact_write_requests =
+    Aws::Vector<Aws::DynamoDB::Model::TransactWriteItemsRequest>;
+
+// Each batch of a commit is written under a token of its own, derived from
+// the commit id, so DynamoDB recognises a batch written again as already
+// applied rather than as a collision.
+inline Aws::String client_request_token(commit_id const &id,
+                                        std::size_t const batch) {
+  Aws::String result{id.str()};
+  if (0 != batch) {
+    result += '-';
+    result += std::to_string(batch);
+  }
+  return result;
+}
+
+// Whether the version record read back holds the commit id.
+inline bool holds_commit(Aws::DynamoDB::Model::GetItemOutcome const &outcome,
+                         Aws::String const &commit_id_name,
+                         commit_id const &commit) {
+  if (not outcome.IsSuccess()) {
+    return false;
   }
+  auto const &version_record = outcome.GetResult().GetItem();
+  auto const commit_id_iterator = version_record.find(commit_id_name);
+  return std::end(version_record) != commit_id_iterator &&
+         commit.str() == commit_id_iterator->second.GetS();
+}
+
+// What an asynchronous commit writes, shared by the callbacks of its batches,
+// which may run after the stream is gone.
+template <std::unsigned_integral Version> struct async_write {
+  // One per batch.
+  transact_write_requests requests;
+  // Reads back the commit id of the version record.
+  Aws::DynamoDB::Model::GetItemRequest commit_id_request;
+  Aws::String commit_id_name;
+  Version expected_version;
+  commit_id commit;
+};
+
+template <std::unsigned_integral Version>
+void write_async(Aws::DynamoDB::DynamoDBClient const &client,
+                 std::shared_ptr<async_write<Version> const> const &write,
+                 std::size_t batch, bool confirmed,
+                 commit_completion const &completed);
+
+// Carries on with the batch after one that was applied.
+template <std::unsigned_integral Version>
+void write_next_async(Aws::DynamoDB::DynamoDBClient const &client,
+                      std::shared_ptr<async_write<Version> const> const &write,
+                      std::size_t const next, bool const confirmed,
+                      commit_completion const &completed) {
+  if (next != std::size(write->requests)) {
+    write_async(client, write, next, confirmed, completed);
+  } else {
+    completed(nullptr);
+  }
+}
+
+// A first batch colliding with the version record is applied after all when
+// that record holds the commit's id, as with the synchronous commit. The
+// batches after it are then taken as applied should they collide too.
+template <std::unsigned_integral Version>
+void confirm_commit_async(
+    Aws::DynamoDB::DynamoDBClient const &client,
+    std::shared_ptr<async_write<Version> const> const &write,
+    Aws::DynamoDB::DynamoDBError const &collision, std::size_t const next,
+    commit_completion const &completed) {
+  client.GetItemAsync(
+      write->commit_id_request,
+      [write, collision, next, completed](
+          Aws::DynamoDB::DynamoDBClient const *const client,
+          Aws::DynamoDB::Model::GetItemRequest const &,
+          Aws::DynamoDB::Model::GetItemOutcome const &outcome,
+          std::shared_ptr<Aws::Client::AsyncCallerContext const> const &) {
+        try {
+          if (not holds_commit(outcome, write->commit_id_name, write->commit)) {
+            throw_commit_error(collision, write->expected_version);
+          }
+        } catch (...) {
+          completed(std::current_exception());
+          return;
+        }
+        write_next_async(*client, write, next, true, completed);
+      });
 }
 
+// Writes the batches from the given one on, each once the one before it has
+// succeeded.
+template <std::unsigned_integral Version>
+void write_async(Aws::DynamoDB::DynamoDBClient const &client,
+                 std::shared_ptr<async_write<Version> const> const &write,
+                 std::size_t const batch, bool const confirmed,
+                 commit_completion const &completed) {
+  std::size_t const next = batch + 1;
+  client.TransactWriteItemsAsync(
+      write->requests[batch],
+      [write, batch, next, confirmed, completed](
+          Aws::DynamoDB::DynamoDBClient const *const client,
+          Aws::DynamoDB::Model::TransactWriteItemsRequest const &,
+          Aws::DynamoDB::Model::TransactWriteItemsOutcome const &outcome,
+          std::shared_ptr<Aws::Client::AsyncCallerContext const> const &) {
+        if (not outcome.IsSuccess()) {
+          if (is_collision(outcome.GetError())) {
+            if (0 == batch) {
+              confirm_commit_async(*client, write, outcome.GetError(), next,
+                                   completed);
+              return;
+            } else if (confirmed) {
+              write_next_async(*client, write, next, true, completed);
+              return;
+            }
+          }
+          try {
+            throw_commit_error(outcome.GetError(), write->expected_version);
+          } catch (...) {
+            completed(std::current_exception());
+            return;
+          }
+        }
+        write_next_async(*client, write, next, confirmed, completed);
+      });
+}
+
+// The given memory resource backs the base's buffer, so Put requests buffered
+// past its inline capacity are allocated from it.
 template <concepts::clock Clock, concepts::domain_event... DomainEvents>
 struct impl : event_stream_base<impl<Clock, DomainEvents...>, Clock,
                                 Aws::DynamoDB::Model::Put, DomainEvents...> {
@@ -68,8 +219,10 @@ struct impl : event_stream_base<impl<Clock, DomainEvents...>, Clock,
                     Aws::DynamoDB::Model::TransactWriteItemsRequest>>
   impl(id_type id, serializer<DomainEvents...> &serializer,
        event_log_config const &config, Aws::DynamoDB::DynamoDBClient &client,
-       Clock clock, CommitRequestFactory &&get_request = {})
-      : base_type{std::move(clock)}, id_{id},
+       Clock clock, CommitRequestFactory &&get_request = {},
+       std::pmr::memory_resource *const resource =
+           std::pmr::get_default_resource())
+      : base_type{std::move(clock), resource}, id_{id},
         serializer_{serializer}, config_{config}, client_{client},
         get_request_{std::forward<decltype(get_request)>(get_request)} {}
 
@@ -99,26 +252,55 @@ struct impl : event_stream_base<impl<Clock, DomainEvents...>, Clock,
     }
   }
 
+  // The Puts are moved out of the buffer into the requests of the commit's
+  // batches once. A commit that fails other than by a collision keeps them,
+  // so a retry sends the very same requests; the base keeps the buffer, now
+  // holding moved-from Puts, until then. A retry whose first batch collides
+  // with the version record is recognised by the commit id that record holds,
+  // so a commit that landed after its request timed out is not mistaken for
+  // a concurrent one, even once DynamoDB has forgotten the token; the batches
+  // after it are then taken as applied should they collide too.
   void commit_buffered_events(buffer_type &&buffer, timestamp_type timestamp,
-                              version_type expected_version) {
-    auto commit_batch =
-        [this, expected_version](std::ranges::input_range auto batch) mutable {
-          auto request = get_request_().WithTransactItems(
-              Aws::Vector<Aws::DynamoDB::Model::TransactWriteItem>{
-                  std::ranges::begin(batch), std::ranges::end(batch)});
-          auto const outcome = client_.TransactWriteItems(request);
-          if (!outcome.IsSuccess()) {
-            throw_exception(outcome.GetError(), expected_version);
-          }
-        };
-    auto as_transact_write_item = [](auto &put) {
-      return Aws::DynamoDB::Model::TransactWriteItem{}.WithPut(std::move(put));
+                              version_type expected_version,
+                              commit_id const &commit) {
+    transact_write_requests const &requests =
+        pending_requests(buffer, timestamp, expected_version, commit);
+    bool confirmed = false;
+    for (std::size_t batch = 0; batch != std::size(requests); ++batch) {
+      auto const outcome = client_.TransactWriteItems(requests[batch]);
+      if (outcome.IsSuccess()) {
+        continue;
+      } else if (is_collision(outcome.GetError())) {
+        if (0 == batch) {
+          confirmed = is_latest_commit(commit);
+        }
+        if (confirmed) {
+          continue;
+        }
+        pending_.reset();
+      }
+      throw_exception(outcome.GetError(), expected_version);
+    }
+    pending_.reset();
+  }
+
+  // Written through the client's asynchronous interface.
+  commit_start prepare_async_commit(std::shared_ptr<buffer_type> buffer,
+                                    timestamp_type const timestamp,
+                                    version_type const expected_version,
+                                    commit_id const &commit) {
+    auto write = std::make_shared<async_write<version_type>>(
+        async_write<version_type>{
+            std::move(
+                pending_requests(*buffer, timestamp, expected_version, commit)),
+            commit_id_request(), config_.commit_id_name(), expected_version,
+            commit});
+    pending_.reset();
+    return [&client = client_,
+            write = std::shared_ptr<async_write<version_type> const>{
+                std::move(write)}](commit_completion const &completed) {
+      write_async(client, write, 0, false, completed);
     };
-    auto items_to_commit = views::concat(
-        views::single(get_version_write_item(timestamp, expected_version)),
-        buffer | views::transform(as_transact_write_item));
-    std::ranges::for_each(items_to_commit | views::chunk(dynamodb_batch_size),
-                          commit_batch);
   }
 
   template <concepts::domain_event DomainEvent>
@@ -147,7 +329,51 @@ struct impl : event_stream_base<impl<Clock, DomainEvents...>, Clock,
   }
 
 private:
-  Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> key() {
+  // The requests a commit is written with, kept until it succeeds or is
+  // dropped.
+  struct pending_commit {
+    commit_id commit;
+    transact_write_requests requests;
+  };
+
+  // The requests of a commit that failed and is now retried, or else those
+  // the buffered Puts are moved into.
+  transact_write_requests &pending_requests(buffer_type &buffer,
+                                            timestamp_type const timestamp,
+                                            version_type const expected_version,
+                                            commit_id const &commit) {
+    if (pending_.has_value() && commit == pending_->commit) {
+      return pending_->requests;
+    }
+    transact_write_requests requests;
+    requests.reserve(std::size(buffer) / dynamodb_batch_size + 1);
+    transact_write_items items;
+    auto add_request = [&, this]() {
+      requests.push_back(
+          get_request_()
+              .WithTransactItems(std::move(items))
+              .WithClientRequestToken(
+                  client_request_token(commit, std::size(requests))));
+      items = {};
+    };
+    items.reserve(std::min(std::size(buffer) + 1, dynamodb_batch_size));
+    items.push_back(get_version_write_item(timestamp, expected_version,
+                                           std::size(buffer), commit));
+    for (Aws::DynamoDB::Model::Put &put : buffer) {
+      if (dynamodb_batch_size == std::size(items)) {
+        add_request();
+        items.reserve(std::min(std::size(buffer) + 1 -
+                                   std::size(requests) * dynamodb_batch_size,
+                               dynamodb_batch_size));
+      }
+      items.push_back(
+          Aws::DynamoDB::Model::TransactWriteItem{}.WithPut(std::move(put)));
+    }
+    add_request();
+    return pending_.emplace(commit, std::move(requests)).requests;
+  }
+
+  Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> key() const {
     return {{this->config_.key_name(), attribute_value(id())},
             {this->config_.version_name(), attribute_value(0)}};
   }
@@ -160,10 +386,28 @@ private:
                                  ")");
   }
 
+  Aws::DynamoDB::Model::GetItemRequest commit_id_request() {
+    return Aws::DynamoDB::Model::GetItemRequest{}
+        .WithTableName(config_.table_name())
+        .WithKey(key())
+        .WithProjectionExpression(config_.commit_id_name())
+        .WithConsistentRead(true);
+  }
+
+  // Whether the version record was last written by the commit.
+  bool is_latest_commit(commit_id const &commit) {
+    return holds_commit(client_.GetItem(commit_id_request()),
+                        config_.commit_id_name(), commit);
+  }
+
   Aws::DynamoDB::Model::Put
-  get_starting_version_item(concepts::timestamp auto timestamp) {
-    auto result = Aws::DynamoDB::Model::Put{}.AddItem(
-        config_.max_version_name(), attribute_value(std::size(items_)));
+  get_starting_version_item(concepts::timestamp auto timestamp,
+                            std::size_t const num_events,
+                            commit_id const &commit) {
+    auto result =
+        Aws::DynamoDB::Model::Put{}
+            .AddItem(config_.max_version_name(), attribute_value(num_events))
+            .AddItem(config_.commit_id_name(), attribute_value(commit.str()));
     initialize(result, version_record_message_type);
     populate_commit_info(timestamp, 0, result);
     return result;
@@ -171,11 +415,14 @@ private:
 
   Aws::DynamoDB::Model::Update
   get_update_version_item(concepts::timestamp auto timestamp,
-                          version_type expected_version) {
-    auto const expression_attribute_values = [=, this]() {
-      item_type result{{":inc", attribute_value(std::size(items_))},
+                          version_type expected_version,
+                          std::size_t const num_events,
+                          commit_id const &commit) {
+    auto const expression_attribute_values = [&, this]() {
+      item_type result{{":inc", attribute_value(num_events)},
                        {":ver", attribute_value(expected_version)},
-                       {":ts", attribute_value(timestamp)}};
+                       {":ts", attribute_value(timestamp)},
+                       {":cid", attribute_value(commit.str())}};
       if (config_.ttl()) {
         // TODO: clock_cast is missing from GCC 11
         auto expiration = std::chrono::time_point_cast<std::chrono::seconds>(
@@ -188,7 +435,8 @@ private:
     auto const expression_attribute_names = [this]() {
       Aws::Map<Aws::String, Aws::String> result{
           {"#ver", config_.max_version_name()},
-          {"#ts", config_.timestamp_name()}};
+          {"#ts", config_.timestamp_name()},
+          {"#cid", config_.commit_id_name()}};
       if (config_.ttl()) {
         result.emplace("#ttl", config_.ttl()->name);
       }
@@ -196,8 +444,9 @@ private:
     };
     auto const update_expression = [this]() {
       return config_.ttl().has_value()
-                 ? "set #ver = #ver + :inc, #ts = :ts, #ttl = :ttl"
-                 : "set #ver = #ver + :inc, #ts = :ts";
+                 ? "set #ver = #ver + :inc, #ts = :ts, #cid = :cid, "
+                   "#ttl = :ttl"
+                 : "set #ver = #ver + :inc, #ts = :ts, #cid = :cid";
     };
     return Aws::DynamoDB::Model::Update{}
         .WithTableName(config_.table_name())
@@ -210,29 +459,23 @@ private:
 
   Aws::DynamoDB::Model::TransactWriteItem
   get_version_write_item(concepts::timestamp auto timestamp,
-                         version_type expected_version) {
+                         version_type expected_version,
+                         std::size_t const num_events,
+                         commit_id const &commit) {
     using Aws::DynamoDB::Model::TransactWriteItem;
     if (0 == expected_version) {
-      return TransactWriteItem{}.WithPut(get_starting_version_item(timestamp));
+      return TransactWriteItem{}.WithPut(
+          get_starting_version_item(timestamp, num_events, commit));
     } else {
-      return TransactWriteItem{}.WithUpdate(
-          get_update_version_item(timestamp, expected_version));
+      return TransactWriteItem{}.WithUpdate(get_update_version_item(
+          timestamp, expected_version, num_events, commit));
     }
   }
 
   [[noreturn]] void
   throw_exception(auto const &error,
                   version_type const expected_version) noexcept(false) {
-    switch (error.GetErrorType()) {
-    case Aws::DynamoDB::DynamoDBErrors::CONDITIONAL_CHECK_FAILED:
-    case Aws::DynamoDB::DynamoDBErrors::DUPLICATE_ITEM:
-    case Aws::DynamoDB::DynamoDBErrors::TRANSACTION_CONFLICT:
-      throw optimistic_concurrency_collision{error.GetMessage(),
-                                             expected_version};
-
-    default:
-      throw commit_error{error};
-    }
+    throw_commit_error(error, expected_version);
   }
 
   std::remove_cvref_t<id_type> id_;
@@ -241,7 +484,7 @@ private:
   Aws::DynamoDB::DynamoDBClient &client_;
   [[no_unique_address]] Clock clock_;
   std::function<Aws::DynamoDB::Model::TransactWriteItemsRequest()> get_request_;
-  std::deque<Aws::DynamoDB::Model::Put> items_;
+  std::optional<pending_commit> pending_;
 };
 } // namespace event_stream_details_
 
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "skizzay/cddd/dynamodb/dynamodb_attribute_value.h"
+#include "skizzay/cddd/dynamodb/dynamodb_deser.h"
+#include "skizzay/cddd/dynamodb/dynamodb_event_log_config.h"
+#include "skizzay/cddd/dynamodb/dynamodb_operation_failed_error.h"
+#include "skizzay/cddd/dynamodb/dynamodb_version_validation_error.h"
+#include "skizzay/cddd/history_load_failed.h"
+#include "skizzay/cddd/identifier.h"
+#include "skizzay/cddd/version.h"
+
+#include <aws/dynamodb/DynamoDBClient.h>
+#include <aws/dynamodb/model/PutItemRequest.h>
+#include <aws/dynamodb/model/QueryRequest.h>
+#include <charconv>
+#include <concepts>
+#include <future>
+#include <limits>
+#include <optional>
+#include <string>
+#include <system_error>
+
+namespace skizzay::cddd::dynamodb {
+using save_snapshot_error =
+    operation_failed_error<std::runtime_error, Aws::DynamoDB::DynamoDBError>;
+using load_snapshot_error =
+    operation_failed_error<history_load_failed, Aws::DynamoDB::DynamoDBError>;
+
+namespace snapshot_store_details_ {
+inline std::string const snapshot_message_type = "snapshot_";
+
+inline Aws::DynamoDB::Model::AttributeValue
+snapshot_sort_key(std::unsigned_integral auto const version) {
+  return Aws::DynamoDB::Model::AttributeValue{}.SetN("-" +
+                                                     std::to_string(version));
+}
+
+template <std::unsigned_integral Version>
+Version snapshot_version(
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> const &item,
+    event_log_config const &config) {
+  Aws::String const &sort_key = safe_get_item_value(
+      item, config.version_name(), &Aws::DynamoDB::Model::AttributeValue::GetN);
+  Version parsed_value = std::numeric_limits<Version>::max();
+  auto const first = sort_key.data() + (sort_key.starts_with('-') ? 1 : 0);
+  auto const parse_result =
+      std::from_chars(first, sort_key.data() + sort_key.size(), parsed_value);
+  std::error_code const result_code = std::make_error_code(parse_result.ec);
+  if (result_code || (0 == parsed_value)) {
+    throw version_validation_error{
+        result_code, "Cannot parse valid snapshot version from : " + sort_key};
+  } else {
+    return parsed_value;
+  }
+}
+
+template <typename Aggregate>
+requires concepts::versioned<Aggregate> && concepts::identifiable<Aggregate>
+struct impl {
+  using item_type = Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>;
+  using version_type = version_t<Aggregate>;
+
+  explicit impl(snapshot_serializer<Aggregate> &serializer,
+                event_log_config const &config,
+                Aws::DynamoDB::DynamoDBClient &client) noexcept
+      : serializer_{serializer}, config_{config}, client_{client} {}
+
+  void save_snapshot(Aggregate const &aggregate) {
+    using skizzay::cddd::id;
+    using skizzay::cddd::version;
+
+    version_type const snapshot_version = version(aggregate);
+    if (0 == snapshot_version) {
+      return;
+    }
+    item_type item = serializer_.serialize(aggregate);
+    item.insert_or_assign(config_.key_name(), attribute_value(id(aggregate)));
+    item.insert_or_assign(config_.version_name(),
+                          snapshot_sort_key(snapshot_version));
+    item.insert_or_assign(config_.type_name(),
+                          attribute_value(snapshot_message_type));
+    auto const outcome = client_.PutItem(
+        Aws::DynamoDB::Model::PutItemRequest{}
+            .WithTableName(config_.snapshot_table_name())
+            .WithItem(std::move(item)));
+    if (not outcome.IsSuccess()) {
+      throw save_snapshot_error{outcome.GetError()};
+    }
+  }
+
+  void load_from_snapshot(Aggregate &aggregate,
+                          version_type const target_version) {
+    using skizzay::cddd::id;
+    if (0 != target_version) {
+      auto const outcome = client_.Query(
+          latest_snapshot_request(id(aggregate), target_version));
+      apply_snapshot(outcome, aggregate);
+    }
+  }
+
+  std::future<Aws::DynamoDB::Model::QueryOutcome>
+  latest_snapshot_callable(id_t<Aggregate> id,
+                           version_type const target_version) const {
+    return client_.QueryCallable(latest_snapshot_request(id, target_version));
+  }
+
+  // Returns the version of the applied snapshot, or nothing when there was no
+  // snapshot newer than the aggregate.
+  std::optional<version_type>
+  apply_snapshot(Aws::DynamoDB::Model::QueryOutcome const &outcome,
+                 Aggregate &aggregate) const {
+    using skizzay::cddd::version;
+
+    if (not outcome.IsSuccess()) {
+      throw load_snapshot_error{outcome.GetError()};
+    }
+    auto const &items = outcome.GetResult().GetItems();
+    if (std::empty(items)) {
+      return std::nullopt;
+    }
+    auto const &item = items.front();
+    version_type const found_version =
+        snapshot_version<version_type>(item, config_);
+    if (found_version <= version(aggregate)) {
+      return std::nullopt;
+    }
+    serializer_.deserialize(item, aggregate);
+    return found_version;
+  }
+
+private:
+  // Snapshot sort keys are negated versions, so walking forward from
+  // -target_version yields the newest snapshot that does not exceed it.
+  Aws::DynamoDB::Model::QueryRequest
+  latest_snapshot_request(id_t<Aggregate> id,
+                          version_type const target_version) const {
+    return Aws::DynamoDB::Model::QueryRequest{}
+        .WithTableName(config_.snapshot_table_name())
+        .WithConsistentRead(true)
+        .WithKeyConditionExpression(
+            "(#pk = :pk) AND (#sk BETWEEN :sk_min AND :sk_max)")
+        .WithExpressionAttributeNames(Aws::Map<Aws::String, Aws::String>{
+            {"#pk", config_.key_name()}, {"#sk", config_.version_name()}})
+        .WithExpressionAttributeValues(
+            item_type{{":pk", attribute_value(id)},
+                      {":sk_min", snapshot_sort_key(target_version)},
+                      {":sk_max", snapshot_sort_key(version_type{1})}})
+        .WithScanIndexForward(true)
+        .WithLimit(1);
+  }
+
+  snapshot_serializer<Aggregate> &serializer_;
+  event_log_config const &config_;
+  Aws::DynamoDB::DynamoDBClient &client_;
+};
+} // namespace snapshot_store_details_
+
+template <typename Aggregate>
+using snapshot_store = snapshot_store_details_::impl<Aggregate>;
+} // namespace skizzay::cddd::dynamodb
@@ -8,15 +8,25 @@
 #include "skizzay/cddd/dynamodb/dynamodb_version_validation_error.h"
 #include "skizzay/cddd/identifier.h"
 #include "skizzay/cddd/narrow_cast.h"
+#include "skizzay/cddd/retry_policy.h"
 #include <aws/dynamodb/DynamoDBClient.h>
 #include <aws/dynamodb/model/AttributeValue.h>
+#include <aws/dynamodb/model/BatchGetItemRequest.h>
 #include <aws/dynamodb/model/GetItemRequest.h>
+#include <aws/dynamodb/model/KeysAndAttributes.h>
 #include <aws/dynamodb/model/Put.h>
 #include <aws/dynamodb/model/TransactWriteItem.h>
 #include <aws/dynamodb/model/Update.h>
+#include <algorithm>
 #include <charconv>
+#include <chrono>
 #include <concepts>
+#include <future>
+#include <limits>
+#include <ranges>
 #include <system_error>
+#include <unordered_map>
+#include <vector>
 
 namespace skizzay::cddd::dynamodb {
 
@@ -25,9 +35,19 @@ struct update_version_failed
   using operation_failed_error::operation_failed_error;
 };
 
+struct version_lookup_failed : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+using version_lookup_error =
+    operation_failed_error<version_lookup_failed, Aws::DynamoDB::DynamoDBError>;
+
 namespace version_service_details_ {
 inline std::string const version_record_message_type = "version_";
 inline std::string const version_field_value = "0";
+inline constexpr std::size_t batch_get_item_limit = 100;
+inline constexpr retry_policy default_lookup_policy{
+    8, std::chrono::milliseconds{25}, std::chrono::seconds{1}};
 
 struct impl {
   using item_type = Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>;
@@ -77,7 +97,7 @@ struct impl {
 
   Aws::DynamoDB::Model::Update update_starting_version_record(
       std::unsigned_integral auto const num_items_in_commit,
-      concepts::version expected_version, item_type &&key,
+      std::unsigned_integral auto const expected_version, item_type &&key,
       std::chrono::sys_seconds timestamp) const {
     auto const expression_attribute_values = [&]() {
       item_type result{
@@ -193,4 +213,143 @@ struct version_service : private version_service_details_::impl {
 
   std::remove_cvref_t<id_t<DomainEvents...>> id_;
 };
+
+// Resolves the versions of many streams at once. Keys are grouped into
+// BatchGetItem requests of up to 100 keys which are all put in flight
+// together; unprocessed keys are resubmitted after backing off as the retry
+// policy says, so lookups throttled together spread out rather than retry in
+// lockstep.
+template <concepts::domain_event... DomainEvents> struct version_lookup {
+  using id_type = std::remove_cvref_t<id_t<DomainEvents...>>;
+  using version_type = version_t<DomainEvents...>;
+  using item_type = Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>;
+  using result_type = std::unordered_map<id_type, version_type>;
+
+  explicit version_lookup(
+      Aws::DynamoDB::DynamoDBClient &client, event_log_config const &config,
+      retry_policy const policy =
+          version_service_details_::default_lookup_policy) noexcept
+      : client_{client}, config_{config}, policy_{policy} {}
+
+  template <std::ranges::input_range Ids>
+  requires std::convertible_to<std::ranges::range_reference_t<Ids>, id_type>
+  result_type versions(Ids &&ids) const {
+    result_type result;
+    std::unordered_map<Aws::String, id_type> ids_by_key;
+    Aws::Vector<item_type> keys;
+    for (auto &&id : ids) {
+      item_type key = key_for(id);
+      auto [iterator, is_new_entry] = ids_by_key.emplace(
+          key_string(key.at(config_.key_name())), id_type(id));
+      if (is_new_entry) {
+        result.emplace(iterator->second, version_type{0});
+        keys.emplace_back(std::move(key));
+      }
+    }
+
+    std::vector<Aws::DynamoDB::Model::BatchGetItemRequest> requests;
+    for (std::size_t i = 0; i < std::size(keys);
+         i += version_service_details_::batch_get_item_limit) {
+      auto const first = std::begin(keys) + narrow_cast<std::ptrdiff_t>(i);
+      auto const last =
+          first + narrow_cast<std::ptrdiff_t>(std::min(
+                      version_service_details_::batch_get_item_limit,
+                      std::size(keys) - i));
+      requests.emplace_back(batch_request(Aws::Vector<item_type>{
+          std::move_iterator{first}, std::move_iterator{last}}));
+    }
+
+    for (std::size_t attempt = 0; not std::empty(requests); ++attempt) {
+      if (attempt == policy_.max_attempts) {
+        throw version_lookup_failed{
+            "Unprocessed keys remain after all version lookup attempts"};
+      } else if (0 != attempt) {
+        back_off(policy_, attempt);
+      }
+      requests = process_responses(submit(requests), ids_by_key, result);
+    }
+    return result;
+  }
+
+private:
+  std::vector<std::future<Aws::DynamoDB::Model::BatchGetItemOutcome>>
+  submit(std::vector<Aws::DynamoDB::Model::BatchGetItemRequest> const
+             &requests) const {
+    std::vector<std::future<Aws::DynamoDB::Model::BatchGetItemOutcome>>
+        pending;
+    pending.reserve(std::size(requests));
+    for (auto const &request : requests) {
+      pending.emplace_back(client_.BatchGetItemCallable(request));
+    }
+    return pending;
+  }
+
+  std::vector<Aws::DynamoDB::Model::BatchGetItemRequest> process_responses(
+      std::vector<std::future<Aws::DynamoDB::Model::BatchGetItemOutcome>>
+          pending,
+      std::unordered_map<Aws::String, id_type> const &ids_by_key,
+      result_type &result) const {
+    std::vector<Aws::DynamoDB::Model::BatchGetItemRequest> retries;
+    for (auto &future : pending) {
+      auto const outcome = future.get();
+      if (not outcome.IsSuccess()) {
+        throw version_lookup_error{outcome.GetError()};
+      }
+      auto const &responses = outcome.GetResult().GetResponses();
+      if (auto const items = responses.find(config_.table_name());
+          std::end(responses) != items) {
+        for (auto const &item : items->second) {
+          result[ids_by_key.at(key_string(item.at(config_.key_name())))] =
+              max_version(item);
+        }
+      }
+      auto const &unprocessed = outcome.GetResult().GetUnprocessedKeys();
+      if (auto const keys = unprocessed.find(config_.table_name());
+          std::end(unprocessed) != keys &&
+          not std::empty(keys->second.GetKeys())) {
+        retries.emplace_back(
+            Aws::DynamoDB::Model::BatchGetItemRequest{}.AddRequestItems(
+                config_.table_name(), keys->second));
+      }
+    }
+    return retries;
+  }
+
+  Aws::DynamoDB::Model::BatchGetItemRequest
+  batch_request(Aws::Vector<item_type> keys) const {
+    return Aws::DynamoDB::Model::BatchGetItemRequest{}.AddRequestItems(
+        config_.table_name(),
+        Aws::DynamoDB::Model::KeysAndAttributes{}
+            .WithKeys(std::move(keys))
+            .WithProjectionExpression("#pk, #ver")
+            .WithExpressionAttributeNames(Aws::Map<Aws::String, Aws::String>{
+                {"#pk", config_.key_name()},
+                {"#ver", config_.max_version_name()}})
+            .WithConsistentRead(true));
+  }
+
+  item_type key_for(auto const &id) const {
+    return {{config_.key_name(), attribute_value(id)},
+            {config_.version_name(), attribute_value(0)}};
+  }
+
+  static Aws::String
+  key_string(Aws::DynamoDB::Model::AttributeValue const &value) {
+    return Aws::DynamoDB::Model::ValueType::NUMBER == value.GetType()
+               ? value.GetN()
+               : value.GetS();
+  }
+
+  version_type max_version(item_type const &item) const {
+    auto const max_version_iterator = item.find(config_.max_version_name());
+    if (std::end(item) == max_version_iterator) {
+      return 0;
+    }
+    return parse_version<version_type>(max_version_iterator->second.GetN());
+  }
+
+  Aws::DynamoDB::DynamoDBClient &client_;
+  event_log_config const &config_;
+  retry_policy policy_;
+};
 } // namespace skizzay::cddd::dynamodb
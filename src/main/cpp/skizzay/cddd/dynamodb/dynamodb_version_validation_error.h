@@ -1,7 +1,11 @@
 #pragma once
 
 #include "skizzay/cddd/history_load_failed.h"
+#include <charconv>
+#include <concepts>
+#include <limits>
 #include <stdexcept>
+#include <string>
 #include <system_error>
 
 namespace skizzay::cddd::dynamodb {
@@ -11,4 +15,19 @@ struct version_validation_error : event_deserialization_failed {
 
   std::error_code ec;
 };
+
+template <std::unsigned_integral Version>
+Version parse_version(std::string const &version_string) {
+  Version parsed_value = std::numeric_limits<Version>::max();
+  auto const parse_result = std::from_chars(
+      version_string.data(), version_string.data() + version_string.size(),
+      parsed_value);
+  std::error_code const result_code = std::make_error_code(parse_result.ec);
+  if (result_code || (std::numeric_limits<Version>::max() == parsed_value)) {
+    throw version_validation_error{
+        result_code, "Cannot parse valid version from : " + version_string};
+  } else {
+    return parsed_value;
+  }
+}
 } // namespace skizzay::cddd::dynamodb
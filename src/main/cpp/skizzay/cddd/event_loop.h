@@ -0,0 +1,88 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <utility>
+
+namespace skizzay::cddd {
+
+// Runs the work posted to it, one item at a time, on the thread calling run.
+// Work may be posted from any thread. Coroutines spawned on the loop are
+// resumed through it once what they awaited completes, wherever that was, so
+// they never run concurrently with one another.
+struct event_loop {
+  event_loop() = default;
+  event_loop(event_loop const &) = delete;
+  event_loop &operator=(event_loop const &) = delete;
+
+  // Coroutine handles are posted as they are; resuming them is calling them.
+  void post(std::function<void()> work) {
+    std::lock_guard l_{m_};
+    work_.push_back(std::move(work));
+    cv_.notify_one();
+  }
+
+  // Runs until the loop is stopped, or until there is no work left and no
+  // outstanding work that may post more. Rethrows the first failure reported
+  // through fail, once the work running at the time has returned.
+  void run() {
+    for (;;) {
+      std::unique_lock l_{m_};
+      cv_.wait(l_, [this]() {
+        return stopped_ || nullptr != error_ || not std::empty(work_) ||
+               0 == outstanding_;
+      });
+      if (nullptr != error_) {
+        std::rethrow_exception(std::exchange(error_, nullptr));
+      } else if (stopped_ || std::empty(work_)) {
+        return;
+      }
+      std::function<void()> const work = std::move(work_.front());
+      work_.pop_front();
+      l_.unlock();
+      work();
+    }
+  }
+
+  void stop() {
+    std::lock_guard l_{m_};
+    stopped_ = true;
+    cv_.notify_one();
+  }
+
+  // Outstanding work keeps run from returning while nothing is posted, such
+  // as a coroutine waiting on I/O. The loop is notified with the lock held, as
+  // run returning may be what lets the loop be destroyed.
+  void work_started() {
+    std::lock_guard l_{m_};
+    ++outstanding_;
+  }
+
+  void work_finished() {
+    std::lock_guard l_{m_};
+    --outstanding_;
+    cv_.notify_one();
+  }
+
+  void fail(std::exception_ptr const error) {
+    std::lock_guard l_{m_};
+    if (nullptr == error_) {
+      error_ = error;
+    }
+    cv_.notify_one();
+  }
+
+private:
+  std::mutex m_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> work_;
+  std::size_t outstanding_ = 0;
+  bool stopped_ = false;
+  std::exception_ptr error_;
+};
+
+} // namespace skizzay::cddd
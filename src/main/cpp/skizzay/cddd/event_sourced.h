@@ -1,9 +1,13 @@
 #pragma once
 
 #include "skizzay/cddd/domain_event.h"
+#include "skizzay/cddd/task.h"
 #include "skizzay/cddd/version.h"
+#include <array>
+#include <exception>
 #include <functional>
 #include <memory>
+#include <span>
 #include <variant>
 
 namespace skizzay::cddd {
@@ -98,6 +102,79 @@ struct apply_fn final {
         },
         domain_event);
   }
+
+  // Closed-set dispatch: a table indexed by the held event's position in
+  // DomainEvents, built at compile time, applies it without visiting it.
+  template <typename T, concepts::domain_event... DomainEvents>
+  requires(std::invocable<apply_fn const, T &,
+                          std::remove_cvref_t<DomainEvents> const &> &&...)
+  void operator()(T &t,
+                  event_interface<DomainEvents...> const &domain_event) const
+      noexcept((std::is_nothrow_invocable_v<
+                    apply_fn const, T &,
+                    std::remove_cvref_t<DomainEvents> const &> &&
+                ...)) {
+    using handler_type =
+        void (*)(T &, event_interface<DomainEvents...> const &);
+    static constexpr std::array<handler_type, sizeof...(DomainEvents)>
+        handlers{&apply_held_event<T, std::remove_cvref_t<DomainEvents>,
+                                   DomainEvents...>...};
+    handlers[domain_event.event_index()](t, domain_event);
+  }
+
+private:
+  template <typename T, concepts::domain_event DomainEvent,
+            concepts::domain_event... DomainEvents>
+  static void
+  apply_held_event(T &t, event_interface<DomainEvents...> const &domain_event) {
+    std::invoke(apply_fn{}, t, domain_event.template get_event<DomainEvent>());
+  }
+};
+
+template <typename... Ts> void apply_range(Ts const &...) = delete;
+
+template <typename T, typename DomainEvent>
+concept member_apply_range = requires(T &t,
+                                      std::span<DomainEvent const> events) {
+  {t.apply_range(events)};
+};
+
+template <typename T, typename DomainEvent>
+concept adl_apply_range = requires(T &t, std::span<DomainEvent const> events) {
+  {apply_range(t, events)};
+};
+
+struct apply_range_fn final {
+  template <typename T, concepts::domain_event DomainEvent>
+  requires member_apply_range<T, DomainEvent>
+  constexpr void operator()(T &t,
+                            std::span<DomainEvent const> const events) const
+      noexcept(noexcept(t.apply_range(events))) {
+    t.apply_range(events);
+  }
+
+  template <typename T, concepts::domain_event DomainEvent>
+  requires(not member_apply_range<T, DomainEvent>) &&
+      adl_apply_range<T, DomainEvent>
+  constexpr void operator()(T &t,
+                            std::span<DomainEvent const> const events) const
+      noexcept(noexcept(apply_range(t, events))) {
+    apply_range(t, events);
+  }
+
+  // Aggregates that have not opted in are handed each event in turn.
+  template <typename T, concepts::domain_event DomainEvent>
+  requires(not member_apply_range<T, DomainEvent>) &&
+      (not adl_apply_range<T, DomainEvent>) &&
+      std::invocable<apply_fn const, T &, DomainEvent const &>
+  constexpr void operator()(T &t,
+                            std::span<DomainEvent const> const events) const
+      noexcept(std::is_nothrow_invocable_v<apply_fn const, T &,
+                                           DomainEvent const &>) {
+    for (DomainEvent const &domain_event : events) {
+      apply_fn{}(t, domain_event);
+    }
+  }
 };
 
 template <typename... Ts> void load_from_history(Ts const &...) = delete;
@@ -137,6 +214,79 @@ struct load_from_history_fn final {
   }
 };
 
+template <typename... Ts> void load_as_of(Ts const &...) = delete;
+
+// Loads the events committed no later than the timestamp, leaving the
+// aggregate as its stream was at that time.
+struct load_as_of_fn final {
+  template <typename EventSource, concepts::versioned Aggregate,
+            concepts::timestamp Timestamp>
+  requires requires(EventSource &event_source, Aggregate &aggregate,
+                    Timestamp const as_of) {
+    event_source.load_as_of(aggregate, as_of);
+  }
+  constexpr void operator()(EventSource &event_source, Aggregate &aggregate,
+                            Timestamp const as_of) const
+      noexcept(noexcept(event_source.load_as_of(aggregate, as_of))) {
+    event_source.load_as_of(aggregate, as_of);
+  }
+
+  template <typename EventSource, concepts::versioned Aggregate,
+            concepts::timestamp Timestamp>
+  requires requires(EventSource &event_source, Aggregate &aggregate,
+                    Timestamp const as_of) {
+    load_as_of(event_source, aggregate, as_of);
+  }
+  constexpr void operator()(EventSource &event_source, Aggregate &aggregate,
+                            Timestamp const as_of) const
+      noexcept(noexcept(load_as_of(event_source, aggregate, as_of))) {
+    load_as_of(event_source, aggregate, as_of);
+  }
+};
+
+template <typename EventSource, typename Aggregate>
+concept has_load_from_history_async =
+    requires(EventSource &event_source, Aggregate &aggregate,
+             version_t<Aggregate> const target_version,
+             std::function<void(std::exception_ptr)> loaded) {
+  event_source.load_from_history_async(aggregate, target_version,
+                                       std::move(loaded));
+};
+
+// Awaiting the result suspends the coroutine until the aggregate is loaded.
+// Event sources that cannot load asynchronously load without suspending.
+struct co_load_from_history_fn final {
+  template <typename EventSource, concepts::versioned Aggregate>
+  requires has_load_from_history_async<EventSource, Aggregate> ||
+      std::invocable<load_from_history_fn const, EventSource &, Aggregate &,
+                     version_t<Aggregate> const>
+  auto operator()(EventSource &event_source, Aggregate &aggregate,
+                  version_t<Aggregate> const target_version) const {
+    return completion_awaiter{
+        [&event_source, &aggregate,
+         target_version](std::function<void(std::exception_ptr)> loaded) {
+          if constexpr (has_load_from_history_async<EventSource, Aggregate>) {
+            event_source.load_from_history_async(aggregate, target_version,
+                                                 std::move(loaded));
+          } else {
+            try {
+              load_from_history_fn{}(event_source, aggregate, target_version);
+            } catch (...) {
+              loaded(std::current_exception());
+              return;
+            }
+            loaded(nullptr);
+          }
+        }};
+  }
+
+  template <typename EventSource, concepts::versioned Aggregate>
+  auto operator()(EventSource &event_source, Aggregate &aggregate) const {
+    return (*this)(event_source, aggregate,
+                   std::numeric_limits<version_t<Aggregate>>::max());
+  }
+};
+
 template <typename... Ts> void load_from_snapshot(Ts const &...) = delete;
 
 struct load_from_snapshot_fn final {
@@ -180,9 +330,21 @@ struct load_from_snapshot_fn final {
 
 inline namespace cpo_fn_ {
 inline constexpr cpo_details_::apply_fn apply = {};
+inline constexpr cpo_details_::apply_range_fn apply_range = {};
 inline constexpr cpo_details_::load_from_history_fn load_from_history = {};
+inline constexpr cpo_details_::load_as_of_fn load_as_of = {};
+inline constexpr cpo_details_::co_load_from_history_fn co_load_from_history =
+    {};
 inline constexpr cpo_details_::load_from_snapshot_fn load_from_snapshot = {};
 } // namespace cpo_fn_
 
+namespace concepts {
+// Whether the aggregate folds runs of the event type itself, rather than
+// being handed them one at a time.
+template <typename T, typename DomainEvent>
+concept range_applicable = domain_event<DomainEvent> &&
+    (cpo_details_::member_apply_range<T, DomainEvent> ||
+     cpo_details_::adl_apply_range<T, DomainEvent>);
+} // namespace concepts
 
 } // namespace skizzay::cddd
@@ -1,13 +1,29 @@
 #pragma once
 
+#include "skizzay/cddd/commit_id.h"
+#include "skizzay/cddd/commit_sequence.h"
 #include "skizzay/cddd/domain_event.h"
 #include "skizzay/cddd/identifier.h"
+#include "skizzay/cddd/narrow_cast.h"
+#include "skizzay/cddd/optimistic_concurrency_collision.h"
+#include "skizzay/cddd/small_vector.h"
+#include "skizzay/cddd/task.h"
 #include "skizzay/cddd/views.h"
 
 #include <algorithm>
 #include <concepts>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace skizzay::cddd {
 namespace event_stream_details_ {
@@ -101,11 +117,162 @@ struct rollback_fn final {
     t.rollback();
   }
 };
+
+template <typename... Ts> void commit_events_async(Ts const &...) = delete;
+
+template <typename T, typename V>
+concept has_commit_events_async = requires(T &t, V const v) {
+  { t.commit_events_async(v) } -> std::same_as<std::future<void>>;
+} || requires(T &t, V const v) {
+  { commit_events_async(t, v) } -> std::same_as<std::future<void>>;
+};
+
+// The returned future completes once the events are committed, or holds the
+// failure. Commits issued through one stream complete in the order they were
+// issued.
+struct commit_events_async_fn final {
+  template <typename T, std::unsigned_integral V>
+  requires requires(T &t, V const v) {
+    { commit_events_async(t, v) } -> std::same_as<std::future<void>>;
+  }
+  std::future<void> operator()(T &t, V const v) const {
+    return commit_events_async(t, v);
+  }
+
+  template <typename T, std::unsigned_integral V>
+  requires requires(T &t, V const v) {
+    { t.commit_events_async(v) } -> std::same_as<std::future<void>>;
+  }
+  std::future<void> operator()(T &t, V const v) const {
+    return t.commit_events_async(v);
+  }
+
+  // Streams without an asynchronous commit are committed synchronously,
+  // returning a future that is already complete.
+  template <typename T, std::unsigned_integral V>
+  requires std::invocable<commit_events_fn const,
+                          std::add_lvalue_reference_t<T>, V> &&
+      (not has_commit_events_async<T, V>)std::future<void>
+      operator()(T &t, V const v) const {
+    std::promise<void> promise;
+    try {
+      commit_events_fn{}(t, v);
+      promise.set_value();
+    } catch (...) {
+      promise.set_exception(std::current_exception());
+    }
+    return promise.get_future();
+  }
+
+  template <typename T, std::signed_integral I>
+  requires std::invocable<commit_events_async_fn const,
+                          std::add_lvalue_reference_t<T>,
+                          std::make_unsigned_t<I>>
+  std::future<void> operator()(T &t, I const i) const {
+    return (*this)(t, narrow_cast<std::make_unsigned_t<I>>(i));
+  }
+};
+
+// The future of an operation started with a completion callback.
+template <std::invocable<commit_completion> Start>
+std::future<void> future_of(Start &&start) {
+  auto const promise = std::make_shared<std::promise<void>>();
+  std::future<void> result = promise->get_future();
+  start([promise](std::exception_ptr const error) {
+    if (nullptr == error) {
+      promise->set_value();
+    } else {
+      promise->set_exception(error);
+    }
+  });
+  return result;
+}
+
+template <typename T, typename V>
+concept has_commit_events_then =
+    requires(T &t, V const v, commit_completion completed) {
+  t.commit_events_async(v, std::move(completed));
+};
+
+// Commits through the stream's asynchronous commit when it has one, or
+// synchronously otherwise, completing with whatever the commit threw.
+template <typename T, std::unsigned_integral V>
+void commit_then(T &t, V const v, commit_completion completed) {
+  if constexpr (has_commit_events_then<T, V>) {
+    t.commit_events_async(v, std::move(completed));
+  } else {
+    try {
+      commit_events_fn{}(t, v);
+    } catch (...) {
+      completed(std::current_exception());
+      return;
+    }
+    completed(nullptr);
+  }
+}
+
+// Awaiting the result suspends the coroutine until the events are committed.
+// Streams without an asynchronous commit are committed without suspending.
+struct co_commit_events_fn final {
+  template <typename T, std::unsigned_integral V>
+  requires has_commit_events_then<T, V> ||
+      std::invocable<commit_events_fn const, std::add_lvalue_reference_t<T>, V>
+  auto operator()(T &t, V const v) const {
+    return completion_awaiter{[&t, v](commit_completion completed) {
+      commit_then(t, v, std::move(completed));
+    }};
+  }
+
+  template <typename T, std::signed_integral I>
+  requires std::invocable<co_commit_events_fn const,
+                          std::add_lvalue_reference_t<T>,
+                          std::make_unsigned_t<I>>
+  auto operator()(T &t, I const i) const {
+    return (*this)(t, narrow_cast<std::make_unsigned_t<I>>(i));
+  }
+};
+
+template <typename Derived, typename Buffer, typename Timestamp,
+          typename Version>
+concept idempotently_async_committable =
+    requires(Derived &derived, std::shared_ptr<Buffer> buffer,
+             Timestamp const timestamp, Version const expected_version,
+             commit_id const &id) {
+  {
+    derived.prepare_async_commit(std::move(buffer), timestamp,
+                                 expected_version, id)
+    } -> std::convertible_to<commit_start>;
+};
+
+template <typename Derived, typename Buffer, typename Timestamp,
+          typename Version>
+concept async_committable =
+    idempotently_async_committable<Derived, Buffer, Timestamp, Version> ||
+    requires(Derived &derived, std::shared_ptr<Buffer> buffer,
+             Timestamp const timestamp, Version const expected_version) {
+  {
+    derived.prepare_async_commit(std::move(buffer), timestamp,
+                                 expected_version)
+    } -> std::convertible_to<commit_start>;
+};
+
+template <typename Derived, typename Buffer, typename Timestamp,
+          typename Version>
+concept idempotently_committable =
+    requires(Derived &derived, Buffer &&buffer, Timestamp const timestamp,
+             Version const expected_version, commit_id const &id) {
+  derived.commit_buffered_events(std::move(buffer), timestamp,
+                                 expected_version, id);
+};
 } // namespace event_stream_details_
 
 inline namespace event_stream_fn_ {
 inline constexpr event_stream_details_::add_event_fn add_event = {};
 inline constexpr event_stream_details_::commit_events_fn commit_events = {};
+inline constexpr event_stream_details_::commit_events_async_fn
+    commit_events_async = {};
+inline constexpr event_stream_details_::co_commit_events_fn co_commit_events =
+    {};
 inline constexpr event_stream_details_::rollback_fn rollback = {};
 } // namespace event_stream_fn_
 
@@ -181,12 +348,184 @@ type_erase(concepts::event_stream_of<DomainEvents...> auto event_stream) {
   return std::make_unique<impl>(std::move(event_stream));
 }
 
+namespace event_stream_details_ {
+// Large enough for the in-memory and Kafka event streams, including their
+// inline event buffers. DynamoDB streams, which buffer whole Put requests,
+// are kept on the heap.
+inline constexpr std::size_t any_event_stream_buffer_size = 64 * sizeof(void *);
+
+template <concepts::domain_event... DomainEvents> struct any_vtable final {
+  using version_type = version_t<DomainEvents...>;
+
+  template <typename EventStream, bool Inline>
+  static constexpr any_vtable make() noexcept {
+    return {
+        Inline,
+        [](void const *const object) -> version_type {
+          return skizzay::cddd::version(
+              *static_cast<EventStream const *>(object));
+        },
+        [](void *const object, version_type const expected_version) {
+          skizzay::cddd::commit_events(*static_cast<EventStream *>(object),
+                                       expected_version);
+        },
+        [](void *const object, version_type const expected_version,
+           commit_completion completed) {
+          commit_then(*static_cast<EventStream *>(object), expected_version,
+                      std::move(completed));
+        },
+        [](void *const object) {
+          skizzay::cddd::rollback(*static_cast<EventStream *>(object));
+        },
+        [](void *const target, void *const object) noexcept {
+          if constexpr (Inline) {
+            ::new (target)
+                EventStream{std::move(*static_cast<EventStream *>(object))};
+          }
+        },
+        [](void *const object) noexcept {
+          if constexpr (Inline) {
+            static_cast<EventStream *>(object)->~EventStream();
+          } else {
+            delete static_cast<EventStream *>(object);
+          }
+        },
+        {[](void *const object,
+            std::remove_cvref_t<DomainEvents> &&domain_event) {
+          skizzay::cddd::add_event(*static_cast<EventStream *>(object),
+                                   std::move(domain_event));
+        }...}};
+  }
+
+  bool is_inline;
+  version_type (*version)(void const *);
+  void (*commit_events)(void *, version_type);
+  void (*commit_events_async)(void *, version_type, commit_completion);
+  void (*rollback)(void *);
+  void (*move_to)(void *, void *) noexcept;
+  void (*destroy)(void *) noexcept;
+  std::tuple<void (*)(void *, std::remove_cvref_t<DomainEvents> &&)...>
+      add_event;
+};
+
+template <typename EventStream>
+inline constexpr bool fits_inline =
+    sizeof(EventStream) <= any_event_stream_buffer_size &&
+    alignof(EventStream) <= alignof(std::max_align_t) &&
+    std::is_nothrow_move_constructible_v<EventStream>;
+
+template <typename EventStream, concepts::domain_event... DomainEvents>
+inline constexpr any_vtable<DomainEvents...> any_vtable_for =
+    any_vtable<DomainEvents...>::template make<
+        EventStream, fits_inline<EventStream>>();
+} // namespace event_stream_details_
+
+// Holds any event stream of DomainEvents by value. Streams small enough are
+// kept in an inline buffer, so erasing the streams of the library's stores
+// does not allocate, and operations dispatch through a flat table of function
+// pointers rather than virtual bases. Larger streams are kept on the heap.
+template <concepts::domain_event... DomainEvents> struct any_event_stream {
+  using version_type = version_t<DomainEvents...>;
+
+  template <typename EventStream>
+  requires(not std::same_as<EventStream, any_event_stream>) &&
+      concepts::event_stream_of<EventStream, DomainEvents...>
+  explicit any_event_stream(EventStream event_stream)
+      : vtable_{&event_stream_details_::any_vtable_for<EventStream,
+                                                       DomainEvents...>} {
+    if constexpr (event_stream_details_::fits_inline<EventStream>) {
+      object_ = ::new (static_cast<void *>(buffer_))
+          EventStream{std::move(event_stream)};
+    } else {
+      object_ = new EventStream{std::move(event_stream)};
+    }
+  }
+
+  any_event_stream(any_event_stream &&other) noexcept
+      : vtable_{other.vtable_} {
+    take(other);
+  }
+
+  any_event_stream &operator=(any_event_stream &&other) noexcept {
+    if (this != &other) {
+      reset();
+      vtable_ = other.vtable_;
+      take(other);
+    }
+    return *this;
+  }
+
+  ~any_event_stream() { reset(); }
+
+  version_type version() const { return vtable_->version(object_); }
+
+  template <concepts::domain_event DomainEvent>
+  requires(std::same_as<std::remove_cvref_t<DomainEvent>,
+                        std::remove_cvref_t<DomainEvents>> ||
+           ...) void add_event(DomainEvent &&domain_event) {
+    using event_type = std::remove_cvref_t<DomainEvent>;
+    constexpr std::size_t index =
+        domain_event_details_::index_of<event_type, DomainEvents...>();
+    std::get<index>(vtable_->add_event)(
+        object_, event_type{std::forward<DomainEvent>(domain_event)});
+  }
+
+  void commit_events(version_type const expected_version) {
+    vtable_->commit_events(object_, expected_version);
+  }
+
+  std::future<void> commit_events_async(version_type const expected_version) {
+    return event_stream_details_::future_of(
+        [&, this](commit_completion completed) {
+          commit_events_async(expected_version, std::move(completed));
+        });
+  }
+
+  void commit_events_async(version_type const expected_version,
+                           commit_completion completed) {
+    vtable_->commit_events_async(object_, expected_version,
+                                 std::move(completed));
+  }
+
+  void rollback() { vtable_->rollback(object_); }
+
+private:
+  void take(any_event_stream &other) noexcept {
+    if (nullptr == other.object_) {
+      object_ = nullptr;
+    } else if (vtable_->is_inline) {
+      vtable_->move_to(buffer_, other.object_);
+      object_ = buffer_;
+      other.reset();
+    } else {
+      object_ = std::exchange(other.object_, nullptr);
+    }
+  }
+
+  void reset() noexcept {
+    if (nullptr != object_) {
+      vtable_->destroy(std::exchange(object_, nullptr));
+    }
+  }
+
+  event_stream_details_::any_vtable<DomainEvents...> const *vtable_;
+  void *object_ = nullptr;
+  alignas(std::max_align_t) std::byte
+      buffer_[event_stream_details_::any_event_stream_buffer_size];
+};
+
+// Uncommitted events are buffered inline up to InlineCapacity; the buffer is
+// reused across commits. Events past that are buffered in the given memory
+// resource, which derived streams may also use for their own transient
+// allocations, so a per-command arena releases them all at once.
 template <typename Derived, concepts::clock Clock, typename Element,
-          concepts::domain_event... DomainEvents>
-struct event_stream_base {
+          std::size_t InlineCapacity, concepts::domain_event... DomainEvents>
+struct basic_event_stream_base {
   using id_type = id_t<DomainEvents...>;
   using element_type = Element;
-  using buffer_type = std::vector<element_type>;
+  using allocator_type = std::pmr::polymorphic_allocator<element_type>;
+  using buffer_type =
+      small_vector<element_type, InlineCapacity, allocator_type>;
   using version_type = version_t<DomainEvents...>;
   using timestamp_type = timestamp_t<DomainEvents...>;
 
@@ -194,47 +533,202 @@ struct event_stream_base {
   requires(std::same_as<std::remove_cvref_t<DomainEvent>,
                         std::remove_cvref_t<DomainEvents>> ||
            ...) void add_event(DomainEvent &&domain_event) {
+    // Events added after a failed commit start a new one; those of the failed
+    // commit may have landed, so they are not sent again.
+    drop_failed_commit();
     buffer_.emplace_back(
         derived().make_buffer_element(std::move(domain_event)));
   }
 
+  // The buffer is handed to the derived stream, which may move its elements
+  // out, and is cleared afterwards whether or not the commit succeeded. A
+  // stream that has committed asynchronously must keep doing so: waiting here
+  // for the commits in flight would deadlock when called from one of their
+  // completions, so the commit is refused and the buffer left as it was.
+  //
+  // Derived streams taking a commit id are instead handed the buffer under an
+  // id, and must be able to send that commit again unless it succeeds, either
+  // by leaving the buffer's elements in place or by keeping what they made of
+  // them under the id. The buffer is kept until then. A commit failing other than by a collision keeps its events, id and
+  // timestamp, so retrying it sends the very same commit, which the backend
+  // recognises should the failed attempt have landed after all. Only a retry
+  // of that very commit reuses them: adding events or expecting another
+  // version drops the failed commit's events, which may have landed.
   constexpr void
   commit_events(std::convertible_to<version_type> auto const expected_version) {
-    buffer_type buffer = std::exchange(buffer_, buffer_type{});
-    if (not std::empty(buffer)) {
-      timestamp_t<DomainEvents...> const timestamp = now(clock_);
-      for (auto &&[i, element] : views::enumerate(buffer)) {
-        version_type const event_version =
-            narrow_cast<version_type>(i) + expected_version + 1;
-        derived().populate_commit_info(timestamp, event_version, element);
+    if constexpr (async_committable) {
+      if (nullptr != sequence_) {
+        throw std::logic_error{"Event stream has committed asynchronously; "
+                               "commit it asynchronously"};
       }
+    }
+    drop_failed_commit_unless(expected_version);
+    if (std::empty(buffer_)) {
+      return;
+    }
+    if constexpr (idempotently_committable) {
+      if (not pending_.has_value()) {
+        pending_.emplace(commit_id::generate(), now(clock_),
+                         narrow_cast<version_type>(expected_version));
+      }
+      populate_buffer(pending_->timestamp, expected_version);
+      try {
+        derived().commit_buffered_events(
+            std::move(buffer_), pending_->timestamp,
+            narrow_cast<version_type>(expected_version), pending_->id);
+      } catch (optimistic_concurrency_collision const &) {
+        rollback();
+        throw;
+      }
+      rollback();
+    } else {
+      clear_on_exit const clear_buffer{buffer_};
+      timestamp_type const timestamp = now(clock_);
+      populate_buffer(timestamp, expected_version);
       derived().commit_buffered_events(
-          std::move(buffer), timestamp,
+          std::move(buffer_), timestamp,
           narrow_cast<version_type>(expected_version));
     }
   }
 
-  constexpr void rollback() noexcept { buffer_.clear(); }
+  // Available when the derived stream supplies prepare_async_commit, which is
+  // given the buffered events and returns what starts their write. The write
+  // is started once the stream's earlier commits have completed, by which
+  // time the stream itself may be gone. The events are held in the stream's
+  // memory resource until the commit completes.
+  std::future<void> commit_events_async(
+      std::convertible_to<version_type> auto const
+          expected_version) requires async_committable {
+    return event_stream_details_::future_of(
+        [&, this](commit_completion completed) {
+          commit_events_async(expected_version, std::move(completed));
+        });
+  }
+
+  // Invokes completed once the events are committed, on whichever thread
+  // completed the write.
+  void commit_events_async(
+      std::convertible_to<version_type> auto const expected_version,
+      commit_completion completed) requires async_committable {
+    drop_failed_commit_unless(expected_version);
+    commit_start start;
+    if (std::empty(buffer_)) {
+      if (nullptr == sequence_) {
+        completed(nullptr);
+        return;
+      }
+      start = [](commit_completion const &committed) { committed(nullptr); };
+    } else {
+      // A commit that failed synchronously is retried as it was.
+      pending_commit const pending =
+          pending_.has_value()
+              ? *pending_
+              : pending_commit{commit_id::generate(), now(clock_),
+                               narrow_cast<version_type>(expected_version)};
+      pending_.reset();
+      populate_buffer(pending.timestamp, expected_version);
+      auto buffer = std::make_shared<buffer_type>(std::move(buffer_));
+      buffer_.clear();
+      if constexpr (idempotently_async_committable) {
+        start = derived().prepare_async_commit(
+            std::move(buffer), pending.timestamp,
+            narrow_cast<version_type>(expected_version), pending.id);
+      } else {
+        start = derived().prepare_async_commit(
+            std::move(buffer), pending.timestamp,
+            narrow_cast<version_type>(expected_version));
+      }
+    }
+    if (nullptr == sequence_) {
+      sequence_ = std::make_shared<commit_sequence>();
+    }
+    sequence_->enqueue(std::move(start), std::move(completed));
+  }
+
+  constexpr void rollback() noexcept {
+    buffer_.clear();
+    pending_.reset();
+  }
 
   constexpr bool empty() const {
     return 0 == skizzay::cddd::version(std::as_const(derived()));
   }
 
 protected:
-  explicit event_stream_base(
-      Clock clock,
-      typename std::vector<element_type>::size_type reserve_capacity = 25)
-      : clock_{std::move_if_noexcept(clock)} {
-    buffer_.reserve(reserve_capacity);
+  explicit basic_event_stream_base(Clock clock,
+                                   std::pmr::memory_resource *const resource =
+                                       std::pmr::get_default_resource())
+      : clock_{std::move_if_noexcept(clock)},
+        buffer_{allocator_type{resource}} {}
+
+  std::pmr::memory_resource *resource() const noexcept {
+    return buffer_.get_allocator().resource();
   }
 
 private:
+  static constexpr bool async_committable =
+      event_stream_details_::async_committable<Derived, buffer_type,
+                                               timestamp_type, version_type>;
+  static constexpr bool idempotently_async_committable =
+      event_stream_details_::idempotently_async_committable<
+          Derived, buffer_type, timestamp_type, version_type>;
+  static constexpr bool idempotently_committable =
+      event_stream_details_::idempotently_committable<
+          Derived, buffer_type, timestamp_type, version_type>;
+
+  struct pending_commit {
+    commit_id id;
+    timestamp_type timestamp;
+    version_type expected_version;
+  };
+
+  void drop_failed_commit() noexcept {
+    if (pending_.has_value()) {
+      rollback();
+    }
+  }
+
+  void drop_failed_commit_unless(
+      std::convertible_to<version_type> auto const expected_version) noexcept {
+    if (pending_.has_value() &&
+        pending_->expected_version != expected_version) {
+      rollback();
+    }
+  }
+
+  void populate_buffer(
+      timestamp_type const timestamp,
+      std::convertible_to<version_type> auto const expected_version) {
+    for (auto &&[i, element] : views::enumerate(buffer_)) {
+      version_type const event_version =
+          narrow_cast<version_type>(i) + expected_version + 1;
+      derived().populate_commit_info(timestamp, event_version, element);
+    }
+  }
+
+  struct clear_on_exit {
+    ~clear_on_exit() { buffer.clear(); }
+
+    buffer_type &buffer;
+  };
+
   constexpr Derived &derived() noexcept {
     return *static_cast<Derived *>(this);
   }
 
   [[no_unique_address]] Clock clock_;
-  std::vector<element_type> buffer_;
+  buffer_type buffer_;
+  std::optional<pending_commit> pending_;
+  std::shared_ptr<commit_sequence> sequence_;
 };
 
+// Typical commands buffer one to three events.
+inline constexpr std::size_t default_event_buffer_capacity = 4;
+
+template <typename Derived, concepts::clock Clock, typename Element,
+          concepts::domain_event... DomainEvents>
+using event_stream_base =
+    basic_event_stream_base<Derived, Clock, Element,
+                            default_event_buffer_capacity, DomainEvents...>;
+
 } // namespace skizzay::cddd
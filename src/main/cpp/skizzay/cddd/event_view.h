@@ -0,0 +1,131 @@
+#pragma once
+
+#include "skizzay/cddd/aggregate_root.h"
+#include "skizzay/cddd/domain_event.h"
+#include "skizzay/cddd/event_sourced.h"
+#include "skizzay/cddd/identifier.h"
+#include "skizzay/cddd/timestamp.h"
+#include "skizzay/cddd/version.h"
+
+#include <concepts>
+#include <functional>
+#include <type_traits>
+
+namespace skizzay::cddd {
+
+// An event as it was stored, before it is decoded. The id, version and
+// timestamp are known up front; the rest of the event stays in its stored
+// representation (bytes, an attribute map...) until the event is decoded or
+// the aggregate reads the fields it needs from the representation itself.
+// Views refer to storage owned by the event source and are only valid while
+// being applied.
+//
+// Format is a tag naming the representation_type of a backend. Keeping the
+// representation out of the view's template arguments keeps namespace std
+// out of argument-dependent lookup of apply.
+template <concepts::domain_event DomainEvent, typename Format>
+struct event_view {
+  using event_type = DomainEvent;
+  using representation_type = typename Format::representation_type;
+  using id_type = std::remove_cvref_t<id_t<DomainEvent>>;
+  using version_type = version_t<DomainEvent>;
+  using timestamp_type = timestamp_t<DomainEvent>;
+  using decoder_type =
+      std::function<DomainEvent(representation_type const &)>;
+
+  event_view(representation_type const &representation, id_type const &id,
+             version_type const version, timestamp_type const timestamp,
+             decoder_type const &decoder) noexcept
+      : representation_{representation}, id_{id}, version_{version},
+        timestamp_{timestamp}, decoder_{decoder} {}
+
+  id_type const &id() const noexcept { return id_; }
+  version_type version() const noexcept { return version_; }
+  timestamp_type timestamp() const noexcept { return timestamp_; }
+
+  representation_type const &representation() const noexcept {
+    return representation_;
+  }
+
+  DomainEvent event() const {
+    DomainEvent domain_event = decoder_(representation_);
+    set_id(domain_event, id_);
+    set_version(domain_event, version_);
+    set_timestamp(domain_event, timestamp_);
+    return domain_event;
+  }
+
+private:
+  representation_type const &representation_;
+  id_type const &id_;
+  version_type version_;
+  timestamp_type timestamp_;
+  decoder_type const &decoder_;
+};
+
+namespace concepts {
+// Whether the aggregate applies views of the event type rather than decoded
+// events.
+template <typename T, typename DomainEvent, typename Format>
+concept view_applicable =
+    std::invocable<decltype(skizzay::cddd::apply), T &,
+                   event_view<DomainEvent, Format> const &>;
+} // namespace concepts
+
+template <typename EventView> struct event_view_visitor_interface {
+  virtual void visit(EventView const &event_view) = 0;
+};
+
+template <typename Format, concepts::domain_event... DomainEvents>
+struct event_view_visitor
+    : virtual event_view_visitor_interface<
+          event_view<std::remove_cvref_t<DomainEvents>, Format>>... {};
+
+template <typename Derived, typename EventView>
+struct aggregate_view_visitor_impl
+    : virtual event_view_visitor_interface<EventView> {
+  void visit(EventView const &event_view) override {
+    static_cast<Derived *>(this)->apply(event_view);
+  }
+};
+
+// Hands views to the aggregate for the event types it applies views of, and
+// decodes the rest, folding runs of them as event_run_visitor does. Callers
+// must flush once the last view has been visited.
+template <typename Aggregate, typename Format,
+          concepts::domain_event... DomainEvents>
+requires concepts::aggregate_root<Aggregate, DomainEvents...>
+struct aggregate_view_visitor final
+    : virtual event_view_visitor<Format, DomainEvents...>,
+      aggregate_view_visitor_impl<
+          aggregate_view_visitor<Aggregate, Format, DomainEvents...>,
+          event_view<std::remove_cvref_t<DomainEvents>, Format>>... {
+  explicit aggregate_view_visitor(Aggregate &aggregate) noexcept
+      : aggregate_{aggregate}, runs_{aggregate} {}
+
+  template <concepts::domain_event DomainEvent>
+  void apply(event_view<DomainEvent, Format> const &event_view) {
+    if constexpr (concepts::view_applicable<Aggregate, DomainEvent, Format>) {
+      runs_.flush();
+      skizzay::cddd::apply(aggregate_, event_view);
+    } else {
+      runs_.apply(event_view.event());
+    }
+  }
+
+  void flush() { runs_.flush(); }
+
+private:
+  Aggregate &aggregate_;
+  event_run_visitor<Aggregate, DomainEvents...> runs_;
+};
+
+template <typename Format, concepts::domain_event... DomainEvents,
+          concepts::aggregate_root<DomainEvents...> AggregateRoot>
+aggregate_view_visitor<AggregateRoot, Format, DomainEvents...>
+as_event_view_visitor(AggregateRoot &aggregate) {
+  return aggregate_view_visitor<AggregateRoot, Format,
+                                DomainEvents...>{aggregate};
+}
+
+} // namespace skizzay::cddd
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <concepts>
+#include <functional>
+#include <utility>
+
+namespace skizzay::cddd {
+namespace concepts {
+// Runs the work posted to it at some point, on some thread.
+template <typename T>
+concept executor = requires(T &t, std::function<void()> work) {
+  t.post(std::move(work));
+};
+} // namespace concepts
+
+// Runs the work on the posting thread before returning.
+struct inline_executor {
+  void post(std::function<void()> work) const { work(); }
+};
+
+} // namespace skizzay::cddd
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "skizzay/cddd/blob_store.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <system_error>
+
+namespace skizzay::cddd {
+// Keeps each blob in its own file, fanned out into subdirectories by the first
+// two characters of the key. Writes go to a temporary file that is renamed
+// into place, so readers never observe a partial blob.
+struct file_blob_store final : blob_store {
+  explicit file_blob_store(std::filesystem::path root)
+      : root_{std::move(root)} {
+    std::filesystem::create_directories(root_);
+  }
+
+  void put_blob(std::string const &key,
+                std::span<std::byte const> const data) override {
+    std::filesystem::path const path = path_for(key);
+    if (std::filesystem::exists(path)) {
+      return;
+    }
+    std::filesystem::create_directories(path.parent_path());
+    std::filesystem::path temporary_path = path;
+    temporary_path += ".tmp" + std::to_string(temporary_suffix());
+    {
+      std::ofstream output{temporary_path, std::ios::binary | std::ios::trunc};
+      output.write(reinterpret_cast<char const *>(data.data()),
+                   static_cast<std::streamsize>(data.size()));
+      if (not output) {
+        throw std::filesystem::filesystem_error{
+            "Failed to write blob", temporary_path,
+            std::make_error_code(std::errc::io_error)};
+      }
+    }
+    std::filesystem::rename(temporary_path, path);
+  }
+
+  blob get_blob(std::string const &key) override {
+    std::filesystem::path const path = path_for(key);
+    std::ifstream input{path, std::ios::binary | std::ios::ate};
+    if (not input) {
+      throw blob_not_found{"Could not find blob '" + key + "'"};
+    }
+    std::vector<std::byte> data(static_cast<std::size_t>(input.tellg()));
+    input.seekg(0);
+    input.read(reinterpret_cast<char *>(data.data()),
+               static_cast<std::streamsize>(data.size()));
+    return std::make_shared<std::vector<std::byte> const>(std::move(data));
+  }
+
+private:
+  std::filesystem::path path_for(std::string const &key) const {
+    return root_ / key.substr(0, 2) / key;
+  }
+
+  static std::uint64_t temporary_suffix() {
+    thread_local std::mt19937_64 generator{std::random_device{}()};
+    return generator();
+  }
+
+  std::filesystem::path root_;
+};
+} // namespace skizzay::cddd
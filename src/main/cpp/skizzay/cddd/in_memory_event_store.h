@@ -1,6 +1,7 @@
 #pragma once
 
 #include "skizzay/cddd/aggregate_root.h"
+#include "skizzay/cddd/commit_id.h"
 #include "skizzay/cddd/concurrent_repository.h"
 #include "skizzay/cddd/domain_event.h"
 #include "skizzay/cddd/event_sourced.h"
@@ -15,10 +16,17 @@
 #include <atomic>
 #include <cassert>
 #include <concepts>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <iterator>
+#include <memory_resource>
 #include <mutex>
+#include <optional>
 #include <shared_mutex>
+#include <span>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 namespace skizzay::cddd {
@@ -27,6 +35,58 @@ namespace in_memory_event_store_details_ {
 template <concepts::clock Clock, concepts::domain_event... DomainEvents>
 requires(0 < sizeof...(DomainEvents)) struct store_impl;
 
+// Applies asynchronous commits on a worker of its own, in the order they were
+// posted. The worker is started by the first commit and drains whatever is
+// left before the store goes away.
+struct completion_queue {
+  completion_queue() = default;
+  completion_queue(completion_queue const &) = delete;
+  completion_queue &operator=(completion_queue const &) = delete;
+
+  ~completion_queue() {
+    {
+      std::lock_guard l_{m_};
+      stopping_ = true;
+    }
+    cv_.notify_one();
+    if (worker_.joinable()) {
+      worker_.join();
+    }
+  }
+
+  void post(std::function<void()> work) {
+    {
+      std::lock_guard l_{m_};
+      work_.push_back(std::move(work));
+      if (not worker_.joinable()) {
+        worker_ = std::thread{[this]() { drain(); }};
+      }
+    }
+    cv_.notify_one();
+  }
+
+private:
+  void drain() {
+    for (;;) {
+      std::unique_lock l_{m_};
+      cv_.wait(l_, [this]() { return stopping_ || not std::empty(work_); });
+      if (std::empty(work_)) {
+        return;
+      }
+      std::function<void()> const work = std::move(work_.front());
+      work_.pop_front();
+      l_.unlock();
+      work();
+    }
+  }
+
+  std::mutex m_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> work_;
+  bool stopping_ = false;
+  std::thread worker_;
+};
+
 template <concepts::clock Clock, concepts::domain_event... DomainEvents>
 struct event_stream final
     : event_stream_base<event_stream<Clock, DomainEvents...>, Clock,
@@ -44,9 +104,10 @@ struct event_stream final
   using event_ptr = std::unique_ptr<event_interface<DomainEvents...>>;
 
   explicit event_stream(auto &&id, Clock clock,
-                        store_impl<Clock, DomainEvents...> &store)
-      : base_type{std::move(clock)}, id_{std::forward<decltype(id)>(id)},
-        store_{store} {}
+                        store_impl<Clock, DomainEvents...> &store,
+                        std::pmr::memory_resource *const resource)
+      : base_type{std::move(clock), resource},
+        id_{std::forward<decltype(id)>(id)}, store_{store} {}
 
   constexpr std::remove_cvref_t<id_type> const &id() const noexcept {
     return id_;
@@ -60,9 +121,30 @@ struct event_stream final
   }
 
   void commit_buffered_events(buffer_type &&buffer, timestamp_type const,
-                              version_type const expected_version) {
-    store_.event_buffers_.get_or_add(id())->append(std::move(buffer),
-                                                   expected_version);
+                              version_type const expected_version,
+                              commit_id const &commit) {
+    store_.get_or_add_buffer(id())->append(buffer, expected_version, commit);
+  }
+
+  // The events are appended by the store's completion queue.
+  commit_start prepare_async_commit(std::shared_ptr<buffer_type> buffer,
+                                    timestamp_type const,
+                                    version_type const expected_version,
+                                    commit_id const &commit) {
+    return [&store = store_, id = id_, buffer = std::move(buffer),
+            expected_version, commit](commit_completion completed) {
+      store.completions_.post([&store, id, buffer, expected_version, commit,
+                               completed = std::move(completed)]() {
+        try {
+          store.get_or_add_buffer(id)->append(*buffer, expected_version,
+                                              commit);
+        } catch (...) {
+          completed(std::current_exception());
+          return;
+        }
+        completed(nullptr);
+      });
+    };
   }
 
   element_type
@@ -84,53 +166,50 @@ private:
   store_impl<Clock, DomainEvents...> &store_;
 };
 
-template <typename Derived, concepts::domain_event DomainEvent>
-struct aggregate_visitor_impl : virtual event_visitor_interface<DomainEvent> {
-  void visit(DomainEvent const &domain_event) override {
-    using skizzay::cddd::apply;
-    apply(static_cast<Derived *>(this)->get_aggregate(), domain_event);
-  }
-};
-
 template <concepts::clock Clock, concepts::domain_event... DomainEvents>
 event_stream(auto &&, std::unsigned_integral auto const,
              store_impl<Clock, DomainEvents...> &)
     -> event_stream<Clock, DomainEvents...>;
 
-template <typename Aggregate, concepts::domain_event... DomainEvents>
-requires(std::invocable<decltype(skizzay::cddd::apply),
-                        std::add_lvalue_reference_t<Aggregate>,
-                        std::remove_cvref_t<DomainEvents> const &>
-             &&...) struct aggregate_visitor final
-    : event_visitor<DomainEvents...>,
-      aggregate_visitor_impl<aggregate_visitor<Aggregate, DomainEvents...>,
-                             std::remove_cvref_t<DomainEvents>>... {
-  aggregate_visitor(Aggregate &aggregate) noexcept : aggregate_{aggregate} {}
-
-  Aggregate &get_aggregate() noexcept { return aggregate_; }
-
-private:
-  Aggregate &aggregate_;
-};
-
 template <concepts::domain_event... DomainEvents> struct buffer final {
   using id_type = id_t<DomainEvents...>;
   using version_type = version_t<DomainEvents...>;
   using timestamp_type = timestamp_t<DomainEvents...>;
   using event_ptr = std::unique_ptr<event_interface<DomainEvents...>>;
-  using storage_type = std::vector<event_ptr>;
+  using storage_type = std::pmr::vector<event_ptr>;
+
+  explicit buffer(std::pmr::memory_resource *const resource =
+                      std::pmr::get_default_resource())
+      : storage_{resource}, committed_{resource} {}
 
   typename storage_type::size_type version() const noexcept {
     std::shared_lock l_{m_};
     return std::size(storage_);
   }
 
-  void append(storage_type &&events, version_type const expected_version) {
+  // The events are moved out of the given span once appended. A retry of the
+  // latest commit succeeds without appending anything, leaving the events
+  // where they are. Only that commit is recognised, as with the version
+  // record of the DynamoDB store; a retry of an earlier one finds the
+  // stream has moved on and collides.
+  void append(std::span<event_ptr> const events,
+              version_type const expected_version, commit_id const &commit) {
     using skizzay::cddd::version;
 
     std::lock_guard l_{m_};
     auto const actual_version = std::size(storage_);
-    if (expected_version == actual_version) {
+    if (latest_commit_ == commit) {
+      return;
+    } else if (expected_version == actual_version) {
+      storage_.reserve(actual_version + std::size(events));
+      committed_.reserve(actual_version + std::size(events));
+      latest_commit_ = commit;
+      for (event_ptr const &event : events) {
+        committed_.push_back(
+            std::empty(committed_)
+                ? event->timestamp()
+                : std::max(committed_.back(), event->timestamp()));
+      }
       storage_.insert(std::end(storage_),
                       std::move_iterator(std::ranges::begin(events)),
                       std::move_iterator(std::ranges::end(events)));
@@ -152,9 +231,21 @@ template <concepts::domain_event... DomainEvents> struct buffer final {
         begin_iterator + std::min(std::size(storage_), target_version));
   }
 
+  // The number of events committed no later than the timestamp.
+  version_type version_as_of(timestamp_type const as_of) const {
+    std::shared_lock l_{m_};
+    return narrow_cast<version_type>(
+        std::ranges::upper_bound(committed_, as_of) - std::begin(committed_));
+  }
+
 private:
   mutable std::shared_mutex m_;
   storage_type storage_;
+  // The latest timestamp up to each event, so the column is sorted even when
+  // the clock was not, and an event counts as committed by a time only once
+  // every event before it was.
+  std::pmr::vector<timestamp_type> committed_;
+  std::optional<commit_id> latest_commit_;
 };
 
 template <concepts::domain_event... DomainEvents> struct event_source final {
@@ -172,13 +263,38 @@ template <concepts::domain_event... DomainEvents> struct event_source final {
     assert((aggregate_version < target_version) &&
            "Aggregate version cannot exceed target version");
 
-    if (nullptr != buffer_) {
-      std::ranges::for_each(
-          buffer_->get_events(aggregate_version + 1, target_version),
-          [aggregate = aggregate_visitor<Aggregate, DomainEvents...>{
-               aggregate}](event_ptr const &event) mutable {
-            event->accept_event_visitor(aggregate);
-          });
+    if (nullptr == buffer_) {
+      return;
+    }
+    auto events = buffer_->get_events(aggregate_version + 1, target_version);
+    if constexpr ((concepts::range_applicable<
+                       Aggregate, std::remove_cvref_t<DomainEvents>> ||
+                   ...)) {
+      auto visitor = as_event_run_visitor<DomainEvents...>(aggregate);
+      for (event_ptr const &event : events) {
+        skizzay::cddd::apply(visitor, *event);
+      }
+      visitor.flush();
+    } else {
+      for (event_ptr const &event : events) {
+        skizzay::cddd::apply(aggregate, *event);
+      }
+    }
+  }
+
+  // Binary searches the stream's commit timestamps for the version to load
+  // up to.
+  template <concepts::aggregate_root<DomainEvents...> Aggregate>
+  void load_as_of(Aggregate &aggregate, concepts::timestamp auto const as_of) {
+    using timestamp_type = timestamp_t<DomainEvents...>;
+
+    if (nullptr == buffer_) {
+      return;
+    }
+    version_type const target_version = buffer_->version_as_of(
+        std::chrono::floor<typename timestamp_type::duration>(as_of));
+    if (version(aggregate) < target_version) {
+      load_from_history(aggregate, target_version);
     }
   }
 
@@ -190,6 +306,12 @@ template <concepts::domain_event... DomainEvents>
 event_source(std::shared_ptr<buffer<DomainEvents...>>)
     -> event_source<DomainEvents...>;
 
+// The store's tables and event storage are allocated from the memory
+// resource given on construction, so a long-lived store can draw from a pool;
+// it must outlive the store and the event sources handed out by it.
+// Each event stream buffers its uncommitted events in a resource of its own,
+// typically an arena for the command being handled. Asynchronous commits are
+// applied by a worker of the store's, one at a time.
 template <concepts::clock Clock, concepts::domain_event... DomainEvents>
 requires(0 < sizeof...(DomainEvents)) struct store_impl {
   friend event_stream<Clock, DomainEvents...>;
@@ -200,12 +322,16 @@ requires(0 < sizeof...(DomainEvents)) struct store_impl {
   using buffer_type = buffer<DomainEvents...>;
   using event_ptr = std::unique_ptr<event_interface<DomainEvents...>>;
 
-  event_stream<Clock, DomainEvents...>
-  get_event_stream(auto const &id) noexcept {
-    using skizzay::cddd::version;
+  store_impl() = default;
 
-    std::shared_ptr<buffer_type> const buffer_ptr = find_buffer(id);
-    return event_stream{std::forward<decltype(id)>(id), clock_, *this};
+  explicit store_impl(std::pmr::memory_resource *const resource)
+      : event_buffers_{resource} {}
+
+  event_stream<Clock, DomainEvents...>
+  get_event_stream(auto const &id,
+                   std::pmr::memory_resource *const resource =
+                       std::pmr::get_default_resource()) noexcept {
+    return event_stream<Clock, DomainEvents...>{id, clock_, *this, resource};
   }
 
   event_source<DomainEvents...> get_event_source(auto const &id) noexcept {
@@ -217,26 +343,21 @@ requires(0 < sizeof...(DomainEvents)) struct store_impl {
   }
 
 private:
-  template <std::ranges::random_access_range Range>
-  requires std::same_as<std::ranges::range_value_t<Range>, event_ptr>
-  void commit(id_type id, Range &range) {
-    if (!std::empty(range)) {
-      event_buffers_.get_or_add(id)->append(current_timestamp(), range);
-    }
-  }
-
   std::shared_ptr<buffer_type> find_buffer(id_type id) const noexcept {
     return event_buffers_.get(id);
   }
 
-  timestamp_type current_timestamp() {
-    using skizzay::cddd::now;
-    return std::chrono::time_point_cast<typename timestamp_type::duration>(
-        now(clock_));
+  std::shared_ptr<buffer_type> get_or_add_buffer(id_type id) {
+    std::pmr::memory_resource *const resource = event_buffers_.resource();
+    return event_buffers_.get_or_add(id, [resource]() {
+      return std::allocate_shared<buffer_type>(
+          std::pmr::polymorphic_allocator<buffer_type>{resource}, resource);
+    });
   }
 
   [[no_unique_address]] Clock clock_;
   concurrent_table<std::shared_ptr<buffer_type>, id_type> event_buffers_;
+  completion_queue completions_;
 };
 } // namespace in_memory_event_store_details_
 
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "skizzay/cddd/kafka/kafka_event_log_config.h"
+
+#include <librdkafka/rdkafkacpp.h>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace skizzay::cddd::kafka {
+
+inline void set_property(RdKafka::Conf &configuration, std::string const &name,
+                         auto const &value) {
+  std::string error_message;
+  if (RdKafka::Conf::CONF_OK !=
+      configuration.set(name, value, error_message)) {
+    throw std::invalid_argument{error_message};
+  }
+}
+
+// Starts the configuration of a client of the event log. Client specific
+// properties are set next, followed by apply_properties so that the event
+// log's additional properties take precedence.
+inline std::unique_ptr<RdKafka::Conf>
+make_configuration(event_log_config const &config) {
+  std::unique_ptr<RdKafka::Conf> result{
+      RdKafka::Conf::create(RdKafka::Conf::CONF_GLOBAL)};
+  set_property(*result, "bootstrap.servers", config.bootstrap_servers());
+  return result;
+}
+
+inline void apply_properties(RdKafka::Conf &configuration,
+                             event_log_config const &config) {
+  for (auto const &[name, value] : config.properties()) {
+    set_property(configuration, name, value);
+  }
+}
+
+} // namespace skizzay::cddd::kafka
@@ -2,17 +2,33 @@
 
 #include "skizzay/cddd/domain_event.h"
 #include <cstddef>
+#include <memory_resource>
 #include <span>
+#include <string_view>
 #include <type_traits>
 #include <vector>
 
 namespace skizzay::cddd::kafka {
 namespace derser_details_ {
+// The payload should be allocated from the given memory resource, an arena
+// that lives until every record of the commit has been delivered.
 template <concepts::domain_event DomainEvent> struct serializer_interface {
-  virtual std::pmr::vector<std::byte> serialize(DomainEvent const &) const = 0;
+  virtual std::pmr::vector<std::byte>
+  serialize(DomainEvent const &, std::pmr::memory_resource *) const = 0;
+  virtual std::string_view
+  message_type(event_type<DomainEvent> const) const noexcept = 0;
 };
 } // namespace derser_details_
 
+// Captures the state of an aggregate in the payload of a snapshot record and
+// restores it. The key and version header are managed by the snapshot store;
+// deserialize must leave the aggregate at the version the snapshot was taken.
+template <typename Aggregate> struct snapshot_serializer {
+  virtual std::pmr::vector<std::byte>
+  serialize(Aggregate const &, std::pmr::memory_resource *) const = 0;
+  virtual void deserialize(std::span<std::byte const>, Aggregate &) const = 0;
+};
+
 template <concepts::domain_event... DomainEvents>
 struct serializer : virtual derser_details_::serializer_interface<
                         std::remove_cvref_t<DomainEvents>>... {};
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "skizzay/cddd/domain_event.h"
+#include "skizzay/cddd/event_view.h"
+#include "skizzay/cddd/history_load_failed.h"
+#include "skizzay/cddd/identifier.h"
+#include "skizzay/cddd/timestamp.h"
+#include "skizzay/cddd/version.h"
+
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+namespace skizzay::cddd::kafka {
+
+namespace event_dispatcher_details_ {
+
+template <typename T>
+concept translator = std::invocable<T, std::span<std::byte const> const> &&
+    concepts::domain_event<
+        std::invoke_result_t<T, std::span<std::byte const> const>>;
+
+template <translator Translator>
+using domain_event_result_t = std::remove_cvref_t<
+    std::invoke_result_t<Translator, std::span<std::byte const> const>>;
+
+template <typename T, typename... DomainEvents>
+concept translator_for_one_of = translator<T> &&
+    (std::same_as<domain_event_result_t<T>, DomainEvents> || ...);
+} // namespace event_dispatcher_details_
+
+// What the event stream wrote around the payload of a record: the message key
+// and headers.
+template <concepts::domain_event... DomainEvents> struct record_metadata {
+  std::remove_cvref_t<id_t<DomainEvents...>> id;
+  version_t<DomainEvents...> version;
+  timestamp_t<DomainEvents...> timestamp;
+};
+
+// Events viewed as the payload of their record.
+struct record_payload final {
+  using representation_type = std::span<std::byte const>;
+};
+
+template <concepts::domain_event DomainEvent>
+using event_view = skizzay::cddd::event_view<DomainEvent, record_payload>;
+
+// Turns the payload of a record back into a domain event, chosen by the type
+// header the event stream wrote alongside it. Translators only see the
+// payload; the id, version and timestamp are set from the record metadata.
+template <concepts::domain_event... DomainEvents> struct event_dispatcher {
+  using metadata_type = record_metadata<DomainEvents...>;
+  using handler_type =
+      std::function<void(std::span<std::byte const>, metadata_type const &,
+                         event_visitor<DomainEvents...> &)>;
+  using view_visitor_type = event_view_visitor<record_payload, DomainEvents...>;
+
+  void dispatch(std::string const &type,
+                std::span<std::byte const> const payload,
+                metadata_type const &metadata,
+                event_visitor<DomainEvents...> &visitor) {
+    try {
+      auto const handler_iter = handlers_.find(type);
+      if (std::end(handlers_) == handler_iter) {
+        throw std::invalid_argument{"Could not find handler for '" + type +
+                                    "'"};
+      } else {
+        handler_iter->second(payload, metadata, visitor);
+      }
+    } catch (...) {
+      std::throw_with_nested(event_deserialization_failed{
+          "Event dispatcher failed to dispatch event to handler."});
+    }
+  }
+
+  // Like dispatch, but hands the visitor a view over the payload rather than
+  // the decoded event.
+  void dispatch(std::string const &type,
+                std::span<std::byte const> const payload,
+                metadata_type const &metadata, view_visitor_type &visitor) {
+    try {
+      auto const viewer_iter = viewers_.find(type);
+      if (std::end(viewers_) == viewer_iter) {
+        throw std::invalid_argument{"Could not find handler for '" + type +
+                                    "'"};
+      } else {
+        viewer_iter->second(payload, metadata, visitor);
+      }
+    } catch (...) {
+      std::throw_with_nested(event_deserialization_failed{
+          "Event dispatcher failed to dispatch event view to handler."});
+    }
+  }
+
+  // Like dispatch, but hands back the event rather than visiting it, for
+  // callers that decode a batch of records before applying any of them.
+  std::unique_ptr<event_interface<DomainEvents...>>
+  decode(std::string const &type, std::span<std::byte const> const payload,
+         metadata_type const &metadata) const {
+    try {
+      auto const decoder_iter = decoders_.find(type);
+      if (std::end(decoders_) == decoder_iter) {
+        throw std::invalid_argument{"Could not find decoder for '" + type +
+                                    "'"};
+      } else {
+        return decoder_iter->second(payload, metadata);
+      }
+    } catch (...) {
+      std::throw_with_nested(event_deserialization_failed{
+          "Event dispatcher failed to decode event."});
+    }
+  }
+
+  void register_translator(
+      std::string event_type_name,
+      event_dispatcher_details_::translator_for_one_of<DomainEvents...> auto
+          translator) {
+    if (handlers_.contains(event_type_name)) {
+      throw std::logic_error{"Handler for event '" + event_type_name +
+                             "' already registered"};
+    } else {
+      using domain_event_type = event_dispatcher_details_::
+          domain_event_result_t<decltype(translator)>;
+      auto decoder = [translator](std::span<std::byte const> const payload,
+                                  metadata_type const &metadata)
+          -> std::unique_ptr<event_interface<DomainEvents...>> {
+        auto domain_event = std::invoke(translator, payload);
+        set_id(domain_event, metadata.id);
+        set_version(domain_event, metadata.version);
+        set_timestamp(domain_event, metadata.timestamp);
+        return std::make_unique<
+            event_holder_impl<domain_event_type, DomainEvents...>>(
+            std::move(domain_event));
+      };
+      auto viewer =
+          [translator = typename kafka::event_view<
+               domain_event_type>::decoder_type{translator}](
+              std::span<std::byte const> const payload,
+              metadata_type const &metadata, view_visitor_type &v) {
+            static_cast<event_view_visitor_interface<
+                kafka::event_view<domain_event_type>> &>(v)
+                .visit({payload, metadata.id, metadata.version,
+                        metadata.timestamp, translator});
+          };
+      auto handler = [translator = std::move(translator)](
+                         std::span<std::byte const> const payload,
+                         metadata_type const &metadata,
+                         event_visitor<DomainEvents...> &v) {
+        auto domain_event = std::invoke(translator, payload);
+        set_id(domain_event, metadata.id);
+        set_version(domain_event, metadata.version);
+        set_timestamp(domain_event, metadata.timestamp);
+        static_cast<event_visitor_interface<domain_event_type> &>(v).visit(
+            domain_event);
+      };
+      decoders_.emplace(event_type_name, std::move(decoder));
+      viewers_.emplace(event_type_name, std::move(viewer));
+      handlers_.emplace(std::move(event_type_name), std::move(handler));
+    }
+  }
+
+private:
+  using decoder_type = std::function<std::unique_ptr<
+      event_interface<DomainEvents...>>(std::span<std::byte const>,
+                                        metadata_type const &)>;
+  using viewer_type =
+      std::function<void(std::span<std::byte const>, metadata_type const &,
+                         view_visitor_type &)>;
+
+  std::unordered_map<std::string, handler_type> handlers_;
+  std::unordered_map<std::string, decoder_type> decoders_;
+  std::unordered_map<std::string, viewer_type> viewers_;
+};
+} // namespace skizzay::cddd::kafka
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "skizzay/cddd/retry_policy.h"
+
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <map>
+#include <optional>
+#include <string>
+#include <utility>
+
+namespace skizzay::cddd::kafka {
+
+struct event_log_config {
+  explicit event_log_config(std::string bootstrap_servers,
+                            std::string topic_name)
+      : bootstrap_servers_{std::move(bootstrap_servers)},
+        topic_name_{std::move(topic_name)},
+        snapshot_topic_name_{topic_name_ + ".snapshots"},
+        reader_group_id_{topic_name_ + ".reader"} {}
+
+  std::string const &bootstrap_servers() const noexcept {
+    return bootstrap_servers_;
+  }
+  std::string const &topic_name() const noexcept { return topic_name_; }
+
+  // The companion topic snapshots are published to, keyed by aggregate id. It
+  // is expected to be compacted, so that only the latest snapshot of each
+  // aggregate is kept.
+  std::string const &snapshot_topic_name() const noexcept {
+    return snapshot_topic_name_;
+  }
+  std::string const &type_header_name() const noexcept {
+    return type_header_name_;
+  }
+  std::string const &version_header_name() const noexcept {
+    return version_header_name_;
+  }
+  std::string const &timestamp_header_name() const noexcept {
+    return timestamp_header_name_;
+  }
+
+  // How long the producer waits for more records before sending a batch, and
+  // how large (in bytes) a batch may grow. Together these trade commit latency
+  // for throughput.
+  std::chrono::milliseconds linger() const noexcept { return linger_; }
+  std::size_t batch_size() const noexcept { return batch_size_; }
+
+  // Upper bound on how long a commit waits for its delivery reports.
+  std::chrono::milliseconds delivery_timeout() const noexcept {
+    return delivery_timeout_;
+  }
+
+  // How a transaction commit that failed retriably is retried. Retries stop
+  // once the delivery timeout has passed, whatever the attempts left.
+  retry_policy const &commit_retry_policy() const noexcept {
+    return commit_retry_policy_;
+  }
+
+  // Upper bound on how long a read of the topic waits for the broker.
+  std::chrono::milliseconds read_timeout() const noexcept {
+    return read_timeout_;
+  }
+
+  // The consumer group named when reading the topic back. Partitions are
+  // always assigned explicitly and no offsets are committed for it.
+  std::string const &reader_group_id() const noexcept {
+    return reader_group_id_;
+  }
+
+  // When set, every commit is published in a Kafka transaction under this id,
+  // and commits to several aggregates can be made atomic. Only one producer
+  // may use a given transactional id at a time.
+  std::optional<std::string> const &transactional_id() const noexcept {
+    return transactional_id_;
+  }
+
+  // Additional librdkafka properties, applied to every client after the ones
+  // above.
+  std::map<std::string, std::string> const &properties() const noexcept {
+    return properties_;
+  }
+
+  event_log_config with_linger(std::chrono::milliseconds const linger) const {
+    event_log_config result = *this;
+    result.linger_ = linger;
+    return result;
+  }
+
+  event_log_config with_batch_size(std::size_t const batch_size) const {
+    event_log_config result = *this;
+    result.batch_size_ = batch_size;
+    return result;
+  }
+
+  event_log_config
+  with_delivery_timeout(std::chrono::milliseconds const delivery_timeout) const {
+    event_log_config result = *this;
+    result.delivery_timeout_ = delivery_timeout;
+    return result;
+  }
+
+  event_log_config
+  with_commit_retry_policy(retry_policy const commit_retry_policy) const {
+    event_log_config result = *this;
+    result.commit_retry_policy_ = commit_retry_policy;
+    return result;
+  }
+
+  event_log_config
+  with_read_timeout(std::chrono::milliseconds const read_timeout) const {
+    event_log_config result = *this;
+    result.read_timeout_ = read_timeout;
+    return result;
+  }
+
+  event_log_config
+  with_snapshot_topic_name(std::string snapshot_topic_name) const {
+    event_log_config result = *this;
+    result.snapshot_topic_name_ = std::move(snapshot_topic_name);
+    return result;
+  }
+
+  event_log_config
+  with_transactional_id(std::optional<std::string> transactional_id) const {
+    event_log_config result = *this;
+    result.transactional_id_ = std::move(transactional_id);
+    return result;
+  }
+
+  event_log_config with_property(std::string name, std::string value) const {
+    event_log_config result = *this;
+    result.properties_.insert_or_assign(std::move(name), std::move(value));
+    return result;
+  }
+
+private:
+  std::string bootstrap_servers_;
+  std::string topic_name_;
+  std::string snapshot_topic_name_;
+  std::string reader_group_id_;
+  std::string type_header_name_ = "cddd-type";
+  std::string version_header_name_ = "cddd-version";
+  std::string timestamp_header_name_ = "cddd-timestamp";
+  std::chrono::milliseconds linger_{5};
+  std::size_t batch_size_ = 1024 * 1024;
+  std::chrono::milliseconds delivery_timeout_{30'000};
+  retry_policy commit_retry_policy_{std::numeric_limits<std::size_t>::max(),
+                                    std::chrono::milliseconds{50},
+                                    std::chrono::seconds{1}};
+  std::chrono::milliseconds read_timeout_{30'000};
+  std::optional<std::string> transactional_id_;
+  std::map<std::string, std::string> properties_;
+};
+
+} // namespace skizzay::cddd::kafka
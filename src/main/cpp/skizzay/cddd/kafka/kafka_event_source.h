@@ -0,0 +1,499 @@
+#pragma once
+
+#include "skizzay/cddd/aggregate_root.h"
+#include "skizzay/cddd/domain_event.h"
+#include "skizzay/cddd/event_sourced.h"
+#include "skizzay/cddd/history_load_failed.h"
+#include "skizzay/cddd/identifier.h"
+#include "skizzay/cddd/kafka/kafka_configuration.h"
+#include "skizzay/cddd/kafka/kafka_event_dispatcher.h"
+#include "skizzay/cddd/kafka/kafka_event_log_config.h"
+#include "skizzay/cddd/kafka/kafka_offset_index.h"
+#include "skizzay/cddd/kafka/kafka_operation_failed_error.h"
+#include "skizzay/cddd/timestamp.h"
+#include "skizzay/cddd/version.h"
+
+#include <librdkafka/rdkafkacpp.h>
+
+#include <cassert>
+#include <charconv>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace skizzay::cddd::kafka {
+using history_load_error = operation_failed_error<history_load_failed>;
+
+namespace event_source_details_ {
+inline constexpr std::chrono::milliseconds consume_interval{100};
+
+// Records closer together than this are read through rather than seeked to.
+inline constexpr std::int64_t seek_distance = 512;
+
+inline std::optional<std::string> header_string(RdKafka::Message &message,
+                                                std::string const &name) {
+  RdKafka::Headers *const headers = message.headers();
+  if (nullptr == headers) {
+    return std::nullopt;
+  }
+  RdKafka::Headers::Header const header = headers->get_last(name);
+  if (RdKafka::ERR_NO_ERROR != header.err() || nullptr == header.value()) {
+    return std::nullopt;
+  }
+  return std::string{static_cast<char const *>(header.value()),
+                     header.value_size()};
+}
+
+template <std::integral Integer>
+std::optional<Integer> header_integer(RdKafka::Message &message,
+                                      std::string const &name) {
+  std::optional<std::string> const value = header_string(message, name);
+  if (not value.has_value()) {
+    return std::nullopt;
+  }
+  Integer result = 0;
+  auto const parse_result = std::from_chars(
+      value->data(), value->data() + std::size(*value), result);
+  if (std::errc{} != parse_result.ec) {
+    return std::nullopt;
+  }
+  return result;
+}
+
+// The type, version and timestamp the event stream wrote alongside a payload.
+template <std::unsigned_integral Version, concepts::timestamp Timestamp>
+struct record_headers {
+  std::string type;
+  Version version;
+  Timestamp timestamp;
+};
+
+template <std::unsigned_integral Version, concepts::timestamp Timestamp>
+record_headers<Version, Timestamp>
+read_record_headers(RdKafka::Message &message,
+                    event_log_config const &config) {
+  std::optional<std::string> type =
+      header_string(message, config.type_header_name());
+  std::optional<Version> const version =
+      header_integer<Version>(message, config.version_header_name());
+  std::optional<typename Timestamp::rep> const timestamp =
+      header_integer<typename Timestamp::rep>(message,
+                                              config.timestamp_header_name());
+  if (not(type && version && timestamp)) {
+    throw event_deserialization_failed{
+        "Record is missing its type, version or timestamp"};
+  }
+  return {std::move(*type), *version,
+          Timestamp{typename Timestamp::duration{*timestamp}}};
+}
+
+inline std::span<std::byte const> payload(RdKafka::Message &message) noexcept {
+  return {static_cast<std::byte const *>(message.payload()), message.len()};
+}
+
+struct topic_partitions {
+  topic_partitions() = default;
+  topic_partitions(topic_partitions const &) = delete;
+  topic_partitions &operator=(topic_partitions const &) = delete;
+  ~topic_partitions() { RdKafka::TopicPartition::destroy(partitions); }
+
+  std::vector<RdKafka::TopicPartition *> partitions;
+};
+} // namespace event_source_details_
+
+// Reads topics of the event log back, either to bring an offset index up to
+// date or to fetch specific records. Reads are serialized over a single
+// consumer whose partitions are assigned explicitly.
+struct reader {
+  explicit reader(event_log_config const &config) : config_{config} {
+    std::unique_ptr<RdKafka::Conf> const configuration =
+        make_configuration(config);
+    set_property(*configuration, "group.id", config.reader_group_id());
+    set_property(*configuration, "enable.auto.commit", std::string{"false"});
+    set_property(*configuration, "enable.auto.offset.store",
+                 std::string{"false"});
+    set_property(*configuration, "auto.offset.reset", std::string{"earliest"});
+    set_property(*configuration, "enable.partition.eof", std::string{"true"});
+    // Records of aborted transactions are never indexed; commit markers are
+    // skipped by the consumer and only show up as gaps in the offsets.
+    set_property(*configuration, "isolation.level",
+                 std::string{"read_committed"});
+    apply_properties(*configuration, config);
+
+    std::string error_message;
+    consumer_.reset(
+        RdKafka::KafkaConsumer::create(configuration.get(), error_message));
+    if (nullptr == consumer_) {
+      throw std::runtime_error{error_message};
+    }
+  }
+
+  reader(reader const &) = delete;
+  reader &operator=(reader const &) = delete;
+
+  ~reader() { consumer_->close(); }
+
+  // Consumes every partition of the event log from its checkpoint up to its
+  // current end, indexing each record that carries a version. Everything
+  // committed before it starts is indexed once it returns, so the index is no
+  // longer stale unless it fails. The exception is an aggregate whose earlier
+  // versions the index does not hold; its records are skipped.
+  void catch_up(offset_index &index) {
+    bool const stale = index.clear_stale();
+    try {
+      catch_up_from_checkpoints(index);
+    } catch (...) {
+      if (stale) {
+        index.mark_stale();
+      }
+      throw;
+    }
+  }
+
+  // Hands every record of the topic to on_record, partition by partition in
+  // order, from the offset start_at gives each partition (the earliest one
+  // when it gives none) up to the partition's current end.
+  void scan(std::string const &topic_name,
+            std::invocable<std::int32_t> auto &&start_at,
+            std::invocable<RdKafka::Message &> auto &&on_record) {
+    std::lock_guard l_{m_};
+    std::map<std::int32_t, std::int64_t> end_offsets;
+    event_source_details_::topic_partitions assignment;
+    for (std::int32_t const partition : partitions(topic_name)) {
+      std::int64_t low = 0;
+      std::int64_t high = 0;
+      throw_if_failed(topic_name,
+                      consumer_->query_watermark_offsets(
+                          topic_name, partition, &low, &high, timeout()));
+      std::optional<std::int64_t> const start_offset = start_at(partition);
+      std::int64_t const next_offset = start_offset.value_or(low);
+      if (next_offset < high) {
+        assignment.partitions.push_back(RdKafka::TopicPartition::create(
+            topic_name, partition, next_offset));
+        end_offsets.emplace(partition, high);
+      }
+    }
+
+    if (not std::empty(end_offsets)) {
+      throw_if_failed(topic_name, consumer_->assign(assignment.partitions));
+      auto const deadline =
+          std::chrono::steady_clock::now() + config_.read_timeout();
+      while (not std::empty(end_offsets)) {
+        std::unique_ptr<RdKafka::Message> const message =
+            consume(topic_name, deadline);
+        if (nullptr == message) {
+          continue;
+        }
+        std::int32_t const partition = message->partition();
+        if (RdKafka::ERR__PARTITION_EOF == message->err()) {
+          end_offsets.erase(partition);
+          continue;
+        }
+        on_record(*message);
+        if (auto const end = end_offsets.find(partition);
+            std::end(end_offsets) != end &&
+            message->offset() + 1 >= end->second) {
+          end_offsets.erase(end);
+        }
+      }
+      consumer_->unassign();
+    }
+  }
+
+  void read(std::int32_t const partition,
+            std::span<std::int64_t const> const offsets,
+            std::invocable<RdKafka::Message &> auto &&on_record) {
+    read(config_.topic_name(), partition, offsets, on_record);
+  }
+
+  // Hands the records at the given offsets of a partition to on_record, in
+  // order. Offsets must be ascending.
+  void read(std::string const &topic_name, std::int32_t const partition,
+            std::span<std::int64_t const> const offsets,
+            std::invocable<RdKafka::Message &> auto &&on_record) {
+    read_while(topic_name, partition, offsets,
+               [&on_record](RdKafka::Message &message) {
+                 on_record(message);
+                 return true;
+               });
+  }
+
+  void read_while(std::int32_t const partition,
+                  std::span<std::int64_t const> const offsets,
+                  std::predicate<RdKafka::Message &> auto &&on_record) {
+    read_while(config_.topic_name(), partition, offsets, on_record);
+  }
+
+  // As read, but stops at the first record on_record returns false for.
+  void read_while(std::string const &topic_name, std::int32_t const partition,
+                  std::span<std::int64_t const> const offsets,
+                  std::predicate<RdKafka::Message &> auto &&on_record) {
+    using namespace event_source_details_;
+
+    if (std::empty(offsets)) {
+      return;
+    }
+    std::lock_guard l_{m_};
+    seek(topic_name, partition, offsets.front());
+    auto const deadline =
+        std::chrono::steady_clock::now() + config_.read_timeout();
+    for (auto next = std::begin(offsets); std::end(offsets) != next;) {
+      std::unique_ptr<RdKafka::Message> const message =
+          consume(topic_name, deadline);
+      if (nullptr == message) {
+        continue;
+      }
+      if (RdKafka::ERR__PARTITION_EOF == message->err() ||
+          message->offset() > *next) {
+        consumer_->unassign();
+        throw history_load_failed{"Record at offset " + std::to_string(*next) +
+                                  " of partition " +
+                                  std::to_string(partition) +
+                                  " is no longer available"};
+      }
+      if (message->offset() < *next) {
+        continue;
+      }
+      if (not on_record(*message)) {
+        break;
+      }
+      if (++next != std::end(offsets) &&
+          *next - message->offset() > seek_distance) {
+        seek(topic_name, partition, *next);
+      }
+    }
+    consumer_->unassign();
+  }
+
+private:
+  int timeout() const noexcept {
+    return static_cast<int>(config_.read_timeout().count());
+  }
+
+  void catch_up_from_checkpoints(offset_index &index) {
+    using namespace event_source_details_;
+
+    scan(
+        config_.topic_name(),
+        [&index](std::int32_t const partition) {
+          return index.next_offset(partition);
+        },
+        [&index, this](RdKafka::Message &message) {
+          std::string const *const key = message.key();
+          std::optional<std::uint64_t> const version =
+              header_integer<std::uint64_t>(message,
+                                            config_.version_header_name());
+          // A version the index cannot follow on from leaves its aggregate
+          // as it was rather than failing the rest of the pass.
+          if (nullptr != key && version.value_or(0) > 0) {
+            index.try_record(*key, message.partition(), *version,
+                             message.offset());
+          }
+          index.checkpoint(message.partition(), message.offset() + 1);
+        });
+    index.flush();
+  }
+
+  static void throw_if_failed(std::string const &topic_name,
+                              RdKafka::ErrorCode const error) {
+    if (RdKafka::ERR_NO_ERROR != error) {
+      throw history_load_error{error, "Failed to read " + topic_name};
+    }
+  }
+
+  std::vector<std::int32_t> partitions(std::string const &topic_name) {
+    RdKafka::Metadata *raw_metadata = nullptr;
+    throw_if_failed(topic_name, consumer_->metadata(true, nullptr,
+                                                    &raw_metadata, timeout()));
+    std::unique_ptr<RdKafka::Metadata> const metadata{raw_metadata};
+    std::vector<std::int32_t> result;
+    for (RdKafka::TopicMetadata const *const topic : *metadata->topics()) {
+      if (topic_name == topic->topic()) {
+        for (RdKafka::PartitionMetadata const *const partition :
+             *topic->partitions()) {
+          result.push_back(partition->id());
+        }
+      }
+    }
+    return result;
+  }
+
+  void seek(std::string const &topic_name, std::int32_t const partition,
+            std::int64_t const offset) {
+    event_source_details_::topic_partitions assignment;
+    assignment.partitions.push_back(
+        RdKafka::TopicPartition::create(topic_name, partition, offset));
+    throw_if_failed(topic_name, consumer_->assign(assignment.partitions));
+  }
+
+  // Returns the next record or end of partition event, or nothing if neither
+  // arrived this interval.
+  std::unique_ptr<RdKafka::Message>
+  consume(std::string const &topic_name,
+          std::chrono::steady_clock::time_point const deadline) {
+    std::unique_ptr<RdKafka::Message> message{consumer_->consume(
+        static_cast<int>(event_source_details_::consume_interval.count()))};
+    switch (message->err()) {
+    case RdKafka::ERR_NO_ERROR:
+    case RdKafka::ERR__PARTITION_EOF:
+      return message;
+
+    case RdKafka::ERR__TIMED_OUT:
+      if (std::chrono::steady_clock::now() < deadline) {
+        return nullptr;
+      }
+      consumer_->unassign();
+      throw history_load_error{RdKafka::ERR__TIMED_OUT,
+                               "Timed out reading " + topic_name};
+
+    default:
+      consumer_->unassign();
+      throw history_load_error{message->err(), message->errstr()};
+    }
+  }
+
+  event_log_config const &config_;
+  std::mutex m_;
+  std::unique_ptr<RdKafka::KafkaConsumer> consumer_;
+};
+
+namespace event_store_details_ {
+template <concepts::domain_event... DomainEvents> struct event_source {
+  using id_type = id_t<DomainEvents...>;
+  using version_type = version_t<DomainEvents...>;
+  using timestamp_type = timestamp_t<DomainEvents...>;
+
+  event_source(id_type id, std::string key, event_log_config const &config,
+               event_dispatcher<DomainEvents...> &event_dispatcher,
+               offset_index &index, kafka::reader &reader)
+      : id_{std::move(id)}, key_{std::move(key)}, config_{config},
+        event_dispatcher_{event_dispatcher}, index_{index}, reader_{reader} {}
+
+  // Replays the aggregate's records straight from the offsets held in the
+  // index, catching it up first if it is stale. Records written by other
+  // processes only become visible once the store has caught up.
+  template <concepts::aggregate_root<DomainEvents...> Aggregate>
+  void load_from_history(Aggregate &aggregate,
+                         version_t<decltype(aggregate)> const target_version) {
+    std::unsigned_integral auto const aggregate_version = version(aggregate);
+    assert((aggregate_version < target_version) &&
+           "Aggregate version cannot exceed target version");
+
+    catch_up_if_stale();
+    std::optional<std::int32_t> const partition = index_.partition(key_);
+    if (not partition.has_value()) {
+      return;
+    }
+    std::vector<std::int64_t> const offsets =
+        index_.offsets(key_, aggregate_version + 1, target_version);
+    auto visitor = playback_visitor(aggregate);
+    reader_.read(*partition, offsets, [&, this](RdKafka::Message &message) {
+      using namespace event_source_details_;
+      auto const headers =
+          read_record_headers<version_type, timestamp_type>(message, config_);
+      event_dispatcher_.dispatch(headers.type, payload(message),
+                                 {id_, headers.version, headers.timestamp},
+                                 visitor);
+    });
+    visitor.flush();
+  }
+
+  // Replays the aggregate's records in order up to the first one committed
+  // after the timestamp. The index gives their offsets, so no more than one
+  // record past those replayed is read.
+  template <concepts::aggregate_root<DomainEvents...> Aggregate>
+  void load_as_of(Aggregate &aggregate, concepts::timestamp auto const as_of) {
+    catch_up_if_stale();
+    std::optional<std::int32_t> const partition = index_.partition(key_);
+    if (not partition.has_value()) {
+      return;
+    }
+    std::vector<std::int64_t> const offsets =
+        index_.offsets(key_, version(aggregate) + 1,
+                       std::numeric_limits<std::uint64_t>::max());
+    auto const cutoff =
+        std::chrono::floor<typename timestamp_type::duration>(as_of);
+    auto visitor = playback_visitor(aggregate);
+    reader_.read_while(
+        *partition, offsets, [&, this](RdKafka::Message &message) {
+          using namespace event_source_details_;
+          auto const headers =
+              read_record_headers<version_type, timestamp_type>(message,
+                                                                config_);
+          if (cutoff < headers.timestamp) {
+            return false;
+          }
+          event_dispatcher_.dispatch(headers.type, payload(message),
+                                     {id_, headers.version, headers.timestamp},
+                                     visitor);
+          return true;
+        });
+    visitor.flush();
+  }
+
+  // Hydrates the aggregate from its latest snapshot, then replays only the
+  // events after it.
+  template <typename SnapshotSource,
+            concepts::aggregate_root<DomainEvents...> Aggregate>
+  requires std::invocable<decltype(skizzay::cddd::load_from_snapshot),
+                          SnapshotSource &, Aggregate &,
+                          version_t<Aggregate> const>
+  void load_from_snapshot_and_history(
+      SnapshotSource &snapshots, Aggregate &aggregate,
+      version_t<Aggregate> const target_version) {
+    if (target_version <= version(aggregate)) {
+      return;
+    }
+    skizzay::cddd::load_from_snapshot(snapshots, aggregate, target_version);
+    if (version(aggregate) < target_version) {
+      load_from_history(aggregate, target_version);
+    }
+  }
+
+private:
+  // Only aggregates that apply a view of at least one event type are handed
+  // views; the rest have each payload decoded straight to its event.
+  template <typename Aggregate>
+  static constexpr bool applies_views =
+      (concepts::view_applicable<Aggregate, std::remove_cvref_t<DomainEvents>,
+                                 record_payload> ||
+       ...);
+
+  template <typename Aggregate>
+  static auto playback_visitor(Aggregate &aggregate) {
+    if constexpr (applies_views<Aggregate>) {
+      return as_event_view_visitor<record_payload, DomainEvents...>(aggregate);
+    } else {
+      return as_event_run_visitor<DomainEvents...>(aggregate);
+    }
+  }
+
+  void catch_up_if_stale() {
+    if (index_.stale()) {
+      reader_.catch_up(index_);
+    }
+  }
+
+  std::remove_cvref_t<id_type> id_;
+  std::string key_;
+  event_log_config const &config_;
+  event_dispatcher<DomainEvents...> &event_dispatcher_;
+  offset_index &index_;
+  kafka::reader &reader_;
+};
+} // namespace event_store_details_
+
+template <concepts::domain_event... DomainEvents>
+using event_source = event_store_details_::event_source<DomainEvents...>;
+} // namespace skizzay::cddd::kafka
@@ -1,73 +1,280 @@
 #pragma once
 
+#include "skizzay/cddd/concurrent_repository.h"
 #include "skizzay/cddd/domain_event.h"
+#include "skizzay/cddd/event_stream.h"
 #include "skizzay/cddd/identifier.h"
 #include "skizzay/cddd/kafka/kafka_deser.h"
+#include "skizzay/cddd/kafka/kafka_event_dispatcher.h"
+#include "skizzay/cddd/kafka/kafka_event_log_config.h"
+#include "skizzay/cddd/kafka/kafka_event_source.h"
+#include "skizzay/cddd/kafka/kafka_offset_index.h"
+#include "skizzay/cddd/kafka/kafka_producer.h"
+#include "skizzay/cddd/kafka/kafka_record.h"
+#include "skizzay/cddd/kafka/kafka_stream_version.h"
+#include "skizzay/cddd/kafka/kafka_transaction.h"
+#include "skizzay/cddd/narrow_cast.h"
 #include "skizzay/cddd/timestamp.h"
 #include "skizzay/cddd/version.h"
 
 #include <librdkafka/rdkafkacpp.h>
 
+#include <concepts>
+#include <exception>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
 namespace skizzay::cddd::kafka {
 namespace event_store_details_ {
-template <concepts::domain_event... DomainEvents> struct event_source {
-  using id_type = std::common_reference_t<id_t<DomainEvents>...>;
-  using version_type = std::common_type_t<version_t<DomainEvents>...>;
-  using timestamp_type = std::common_type_t<timestamp_t<DomainEvents>...>;
-
-  template <concepts::versioned Aggregate>
-  requires std::same_as<version_type, version_t<Aggregate>> &&
-      (std::invocable<decltype(skizzay::cddd::apply),
-                      std::add_lvalue_reference_t<Aggregate>,
-                      std::remove_reference_t<DomainEvents> const &>
-           &&...) void load_from_history(Aggregate &aggregate,
-                                         version_t<decltype(aggregate)> const
-                                             target_version) {
-    std::unsigned_integral auto const aggregate_version = version(aggregate);
-    assert((aggregate_version < target_version) &&
-           "Aggregate version cannot exceed target version");
-  }
-};
 
-template <concepts::domain_event... DomainEvents> struct event_stream {
-  using id_type = std::common_reference_t<id_t<DomainEvents>...>;
-  using version_type = std::common_type_t<version_t<DomainEvents>...>;
-  using timestamp_type = std::common_type_t<timestamp_t<DomainEvents>...>;
+// Payloads of the events buffered for one commit are allocated from a single
+// arena, which the records share ownership of until they are delivered.
+inline constexpr std::size_t initial_arena_size = 16 * 1024;
+
+template <concepts::clock Clock, concepts::domain_event... DomainEvents>
+struct event_stream final
+    : event_stream_base<event_stream<Clock, DomainEvents...>, Clock, record,
+                        DomainEvents...> {
+  using base_type = event_stream_base<event_stream<Clock, DomainEvents...>,
+                                      Clock, record, DomainEvents...>;
+  using typename base_type::buffer_type;
+  using typename base_type::element_type;
+  using typename base_type::id_type;
+  using typename base_type::timestamp_type;
+  using typename base_type::version_type;
 
-  event_stream(std::remove_cvref_t<id_type> const &id) noexcept(
-      std::is_nothrow_constructible_v<std::remove_cvref_t<id_type>>)
-      : id_{id} {}
+  event_stream(id_type id, serializer<DomainEvents...> const &serializer,
+               event_log_config const &config, kafka::producer &producer,
+               offset_index &index,
+               std::shared_ptr<stream_version<version_type>> stream_version,
+               transaction_coordinator<version_type> *const coordinator,
+               transaction<version_type> *const enlisted_in, Clock clock)
+      : base_type{std::move(clock)}, id_{std::move(id)},
+        key_{message_key(id_)}, serializer_{serializer}, config_{config},
+        producer_{producer}, index_{index},
+        stream_version_{std::move(stream_version)}, coordinator_{coordinator},
+        transaction_{enlisted_in} {}
 
   std::remove_cvref_t<id_type> const &id() const noexcept { return id_; }
 
+  version_type version() const { return stream_version_->get(); }
+
+  // Streams enlisted in a transaction only stage their events with it. On a
+  // transactional event log, other streams commit in a transaction of their
+  // own.
+  void commit_buffered_events(buffer_type &&buffer, timestamp_type const,
+                              version_type const expected_version) {
+    arena_.reset();
+    if (nullptr != transaction_) {
+      transaction_->stage(key_, stream_version_, expected_version, buffer);
+    } else if (nullptr != coordinator_) {
+      transaction<version_type> t{*coordinator_};
+      t.stage(key_, stream_version_, expected_version, buffer);
+      t.commit();
+    } else {
+      stream_version_->commit(
+          expected_version, narrow_cast<version_type>(std::size(buffer)),
+          [&, this]() {
+            index_committed(index_, key_, expected_version,
+                            producer_.produce(config_.topic_name(), key_,
+                                              buffer));
+          });
+    }
+  }
+
+  // Other streams complete once every record has a delivery report. Streams
+  // enlisted in a transaction stage their events when their turn comes, so
+  // the transaction must not be committed before the returned future
+  // completes; on a transactional event log, the others commit in a
+  // transaction of their own when their turn comes.
+  commit_start prepare_async_commit(std::shared_ptr<buffer_type> buffer,
+                                    timestamp_type const,
+                                    version_type const expected_version) {
+    arena_.reset();
+    return [key = key_, &config = config_, &producer = producer_,
+            &index = index_, stream_version = stream_version_,
+            coordinator = coordinator_, enlisted_in = transaction_,
+            buffer = std::move(buffer),
+            expected_version](commit_completion completed) {
+      if (nullptr != enlisted_in) {
+        enlisted_in->stage(key, stream_version, expected_version, *buffer);
+        completed(nullptr);
+      } else if (nullptr != coordinator) {
+        transaction<version_type> t{*coordinator};
+        t.stage(key, stream_version, expected_version, *buffer);
+        t.commit();
+        completed(nullptr);
+      } else {
+        version_type const num_events =
+            narrow_cast<version_type>(std::size(*buffer));
+        stream_version->claim(expected_version);
+        try {
+          producer.send_async(
+              config.topic_name(), key, *buffer,
+              [key, &index, stream_version, buffer, expected_version,
+               num_events, completed](std::exception_ptr error,
+                                      std::vector<record_location> const
+                                          &locations) {
+                if (nullptr == error) {
+                  index_committed(index, key, expected_version, locations);
+                }
+                stream_version->release(expected_version, num_events,
+                                        nullptr == error);
+                completed(error);
+              });
+        } catch (...) {
+          stream_version->release(expected_version, num_events, false);
+          throw;
+        }
+      }
+    };
+  }
+
   template <concepts::domain_event DomainEvent>
-  requires(std::same_as<std::remove_cvref_t<DomainEvent>,
-                        std::remove_cvref_t<DomainEvents>> ||
-           ...) void add_event(DomainEvent &&) {}
+  record make_buffer_element(DomainEvent &&domain_event) {
+    using serializer_type =
+        derser_details_::serializer_interface<std::remove_cvref_t<DomainEvent>>;
+    serializer_type const &serializer =
+        static_cast<serializer_type const &>(serializer_);
+    if (nullptr == arena_) {
+      arena_ = std::make_shared<std::pmr::monotonic_buffer_resource>(
+          initial_arena_size);
+    }
+    record result;
+    result.payload_owner = arena_;
+    result.payload = serializer.serialize(domain_event, arena_.get());
+    result.headers->add(config_.type_header_name(),
+                        std::string{serializer.message_type(
+                            event_type<std::remove_cvref_t<DomainEvent>>{})});
+    return result;
+  }
 
-  constexpr void commit_events() {}
+  void populate_commit_info(timestamp_type const timestamp,
+                            version_type const event_version, record &r) {
+    r.headers->add(config_.version_header_name(), header_value(event_version));
+    r.headers->add(config_.timestamp_header_name(), header_value(timestamp));
+    r.timestamp_in_ms = timestamp_in_ms(timestamp);
+  }
 
-  constexpr void rollback() noexcept {}
+  void rollback() noexcept {
+    base_type::rollback();
+    arena_.reset();
+  }
 
 private:
   std::remove_cvref_t<id_type> id_;
+  std::string key_;
+  serializer<DomainEvents...> const &serializer_;
+  event_log_config const &config_;
+  kafka::producer &producer_;
+  offset_index &index_;
+  std::shared_ptr<stream_version<version_type>> stream_version_;
+  transaction_coordinator<version_type> *coordinator_;
+  transaction<version_type> *transaction_;
+  std::shared_ptr<std::pmr::monotonic_buffer_resource> arena_;
 };
 
-template <concepts::domain_event... DomainEvents> struct event_store {
-  using id_type = std::common_reference_t<id_t<DomainEvents>...>;
-  using version_type = std::common_type_t<version_t<DomainEvents>...>;
-  using timestamp_type = std::common_type_t<timestamp_t<DomainEvents>...>;
+template <concepts::clock Clock, concepts::domain_event... DomainEvents>
+struct event_store {
+  using id_type = id_t<DomainEvents...>;
+  using version_type = version_t<DomainEvents...>;
+  using timestamp_type = timestamp_t<DomainEvents...>;
+
+  explicit event_store(event_log_config const &config,
+                       serializer<DomainEvents...> const &serializer,
+                       event_dispatcher<DomainEvents...> &event_dispatcher,
+                       offset_index &index, Clock clock = {})
+      : config_{config}, serializer_{serializer},
+        event_dispatcher_{event_dispatcher}, index_{index}, producer_{config},
+        reader_{config}, clock_{std::move(clock)} {
+    if (producer_.transactional()) {
+      coordinator_.emplace(config_, producer_, index_);
+    }
+  }
 
-  event_stream<DomainEvents...> get_event_stream(auto const &id) noexcept {
-    return {id};
+  event_stream<Clock, DomainEvents...> get_event_stream(auto const &id) {
+    return {id,     serializer_,    config_,       producer_,
+            index_, version_of(id), coordinator(), nullptr,
+            clock_};
   }
 
-  event_source<DomainEvents...> get_event_source(auto const &) noexcept {
-    return {};
+  // Commits to the returned stream are staged with the transaction, to be
+  // published when it commits.
+  event_stream<Clock, DomainEvents...>
+  get_event_stream(auto const &id, transaction<version_type> &enlisted_in) {
+    return {id,     serializer_,    config_,       producer_,
+            index_, version_of(id), coordinator(), &enlisted_in,
+            clock_};
   }
 
-  std::unique_ptr<serializer<DomainEvents...>> serializer_;
+  // Starts a transaction spanning any number of aggregates. Only available
+  // when the event log has a transactional id.
+  transaction<version_type> begin_transaction() {
+    if (nullptr == coordinator()) {
+      throw std::logic_error{"Event log " + config_.topic_name() +
+                             " has no transactional id"};
+    }
+    return transaction<version_type>{*coordinator_};
+  }
+
+  event_source<DomainEvents...> get_event_source(auto const &id) {
+    return {id, message_key(id), config_, event_dispatcher_, index_, reader_};
+  }
+
+  // Indexes whatever has been written to the topic since the last catch up,
+  // and advances the versions of the streams already handed out to match.
+  // Needed on start up when the index may be behind the topic, and whenever
+  // another process may have written to it. Kafka has no conditional writes,
+  // so commits racing another writer's between catch ups are not detected.
+  void catch_up() {
+    reader_.catch_up(index_);
+    versions_.for_each(
+        [this](auto const &id,
+               std::shared_ptr<stream_version<version_type>> const &version) {
+          version->catch_up(
+              narrow_cast<version_type>(index_.version(message_key(id))));
+        });
+  }
+
+private:
+  transaction_coordinator<version_type> *coordinator() noexcept {
+    return coordinator_ ? &*coordinator_ : nullptr;
+  }
+
+  std::shared_ptr<stream_version<version_type>>
+  version_of(std::remove_cvref_t<id_type> const &id) {
+    if (auto result = versions_.get(id); nullptr != result) {
+      return result;
+    }
+    return versions_.add(
+        id, std::make_shared<stream_version<version_type>>(
+                narrow_cast<version_type>(index_.version(message_key(id)))));
+  }
+
+  event_log_config const &config_;
+  serializer<DomainEvents...> const &serializer_;
+  event_dispatcher<DomainEvents...> &event_dispatcher_;
+  offset_index &index_;
+  kafka::producer producer_;
+  kafka::reader reader_;
+  [[no_unique_address]] Clock clock_;
+  concurrent_table<std::shared_ptr<stream_version<version_type>>,
+                   std::remove_cvref_t<id_type>>
+      versions_;
+  std::optional<transaction_coordinator<version_type>> coordinator_;
 };
 } // namespace event_store_details_
 
+template <concepts::clock Clock, concepts::domain_event... DomainEvents>
+using event_store = event_store_details_::event_store<Clock, DomainEvents...>;
+
+template <concepts::clock Clock, concepts::domain_event... DomainEvents>
+using event_stream = event_store_details_::event_stream<Clock, DomainEvents...>;
+
 } // namespace skizzay::cddd::kafka
@@ -0,0 +1,351 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+namespace skizzay::cddd::kafka {
+
+struct offset_index_corrupted : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+namespace offset_index_details_ {
+// The index file is a sequence of blocks. An aggregate block holds a run of
+// consecutive versions of one aggregate:
+//   varint key size, key, varint partition, varint first version,
+//   varint count, varint first offset, (count - 1) varint offset deltas
+// A checkpoint block has an empty key and records how far a partition has
+// been consumed:
+//   varint 0, varint partition, varint next offset
+// Later blocks supersede earlier ones, so the file can be appended to and
+// rewritten by compact() when it grows. A crash part way through an append
+// leaves the last block cut short; it is dropped when the file is loaded.
+inline void write_varint(std::string &out, std::uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+// Empty when the input ends part way through the varint.
+inline std::optional<std::uint64_t> read_varint(std::string_view &in) {
+  std::uint64_t result = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    if (std::empty(in)) {
+      return std::nullopt;
+    }
+    auto const byte = static_cast<std::uint8_t>(in.front());
+    in.remove_prefix(1);
+    result |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+    if (0 == (byte & 0x80)) {
+      return result;
+    }
+  }
+  throw offset_index_corrupted{"Overlong varint in offset index"};
+}
+
+struct entry {
+  std::int32_t partition = -1;
+  std::vector<std::int64_t> offsets;
+};
+} // namespace offset_index_details_
+
+// Maps each aggregate (by message key) to its partition and the offset of
+// every version of it, so that hydration can seek straight to an aggregate's
+// records instead of scanning the partition. Offsets are only ever appended
+// in version order; a record for an already indexed version (a commit that
+// was retried after a failed delivery) replaces it and everything after it.
+struct offset_index {
+  explicit offset_index(std::filesystem::path path) : path_{std::move(path)} {
+    load();
+  }
+
+  void record(std::string const &key, std::int32_t const partition,
+              std::uint64_t const version, std::int64_t const offset) {
+    if (not try_record(key, partition, version, offset)) {
+      throw offset_index_corrupted{"Version " + std::to_string(version) +
+                                   " of '" + key + "' is out of sequence"};
+    }
+  }
+
+  // As record, but a version past the one after the last indexed is left out
+  // and false returned instead of throwing.
+  bool try_record(std::string const &key, std::int32_t const partition,
+                  std::uint64_t const version, std::int64_t const offset) {
+    std::lock_guard l_{m_};
+    auto const indexed = entries_.find(key);
+    std::size_t const indexed_versions =
+        std::end(entries_) == indexed ? 0 : std::size(indexed->second.offsets);
+    if (0 == version || version > indexed_versions + 1) {
+      return false;
+    }
+    auto &entry = entries_[key];
+    if (version <= std::size(entry.offsets) &&
+        offset == entry.offsets[version - 1] &&
+        partition == entry.partition) {
+      return true;
+    }
+    entry.partition = partition;
+    entry.offsets.resize(version - 1);
+    entry.offsets.push_back(offset);
+    if (auto const [dirty, is_new_entry] = dirty_.try_emplace(key, version);
+        not is_new_entry) {
+      dirty->second = std::min(dirty->second, version);
+    }
+    return true;
+  }
+
+  void checkpoint(std::int32_t const partition,
+                  std::int64_t const next_offset) {
+    std::lock_guard l_{m_};
+    checkpoints_.insert_or_assign(partition, next_offset);
+    dirty_checkpoints_ = true;
+  }
+
+  // The offset at which consumption of a partition should resume.
+  std::optional<std::int64_t> next_offset(std::int32_t const partition) const {
+    std::lock_guard l_{m_};
+    if (auto const checkpoint = checkpoints_.find(partition);
+        std::end(checkpoints_) != checkpoint) {
+      return checkpoint->second;
+    }
+    return std::nullopt;
+  }
+
+  std::uint64_t version(std::string const &key) const {
+    std::lock_guard l_{m_};
+    auto const entry = entries_.find(key);
+    return std::end(entries_) == entry ? 0 : std::size(entry->second.offsets);
+  }
+
+  std::optional<std::int32_t> partition(std::string const &key) const {
+    std::lock_guard l_{m_};
+    if (auto const entry = entries_.find(key); std::end(entries_) != entry) {
+      return entry->second.partition;
+    }
+    return std::nullopt;
+  }
+
+  // Offsets of versions [first_version, last_version], clamped to what has
+  // been indexed.
+  std::vector<std::int64_t> offsets(std::string const &key,
+                                    std::uint64_t const first_version,
+                                    std::uint64_t const last_version) const {
+    std::lock_guard l_{m_};
+    auto const entry = entries_.find(key);
+    if (std::end(entries_) == entry || 0 == first_version) {
+      return {};
+    }
+    auto const &offsets = entry->second.offsets;
+    std::uint64_t const end_version =
+        std::min<std::uint64_t>(last_version, std::size(offsets));
+    if (first_version > end_version) {
+      return {};
+    }
+    return {std::next(std::begin(offsets), first_version - 1),
+            std::next(std::begin(offsets), end_version)};
+  }
+
+  // Marks the index as lagging behind records known to be committed, as when
+  // indexing them failed after the fact. Catching up clears it.
+  void mark_stale() noexcept { stale_.store(true, std::memory_order_release); }
+
+  bool stale() const noexcept {
+    return stale_.load(std::memory_order_acquire);
+  }
+
+  // Whether the index was stale.
+  bool clear_stale() noexcept {
+    return stale_.exchange(false, std::memory_order_acq_rel);
+  }
+
+  // Appends everything recorded since the last flush to the index file. What
+  // fails to be written is kept for the next flush.
+  void flush() {
+    std::lock_guard l_{m_};
+    std::string buffer;
+    for (auto const &[key, first_version] : dirty_) {
+      auto const &entry = entries_.at(key);
+      append_entry(buffer, key, entry, first_version);
+    }
+    if (dirty_checkpoints_) {
+      append_checkpoints(buffer);
+    }
+    if (not std::empty(buffer)) {
+      write(buffer, std::ios::app);
+    }
+    dirty_.clear();
+    dirty_checkpoints_ = false;
+  }
+
+  // Rewrites the index file with a single block per aggregate.
+  void compact() {
+    std::lock_guard l_{m_};
+    std::string buffer;
+    for (auto const &[key, entry] : entries_) {
+      append_entry(buffer, key, entry, 1);
+    }
+    append_checkpoints(buffer);
+    std::filesystem::path temporary_path = path_;
+    temporary_path += ".compact";
+    {
+      std::ofstream output{temporary_path, std::ios::binary | std::ios::trunc};
+      output.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+      if (not output) {
+        throw std::filesystem::filesystem_error{
+            "Failed to compact offset index", temporary_path,
+            std::make_error_code(std::errc::io_error)};
+      }
+    }
+    std::filesystem::rename(temporary_path, path_);
+    dirty_.clear();
+    dirty_checkpoints_ = false;
+  }
+
+private:
+  static void append_entry(std::string &buffer, std::string const &key,
+                           offset_index_details_::entry const &entry,
+                           std::uint64_t const first_version) {
+    using offset_index_details_::write_varint;
+    if (first_version > std::size(entry.offsets)) {
+      return;
+    }
+    write_varint(buffer, std::size(key));
+    buffer.append(key);
+    write_varint(buffer, static_cast<std::uint64_t>(entry.partition));
+    write_varint(buffer, first_version);
+    write_varint(buffer, std::size(entry.offsets) - first_version + 1);
+    std::int64_t previous = entry.offsets[first_version - 1];
+    write_varint(buffer, static_cast<std::uint64_t>(previous));
+    for (std::size_t i = first_version; i < std::size(entry.offsets); ++i) {
+      write_varint(buffer,
+                   static_cast<std::uint64_t>(entry.offsets[i] - previous));
+      previous = entry.offsets[i];
+    }
+  }
+
+  void append_checkpoints(std::string &buffer) const {
+    using offset_index_details_::write_varint;
+    for (auto const &[partition, next_offset] : checkpoints_) {
+      write_varint(buffer, 0);
+      write_varint(buffer, static_cast<std::uint64_t>(partition));
+      write_varint(buffer, static_cast<std::uint64_t>(next_offset));
+    }
+  }
+
+  void write(std::string const &buffer, std::ios::openmode const mode) {
+    std::ofstream output{path_, std::ios::binary | mode};
+    output.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    if (not output) {
+      throw std::filesystem::filesystem_error{
+          "Failed to write offset index", path_,
+          std::make_error_code(std::errc::io_error)};
+    }
+  }
+
+  // A block cut short by a crash part way through an append is cut from the
+  // file, along with anything after it. The index is then stale, as the
+  // records it held are still to be caught up on from the topic.
+  void load() {
+    std::ifstream input{path_, std::ios::binary};
+    if (not input) {
+      return;
+    }
+    std::string const contents{std::istreambuf_iterator<char>{input},
+                               std::istreambuf_iterator<char>{}};
+    input.close();
+    std::string_view in = contents;
+    while (not std::empty(in)) {
+      if (not load_block(in)) {
+        std::filesystem::resize_file(
+            path_, std::size(contents) - std::size(in));
+        mark_stale();
+        break;
+      }
+    }
+  }
+
+  // Loads the block at the front of in and moves past it. When in ends part
+  // way through the block, nothing is loaded, in is left as it was and false
+  // is returned.
+  bool load_block(std::string_view &in) {
+    using offset_index_details_::read_varint;
+    std::string_view block = in;
+    std::optional<std::uint64_t> const key_size = read_varint(block);
+    if (not key_size.has_value()) {
+      return false;
+    }
+    if (0 == *key_size) {
+      std::optional<std::uint64_t> const partition = read_varint(block);
+      std::optional<std::uint64_t> const next_offset = read_varint(block);
+      if (not(partition.has_value() && next_offset.has_value())) {
+        return false;
+      }
+      checkpoints_.insert_or_assign(static_cast<std::int32_t>(*partition),
+                                    static_cast<std::int64_t>(*next_offset));
+      in = block;
+      return true;
+    }
+    if (*key_size > std::size(block)) {
+      return false;
+    }
+    std::string key{block.substr(0, *key_size)};
+    block.remove_prefix(*key_size);
+    std::optional<std::uint64_t> const partition = read_varint(block);
+    std::optional<std::uint64_t> const first_version = read_varint(block);
+    std::optional<std::uint64_t> const count = read_varint(block);
+    if (not(partition.has_value() && first_version.has_value() &&
+            count.has_value())) {
+      return false;
+    }
+    auto const indexed = entries_.find(key);
+    std::size_t const indexed_versions =
+        std::end(entries_) == indexed ? 0 : std::size(indexed->second.offsets);
+    if (0 == *first_version || 0 == *count ||
+        *first_version > indexed_versions + 1) {
+      throw offset_index_corrupted{"Offset index for '" + key +
+                                   "' is out of sequence"};
+    }
+    std::vector<std::int64_t> offsets;
+    offsets.reserve(std::min<std::uint64_t>(*count, std::size(block)));
+    for (std::uint64_t i = 0; i < *count; ++i) {
+      std::optional<std::uint64_t> const delta = read_varint(block);
+      if (not delta.has_value()) {
+        return false;
+      }
+      offsets.push_back((std::empty(offsets) ? 0 : offsets.back()) +
+                        static_cast<std::int64_t>(*delta));
+    }
+    auto &entry = entries_[std::move(key)];
+    entry.partition = static_cast<std::int32_t>(*partition);
+    entry.offsets.resize(*first_version - 1);
+    entry.offsets.insert(std::end(entry.offsets), std::begin(offsets),
+                         std::end(offsets));
+    in = block;
+    return true;
+  }
+
+  std::filesystem::path path_;
+  mutable std::mutex m_;
+  std::unordered_map<std::string, offset_index_details_::entry> entries_;
+  std::map<std::int32_t, std::int64_t> checkpoints_;
+  std::unordered_map<std::string, std::uint64_t> dirty_;
+  bool dirty_checkpoints_ = false;
+  std::atomic<bool> stale_ = false;
+};
+} // namespace skizzay::cddd::kafka
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <librdkafka/rdkafkacpp.h>
+
+#include <concepts>
+#include <stdexcept>
+#include <string>
+
+namespace skizzay::cddd::kafka {
+
+template <std::derived_from<std::exception> E>
+struct operation_failed_error : E {
+  operation_failed_error(RdKafka::ErrorCode const error,
+                         std::string const &message)
+      : E{message + ": " + RdKafka::err2str(error)}, error_{error} {}
+
+  RdKafka::ErrorCode error() const noexcept { return error_; }
+
+private:
+  RdKafka::ErrorCode error_;
+};
+
+} // namespace skizzay::cddd::kafka
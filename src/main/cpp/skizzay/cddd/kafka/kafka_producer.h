@@ -0,0 +1,337 @@
+#pragma once
+
+#include "skizzay/cddd/commit_failed.h"
+#include "skizzay/cddd/kafka/kafka_configuration.h"
+#include "skizzay/cddd/kafka/kafka_event_log_config.h"
+#include "skizzay/cddd/kafka/kafka_operation_failed_error.h"
+#include "skizzay/cddd/kafka/kafka_record.h"
+#include "skizzay/cddd/retry_policy.h"
+
+#include <librdkafka/rdkafkacpp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace skizzay::cddd::kafka {
+using commit_error = operation_failed_error<commit_failed>;
+
+namespace producer_details_ {
+inline constexpr std::chrono::milliseconds poll_interval{10};
+
+// Tracks the delivery reports of the records produced by one commit. Reports
+// may be served by any thread polling the producer, so completion is only
+// observed through the atomic counter.
+struct delivery_batch {
+  struct slot {
+    delivery_batch *batch;
+    std::size_t index;
+    record *r;
+  };
+
+  explicit delivery_batch(std::size_t const num_records)
+      : pending_{num_records}, locations_(num_records) {
+    slots_.reserve(num_records);
+  }
+
+  // Slots are reserved up front so that the opaque handed to librdkafka stays
+  // put while later records are tracked.
+  slot *track(record &r) {
+    assert((std::size(slots_) < slots_.capacity()) &&
+           "Tracking more records than the batch was created for");
+    slots_.push_back(slot{this, std::size(slots_), &r});
+    return &slots_.back();
+  }
+
+  // librdkafka is done with the payload once it is reported, so it is
+  // released here rather than when the commit returns.
+  void delivered(slot &s, RdKafka::Message const &message) {
+    if (RdKafka::ERR_NO_ERROR == message.err()) {
+      locations_[s.index] = {message.partition(), message.offset()};
+    }
+    release_payload(*s.r);
+    complete(message.err(), message.errstr());
+  }
+
+  // Invoked once every record has been reported, on the thread serving the
+  // last report. Must be set before the records are sent.
+  void when_done(std::function<void()> done) { done_ = std::move(done); }
+
+  void complete(RdKafka::ErrorCode const error, std::string const &message,
+                std::size_t const num_records = 1) {
+    if (RdKafka::ERR_NO_ERROR != error) {
+      std::lock_guard l_{m_};
+      if (RdKafka::ERR_NO_ERROR == error_) {
+        error_ = error;
+        message_ = message;
+      }
+    }
+    finish(num_records);
+  }
+
+  // Gives up on records that will never be produced.
+  void abandon(std::size_t const num_records) noexcept {
+    finish(num_records);
+  }
+
+  bool done() const noexcept {
+    return 0 == pending_.load(std::memory_order_acquire);
+  }
+
+  std::vector<record_location> take_locations() {
+    std::lock_guard l_{m_};
+    if (RdKafka::ERR_NO_ERROR != error_) {
+      throw commit_error{error_, message_};
+    }
+    return std::move(locations_);
+  }
+
+private:
+  // Without a callback, a waiter may destroy the batch as soon as the count
+  // reaches zero, so whether there is one is read beforehand. A callback owns
+  // the batch, keeping it alive until the callback, moved out first, returns.
+  void finish(std::size_t const num_records) noexcept {
+    bool const has_callback = static_cast<bool>(done_);
+    if (num_records != pending_.fetch_sub(num_records,
+                                          std::memory_order_acq_rel) ||
+        not has_callback) {
+      return;
+    }
+    std::function<void()> const done = std::move(done_);
+    done();
+  }
+
+  std::atomic<std::size_t> pending_;
+  mutable std::mutex m_;
+  RdKafka::ErrorCode error_ = RdKafka::ERR_NO_ERROR;
+  std::string message_;
+  std::vector<slot> slots_;
+  std::vector<record_location> locations_;
+  std::function<void()> done_;
+};
+
+struct delivery_report final : RdKafka::DeliveryReportCb {
+  void dr_cb(RdKafka::Message &message) override {
+    if (auto *const slot =
+            static_cast<delivery_batch::slot *>(message.msg_opaque());
+        nullptr != slot) {
+      slot->batch->delivered(*slot, message);
+    }
+  }
+};
+} // namespace producer_details_
+
+// An idempotent producer shared by every stream of an event store. Records are
+// keyed by aggregate id so that all events of an aggregate land, in order, on
+// the same partition; batching across aggregates is left to librdkafka. When
+// the event log has a transactional id, records may only be sent between
+// begin_transaction and commit_transaction.
+struct producer {
+  explicit producer(event_log_config const &config)
+      : delivery_timeout_{config.delivery_timeout()},
+        commit_retry_policy_{config.commit_retry_policy()},
+        transactional_{config.transactional_id().has_value()} {
+    std::unique_ptr<RdKafka::Conf> const configuration =
+        make_configuration(config);
+    set_property(*configuration, "enable.idempotence", std::string{"true"});
+    set_property(*configuration, "linger.ms",
+                 std::to_string(config.linger().count()));
+    set_property(*configuration, "batch.size",
+                 std::to_string(config.batch_size()));
+    set_property(*configuration, "message.timeout.ms",
+                 std::to_string(config.delivery_timeout().count()));
+    if (transactional_) {
+      set_property(*configuration, "transactional.id",
+                   *config.transactional_id());
+    }
+    apply_properties(*configuration, config);
+    set_property(*configuration, "dr_cb",
+                 static_cast<RdKafka::DeliveryReportCb *>(&delivery_report_));
+
+    std::string error_message;
+    producer_.reset(RdKafka::Producer::create(configuration.get(),
+                                              error_message));
+    if (nullptr == producer_) {
+      throw std::runtime_error{error_message};
+    }
+    if (transactional_) {
+      throw_if_failed(producer_->init_transactions(timeout()));
+    }
+  }
+
+  producer(producer const &) = delete;
+  producer &operator=(producer const &) = delete;
+
+  ~producer() {
+    stopping_.store(true, std::memory_order_release);
+    if (poller_.joinable()) {
+      poller_.join();
+    }
+    producer_->flush(timeout());
+  }
+
+  bool transactional() const noexcept { return transactional_; }
+
+  // Produces the records in order and blocks until every one of them has a
+  // delivery report. Payloads are handed to librdkafka without copying.
+  // Returns where each record landed, or throws commit_error with the first
+  // failure reported.
+  std::vector<record_location> produce(std::string const &topic_name,
+                                       std::string const &key,
+                                       std::span<record> const records) {
+    producer_details_::delivery_batch batch{std::size(records)};
+    send(topic_name, key, records, batch);
+    wait_for(batch);
+    return batch.take_locations();
+  }
+
+  // Produces the records in order without waiting for their delivery reports.
+  // Returns false if librdkafka refused one of them, in which case the rest
+  // are not produced and the failure is recorded in the batch.
+  bool send(std::string const &topic_name, std::string const &key,
+            std::span<record> const records,
+            producer_details_::delivery_batch &batch) {
+    for (std::size_t i = 0; i != std::size(records); ++i) {
+      RdKafka::ErrorCode const error =
+          produce_one(topic_name, key, records[i], batch);
+      if (RdKafka::ERR_NO_ERROR != error) {
+        batch.complete(error, "Failed to produce record",
+                       std::size(records) - i);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Produces the records in order without blocking. Once every one of them
+  // has a delivery report, delivered is given where they landed, or the first
+  // failure reported as a commit_error. From the first call on, reports are
+  // served by a thread polling the producer. The records must stay put until
+  // delivered is invoked, which must not throw.
+  void send_async(
+      std::string const &topic_name, std::string const &key,
+      std::span<record> const records,
+      std::function<void(std::exception_ptr, std::vector<record_location>)>
+          delivered) {
+    std::call_once(start_polling_, [this]() {
+      poller_ = std::thread{[this]() {
+        while (not stopping_.load(std::memory_order_acquire)) {
+          producer_->poll(
+              static_cast<int>(producer_details_::poll_interval.count()));
+        }
+      }};
+    });
+    auto batch =
+        std::make_shared<producer_details_::delivery_batch>(std::size(records));
+    batch->when_done([batch, delivered = std::move(delivered)]() {
+      std::vector<record_location> locations;
+      try {
+        locations = batch->take_locations();
+      } catch (...) {
+        delivered(std::current_exception(), {});
+        return;
+      }
+      delivered(nullptr, std::move(locations));
+    });
+    send(topic_name, key, records, *batch);
+  }
+
+  void wait_for(producer_details_::delivery_batch const &batch) {
+    while (not batch.done()) {
+      producer_->poll(
+          static_cast<int>(producer_details_::poll_interval.count()));
+    }
+  }
+
+  void begin_transaction() { throw_if_failed(producer_->begin_transaction()); }
+
+  // Retriable failures are retried as the commit retry policy says, until
+  // the delivery timeout has passed. If the commit fails, the transaction is
+  // aborted before commit_error is thrown.
+  void commit_transaction() {
+    auto const deadline = std::chrono::steady_clock::now() + delivery_timeout_;
+    for (std::size_t attempt = 1;; ++attempt) {
+      std::unique_ptr<RdKafka::Error> const error{
+          producer_->commit_transaction(timeout())};
+      if (nullptr == error) {
+        return;
+      }
+      if (error->is_retriable() &&
+          attempt < commit_retry_policy_.max_attempts &&
+          std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_until(std::min(
+            deadline, std::chrono::steady_clock::now() +
+                          backoff_delay(commit_retry_policy_, attempt)));
+        continue;
+      }
+      if (not error->is_fatal()) {
+        abort_transaction();
+      }
+      throw commit_error{error->code(), error->str()};
+    }
+  }
+
+  // Whatever was sent in the current transaction is discarded by the broker.
+  // Failures are left to surface on the next transaction.
+  void abort_transaction() noexcept {
+    std::unique_ptr<RdKafka::Error> const error{
+        producer_->abort_transaction(timeout())};
+  }
+
+  RdKafka::Producer &get() noexcept { return *producer_; }
+
+private:
+  int timeout() const noexcept {
+    return static_cast<int>(delivery_timeout_.count());
+  }
+
+  static void throw_if_failed(RdKafka::Error *const raw_error) {
+    std::unique_ptr<RdKafka::Error> const error{raw_error};
+    if (nullptr != error) {
+      throw commit_error{error->code(), error->str()};
+    }
+  }
+
+  RdKafka::ErrorCode produce_one(std::string const &topic_name,
+                                 std::string const &key, record &r,
+                                 producer_details_::delivery_batch &batch) {
+    producer_details_::delivery_batch::slot *const slot = batch.track(r);
+    for (;;) {
+      RdKafka::ErrorCode const error = producer_->produce(
+          topic_name, RdKafka::Topic::PARTITION_UA, 0, r.payload.data(),
+          std::size(r.payload), key.data(), std::size(key), r.timestamp_in_ms,
+          r.headers.get(), slot);
+      if (RdKafka::ERR__QUEUE_FULL == error) {
+        producer_->poll(
+            static_cast<int>(producer_details_::poll_interval.count()));
+        continue;
+      }
+      if (RdKafka::ERR_NO_ERROR == error) {
+        // librdkafka owns the headers once the record has been accepted
+        static_cast<void>(r.headers.release());
+      }
+      return error;
+    }
+  }
+
+  std::chrono::milliseconds delivery_timeout_;
+  retry_policy commit_retry_policy_;
+  bool transactional_;
+  producer_details_::delivery_report delivery_report_;
+  std::unique_ptr<RdKafka::Producer> producer_;
+  std::once_flag start_polling_;
+  std::atomic<bool> stopping_ = false;
+  std::thread poller_;
+};
+
+} // namespace skizzay::cddd::kafka
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <utility>
+
+namespace skizzay::cddd::kafka {
+
+struct projection_config {
+  explicit projection_config(std::string group_id)
+      : group_id_{std::move(group_id)} {}
+
+  // The consumer group the projection commits its offsets under. Partitions
+  // of the event log are balanced across the runners sharing it.
+  std::string const &group_id() const noexcept { return group_id_; }
+
+  // A batch is handed to the projection once it holds this many records, or
+  // once this long has passed since the batch was started.
+  std::size_t max_batch_size() const noexcept { return max_batch_size_; }
+  std::chrono::milliseconds max_batch_wait() const noexcept {
+    return max_batch_wait_;
+  }
+
+  // Additional librdkafka properties for the projection's consumer, applied
+  // after those of the event log.
+  std::map<std::string, std::string> const &properties() const noexcept {
+    return properties_;
+  }
+
+  projection_config
+  with_max_batch_size(std::size_t const max_batch_size) const {
+    projection_config result = *this;
+    result.max_batch_size_ = max_batch_size;
+    return result;
+  }
+
+  projection_config
+  with_max_batch_wait(std::chrono::milliseconds const max_batch_wait) const {
+    projection_config result = *this;
+    result.max_batch_wait_ = max_batch_wait;
+    return result;
+  }
+
+  projection_config with_property(std::string name, std::string value) const {
+    projection_config result = *this;
+    result.properties_.insert_or_assign(std::move(name), std::move(value));
+    return result;
+  }
+
+private:
+  std::string group_id_;
+  std::size_t max_batch_size_ = 500;
+  std::chrono::milliseconds max_batch_wait_{100};
+  std::map<std::string, std::string> properties_;
+};
+
+} // namespace skizzay::cddd::kafka
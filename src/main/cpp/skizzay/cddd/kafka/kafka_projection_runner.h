@@ -0,0 +1,354 @@
+#pragma once
+
+#include "skizzay/cddd/domain_event.h"
+#include "skizzay/cddd/identifier.h"
+#include "skizzay/cddd/kafka/kafka_configuration.h"
+#include "skizzay/cddd/kafka/kafka_event_dispatcher.h"
+#include "skizzay/cddd/kafka/kafka_event_log_config.h"
+#include "skizzay/cddd/kafka/kafka_event_source.h"
+#include "skizzay/cddd/kafka/kafka_operation_failed_error.h"
+#include "skizzay/cddd/kafka/kafka_projection_config.h"
+#include "skizzay/cddd/kafka/kafka_record.h"
+#include "skizzay/cddd/projection_failed.h"
+#include "skizzay/cddd/timestamp.h"
+#include "skizzay/cddd/version.h"
+
+#include <librdkafka/rdkafkacpp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace skizzay::cddd::kafka {
+using projection_error = operation_failed_error<projection_failed>;
+
+// Consecutive events of one aggregate, in the order they were committed.
+template <concepts::domain_event... DomainEvents> struct event_run {
+  std::remove_cvref_t<id_t<DomainEvents...>> id;
+  std::vector<std::unique_ptr<event_interface<DomainEvents...>>> events;
+};
+
+// A read model kept up to date by a projection runner. Each batch holds at
+// most one run per aggregate. Batches from different partitions are projected
+// concurrently, but every event of an aggregate is projected by the same
+// worker, in order. A batch must be durable once project returns, as its
+// offsets are committed next; if project throws, the runner stops and the
+// batch is consumed again when the projection restarts.
+template <concepts::domain_event... DomainEvents> struct projection {
+  virtual ~projection() = default;
+
+  virtual void project(std::span<event_run<DomainEvents...>> runs) = 0;
+};
+
+namespace projection_runner_details_ {
+inline constexpr std::chrono::milliseconds poll_interval{100};
+
+// Consumes one assigned partition from its own queue, projecting the records
+// in batches and committing their offsets after each one.
+template <concepts::domain_event... DomainEvents> struct partition_worker {
+  using id_type = std::remove_cvref_t<id_t<DomainEvents...>>;
+  using version_type = version_t<DomainEvents...>;
+  using timestamp_type = timestamp_t<DomainEvents...>;
+
+  partition_worker(RdKafka::KafkaConsumer &consumer,
+                   std::int32_t const partition,
+                   std::unique_ptr<RdKafka::Queue> queue,
+                   event_log_config const &config,
+                   projection_config const &options,
+                   event_dispatcher<DomainEvents...> const &event_dispatcher,
+                   projection<DomainEvents...> &target)
+      : consumer_{consumer}, partition_{partition}, queue_{std::move(queue)},
+        config_{config}, options_{options},
+        event_dispatcher_{event_dispatcher}, projection_{target},
+        thread_{[this]() { work(); }} {}
+
+  partition_worker(partition_worker const &) = delete;
+  partition_worker &operator=(partition_worker const &) = delete;
+
+  ~partition_worker() { stop(); }
+
+  // Waits for the batch in flight to be projected and committed.
+  void stop() noexcept {
+    stopping_.store(true, std::memory_order_release);
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  void rethrow_if_failed() const {
+    if (failed_.load(std::memory_order_acquire)) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+private:
+  bool stopping() const noexcept {
+    return stopping_.load(std::memory_order_acquire);
+  }
+
+  void work() noexcept {
+    try {
+      while (not stopping()) {
+        std::vector<std::unique_ptr<RdKafka::Message>> const records =
+            collect();
+        if (not std::empty(records)) {
+          project(records);
+          commit(records.back()->offset() + 1);
+        }
+      }
+    } catch (...) {
+      error_ = std::current_exception();
+      failed_.store(true, std::memory_order_release);
+    }
+  }
+
+  std::vector<std::unique_ptr<RdKafka::Message>> collect() {
+    std::vector<std::unique_ptr<RdKafka::Message>> result;
+    result.reserve(options_.max_batch_size());
+    auto const deadline =
+        std::chrono::steady_clock::now() + options_.max_batch_wait();
+    while (std::size(result) < options_.max_batch_size() && not stopping()) {
+      auto const remaining =
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              deadline - std::chrono::steady_clock::now());
+      if (remaining <= std::chrono::milliseconds::zero()) {
+        break;
+      }
+      std::unique_ptr<RdKafka::Message> message{queue_->consume(
+          static_cast<int>(std::min(remaining, poll_interval).count()))};
+      if (nullptr == message) {
+        continue;
+      }
+      switch (message->err()) {
+      case RdKafka::ERR_NO_ERROR:
+        result.push_back(std::move(message));
+        break;
+
+      case RdKafka::ERR__TIMED_OUT:
+      case RdKafka::ERR__PARTITION_EOF:
+        break;
+
+      default:
+        throw projection_error{message->err(), message->errstr()};
+      }
+    }
+    return result;
+  }
+
+  // Groups the records into runs per aggregate, in order of each aggregate's
+  // first record. Records without a key were not written by an event stream
+  // and are skipped.
+  void project(std::span<std::unique_ptr<RdKafka::Message> const> records) {
+    using namespace event_source_details_;
+
+    std::vector<event_run<DomainEvents...>> runs;
+    std::unordered_map<std::string, std::size_t> run_of_key;
+    for (std::unique_ptr<RdKafka::Message> const &message : records) {
+      std::string const *const key = message->key();
+      if (nullptr == key) {
+        continue;
+      }
+      auto const [position, inserted] =
+          run_of_key.try_emplace(*key, std::size(runs));
+      if (inserted) {
+        runs.push_back({id_from_message_key<id_type>(*key), {}});
+      }
+      event_run<DomainEvents...> &run = runs[position->second];
+      auto const headers =
+          read_record_headers<version_type, timestamp_type>(*message, config_);
+      run.events.push_back(event_dispatcher_.decode(
+          headers.type, payload(*message),
+          {run.id, headers.version, headers.timestamp}));
+    }
+    if (not std::empty(runs)) {
+      projection_.project(runs);
+    }
+  }
+
+  void commit(std::int64_t const next_offset) {
+    event_source_details_::topic_partitions offsets;
+    offsets.partitions.push_back(RdKafka::TopicPartition::create(
+        config_.topic_name(), partition_, next_offset));
+    if (RdKafka::ErrorCode const error =
+            consumer_.commitSync(offsets.partitions);
+        RdKafka::ERR_NO_ERROR != error) {
+      throw projection_error{error, "Failed to commit offset " +
+                                        std::to_string(next_offset) +
+                                        " of partition " +
+                                        std::to_string(partition_)};
+    }
+  }
+
+  RdKafka::KafkaConsumer &consumer_;
+  std::int32_t partition_;
+  std::unique_ptr<RdKafka::Queue> queue_;
+  event_log_config const &config_;
+  projection_config const &options_;
+  event_dispatcher<DomainEvents...> const &event_dispatcher_;
+  projection<DomainEvents...> &projection_;
+  std::atomic<bool> stopping_ = false;
+  std::atomic<bool> failed_ = false;
+  std::exception_ptr error_;
+  std::thread thread_;
+};
+} // namespace projection_runner_details_
+
+// Feeds the event log to a projection as a member of a consumer group, with a
+// worker per assigned partition. Workers of revoked partitions finish and
+// commit the batch they are on before the partitions are handed over.
+template <concepts::domain_event... DomainEvents> struct projection_runner {
+  projection_runner(event_log_config const &config,
+                    projection_config const &options,
+                    event_dispatcher<DomainEvents...> const &event_dispatcher,
+                    projection<DomainEvents...> &target)
+      : config_{config}, options_{options},
+        event_dispatcher_{event_dispatcher}, projection_{target},
+        rebalance_{*this} {
+    std::unique_ptr<RdKafka::Conf> const configuration =
+        make_configuration(config);
+    set_property(*configuration, "group.id", options.group_id());
+    set_property(*configuration, "enable.auto.commit", std::string{"false"});
+    set_property(*configuration, "enable.auto.offset.store",
+                 std::string{"false"});
+    set_property(*configuration, "auto.offset.reset", std::string{"earliest"});
+    set_property(*configuration, "isolation.level",
+                 std::string{"read_committed"});
+    apply_properties(*configuration, config);
+    for (auto const &[name, value] : options.properties()) {
+      set_property(*configuration, name, value);
+    }
+    set_property(*configuration, "rebalance_cb",
+                 static_cast<RdKafka::RebalanceCb *>(&rebalance_));
+
+    std::string error_message;
+    consumer_.reset(
+        RdKafka::KafkaConsumer::create(configuration.get(), error_message));
+    if (nullptr == consumer_) {
+      throw std::runtime_error{error_message};
+    }
+  }
+
+  projection_runner(projection_runner const &) = delete;
+  projection_runner &operator=(projection_runner const &) = delete;
+
+  ~projection_runner() {
+    workers_.clear();
+    consumer_->close();
+  }
+
+  // Runs the projection until stop is called, or rethrows the error of the
+  // first worker to fail. Rebalances are served on the calling thread.
+  void run() {
+    throw_if_failed(consumer_->subscribe({config_.topic_name()}));
+    try {
+      while (not stopping_.load(std::memory_order_acquire)) {
+        std::unique_ptr<RdKafka::Message> const message{
+            consumer_->consume(static_cast<int>(
+                projection_runner_details_::poll_interval.count()))};
+        if (nullptr != message && RdKafka::ERR__FATAL == message->err()) {
+          throw projection_error{message->err(), message->errstr()};
+        }
+        if (rebalance_error_) {
+          std::rethrow_exception(rebalance_error_);
+        }
+        for (auto const &[partition, worker] : workers_) {
+          worker->rethrow_if_failed();
+        }
+      }
+    } catch (...) {
+      workers_.clear();
+      throw;
+    }
+    workers_.clear();
+  }
+
+  // May be called from any thread.
+  void stop() noexcept { stopping_.store(true, std::memory_order_release); }
+
+private:
+  using worker_type =
+      projection_runner_details_::partition_worker<DomainEvents...>;
+
+  struct rebalance final : RdKafka::RebalanceCb {
+    explicit rebalance(projection_runner &runner) noexcept : runner{runner} {}
+
+    void rebalance_cb(RdKafka::KafkaConsumer *,
+                      RdKafka::ErrorCode const error,
+                      std::vector<RdKafka::TopicPartition *> &partitions)
+        override {
+      try {
+        if (RdKafka::ERR__ASSIGN_PARTITIONS == error) {
+          runner.assign(partitions);
+        } else {
+          runner.revoke(partitions);
+        }
+      } catch (...) {
+        runner.rebalance_error_ = std::current_exception();
+      }
+    }
+
+    projection_runner &runner;
+  };
+
+  // Partition queues are detached from the consumer before the partitions are
+  // assigned, so that no record reaches the consumer's own queue.
+  void assign(std::vector<RdKafka::TopicPartition *> const &partitions) {
+    std::vector<std::pair<std::int32_t, std::unique_ptr<RdKafka::Queue>>>
+        queues;
+    for (RdKafka::TopicPartition const *const partition : partitions) {
+      std::unique_ptr<RdKafka::Queue> queue{
+          consumer_->get_partition_queue(partition)};
+      if (nullptr == queue) {
+        throw projection_failed{"No queue for partition " +
+                                std::to_string(partition->partition())};
+      }
+      throw_if_failed(queue->forward(nullptr));
+      queues.emplace_back(partition->partition(), std::move(queue));
+    }
+    throw_if_failed(consumer_->assign(partitions));
+    for (auto &[partition, queue] : queues) {
+      workers_.insert_or_assign(
+          partition, std::make_unique<worker_type>(
+                         *consumer_, partition, std::move(queue), config_,
+                         options_, event_dispatcher_, projection_));
+    }
+  }
+
+  void revoke(std::vector<RdKafka::TopicPartition *> const &partitions) {
+    for (RdKafka::TopicPartition const *const partition : partitions) {
+      workers_.erase(partition->partition());
+    }
+    throw_if_failed(consumer_->unassign());
+  }
+
+  void throw_if_failed(RdKafka::ErrorCode const error) const {
+    if (RdKafka::ERR_NO_ERROR != error) {
+      throw projection_error{error, "Failed to consume " +
+                                        config_.topic_name()};
+    }
+  }
+
+  event_log_config const &config_;
+  projection_config const &options_;
+  event_dispatcher<DomainEvents...> const &event_dispatcher_;
+  projection<DomainEvents...> &projection_;
+  rebalance rebalance_;
+  std::atomic<bool> stopping_ = false;
+  std::exception_ptr rebalance_error_;
+  std::unique_ptr<RdKafka::KafkaConsumer> consumer_;
+  std::map<std::int32_t, std::unique_ptr<worker_type>> workers_;
+};
+
+} // namespace skizzay::cddd::kafka
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "skizzay/cddd/timestamp.h"
+
+#include <librdkafka/rdkafkacpp.h>
+
+#include <charconv>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace skizzay::cddd::kafka {
+
+// A single event on its way to the topic. The headers are handed over to
+// librdkafka once the record has been produced. The payload is not copied by
+// librdkafka, so whatever owns its memory is kept alive until delivery.
+struct record {
+  std::shared_ptr<void> payload_owner;
+  std::pmr::vector<std::byte> payload;
+  std::unique_ptr<RdKafka::Headers> headers{RdKafka::Headers::create()};
+  std::int64_t timestamp_in_ms = 0;
+};
+
+// Frees the payload before letting go of whatever owns its memory.
+inline void release_payload(record &r) noexcept {
+  {
+    std::pmr::vector<std::byte> const payload = std::move(r.payload);
+  }
+  r.payload_owner.reset();
+}
+
+// Where a record was written, as reported on delivery.
+struct record_location {
+  std::int32_t partition = RdKafka::Topic::PARTITION_UA;
+  std::int64_t offset = -1;
+};
+
+inline std::string message_key(std::string_view const id) {
+  return std::string{id};
+}
+
+inline std::string message_key(std::integral auto const id) {
+  return std::to_string(id);
+}
+
+template <typename Id>
+requires requires(Id const &id) {
+  { to_string(id) } -> std::convertible_to<std::string>;
+}
+inline std::string message_key(Id const &id) { return to_string(id); }
+
+// The reverse of message_key, for consumers that only have the record to go
+// by.
+template <typename Id>
+requires std::constructible_from<Id, std::string const &>
+inline Id id_from_message_key(std::string const &key) { return Id(key); }
+
+template <std::integral Id>
+inline Id id_from_message_key(std::string const &key) {
+  Id result = 0;
+  auto const parse_result =
+      std::from_chars(key.data(), key.data() + std::size(key), result);
+  if (std::errc{} != parse_result.ec ||
+      key.data() + std::size(key) != parse_result.ptr) {
+    throw std::invalid_argument{"Message key '" + key +
+                                "' is not an aggregate id"};
+  }
+  return result;
+}
+
+inline std::string header_value(std::unsigned_integral auto const value) {
+  return std::to_string(value);
+}
+
+inline std::string header_value(concepts::timestamp auto const timestamp) {
+  return std::to_string(timestamp.time_since_epoch().count());
+}
+
+inline std::int64_t
+timestamp_in_ms(concepts::timestamp auto const timestamp) noexcept {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             timestamp.time_since_epoch())
+      .count();
+}
+
+} // namespace skizzay::cddd::kafka
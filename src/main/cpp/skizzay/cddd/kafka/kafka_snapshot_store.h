@@ -0,0 +1,175 @@
+#pragma once
+
+#include "skizzay/cddd/history_load_failed.h"
+#include "skizzay/cddd/identifier.h"
+#include "skizzay/cddd/kafka/kafka_deser.h"
+#include "skizzay/cddd/kafka/kafka_event_log_config.h"
+#include "skizzay/cddd/kafka/kafka_event_source.h"
+#include "skizzay/cddd/kafka/kafka_producer.h"
+#include "skizzay/cddd/kafka/kafka_record.h"
+#include "skizzay/cddd/version.h"
+
+#include <librdkafka/rdkafkacpp.h>
+
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace skizzay::cddd::kafka {
+namespace snapshot_store_details_ {
+
+// Where the latest known snapshot of an aggregate was written.
+struct snapshot_location {
+  std::int32_t partition;
+  std::int64_t offset;
+  std::uint64_t version;
+};
+
+// Publishes snapshots to the event log's snapshot topic and keeps the
+// location of the latest one per aggregate in memory, so that loading a
+// snapshot reads a single record. Snapshots published by other processes are
+// only known once the store has caught up.
+template <typename Aggregate>
+requires concepts::versioned<Aggregate> && concepts::identifiable<Aggregate>
+struct impl {
+  using version_type = version_t<Aggregate>;
+
+  // Snapshots are not part of any transaction, so they are published through
+  // a producer of their own.
+  explicit impl(snapshot_serializer<Aggregate> const &serializer,
+                event_log_config const &config)
+      : serializer_{serializer}, config_{config},
+        producer_{config.with_transactional_id(std::nullopt)},
+        reader_{config} {}
+
+  // Throws commit_error if the snapshot could not be published.
+  void save_snapshot(Aggregate const &aggregate) {
+    using skizzay::cddd::id;
+    using skizzay::cddd::version;
+
+    version_type const snapshot_version = version(aggregate);
+    if (0 == snapshot_version) {
+      return;
+    }
+    std::string const key = message_key(id(aggregate));
+    std::vector<record> records(1);
+    records.front().payload =
+        serializer_.serialize(aggregate, std::pmr::get_default_resource());
+    records.front().headers->add(config_.version_header_name(),
+                                 header_value(snapshot_version));
+    std::vector<record_location> const locations =
+        producer_.produce(config_.snapshot_topic_name(), key, records);
+    remember(key, {locations.front().partition, locations.front().offset,
+                   snapshot_version});
+  }
+
+  // Reads the snapshot topic from where the last catch up left off. Needed on
+  // start up, and whenever another process may have published snapshots.
+  void catch_up() {
+    reader_.scan(
+        config_.snapshot_topic_name(),
+        [this](std::int32_t const partition) -> std::optional<std::int64_t> {
+          std::lock_guard l_{m_};
+          if (auto const checkpoint = checkpoints_.find(partition);
+              std::end(checkpoints_) != checkpoint) {
+            return checkpoint->second;
+          }
+          return std::nullopt;
+        },
+        [this](RdKafka::Message &message) {
+          std::string const *const key = message.key();
+          std::optional<std::uint64_t> const snapshot_version =
+              event_source_details_::header_integer<std::uint64_t>(
+                  message, config_.version_header_name());
+          if (nullptr != key && snapshot_version.value_or(0) > 0) {
+            remember(*key, {message.partition(), message.offset(),
+                            *snapshot_version});
+          }
+          std::lock_guard l_{m_};
+          checkpoints_.insert_or_assign(message.partition(),
+                                        message.offset() + 1);
+        });
+  }
+
+  void load_from_snapshot(Aggregate &aggregate,
+                          version_type const target_version) {
+    apply_snapshot(aggregate, target_version);
+  }
+
+  // Returns the version of the applied snapshot, or nothing when there was no
+  // usable snapshot newer than the aggregate. Only the latest snapshot of an
+  // aggregate is kept, so one taken past the target version cannot be used,
+  // nor can one compacted away after another process published a newer one.
+  std::optional<version_type>
+  apply_snapshot(Aggregate &aggregate, version_type const target_version) {
+    using skizzay::cddd::id;
+    using skizzay::cddd::version;
+
+    std::string const key = message_key(id(aggregate));
+    std::optional<snapshot_location> const location = find(key);
+    if (not location.has_value() || target_version < location->version ||
+        location->version <= version(aggregate)) {
+      return std::nullopt;
+    }
+    try {
+      reader_.read(config_.snapshot_topic_name(), location->partition,
+                   std::span{&location->offset, 1},
+                   [&aggregate, this](RdKafka::Message &message) {
+                     serializer_.deserialize(
+                         event_source_details_::payload(message), aggregate);
+                   });
+    } catch (history_load_error const &) {
+      throw;
+    } catch (history_load_failed const &) {
+      forget(key, *location);
+      return std::nullopt;
+    }
+    return static_cast<version_type>(location->version);
+  }
+
+private:
+  std::optional<snapshot_location> find(std::string const &key) const {
+    std::lock_guard l_{m_};
+    if (auto const location = locations_.find(key);
+        std::end(locations_) != location) {
+      return location->second;
+    }
+    return std::nullopt;
+  }
+
+  void remember(std::string const &key, snapshot_location const location) {
+    std::lock_guard l_{m_};
+    auto const [known, inserted] = locations_.try_emplace(key, location);
+    if (not inserted && known->second.version <= location.version) {
+      known->second = location;
+    }
+  }
+
+  void forget(std::string const &key, snapshot_location const location) {
+    std::lock_guard l_{m_};
+    if (auto const known = locations_.find(key);
+        std::end(locations_) != known &&
+        known->second.offset == location.offset) {
+      locations_.erase(known);
+    }
+  }
+
+  snapshot_serializer<Aggregate> const &serializer_;
+  event_log_config const &config_;
+  kafka::producer producer_;
+  kafka::reader reader_;
+  mutable std::mutex m_;
+  std::unordered_map<std::string, snapshot_location> locations_;
+  std::map<std::int32_t, std::int64_t> checkpoints_;
+};
+} // namespace snapshot_store_details_
+
+template <typename Aggregate>
+using snapshot_store = snapshot_store_details_::impl<Aggregate>;
+} // namespace skizzay::cddd::kafka
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "skizzay/cddd/optimistic_concurrency_collision.h"
+
+#include <algorithm>
+#include <concepts>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <utility>
+
+namespace skizzay::cddd::kafka {
+namespace event_store_details_ {
+
+// Kafka has no conditional writes, so the committed version of each stream is
+// tracked by the store. The lock is held for the whole commit, which keeps the
+// records of concurrent commits to one aggregate from interleaving on its
+// partition. This assumes the store is the only writer of its aggregates
+// between catch ups, which advance the version past what others have written.
+// Writers racing between catch ups may still write the same versions.
+template <std::unsigned_integral Version> struct stream_version {
+  explicit stream_version(Version const value = 0) noexcept : value_{value} {}
+
+  Version get() const {
+    std::lock_guard l_{m_};
+    return value_;
+  }
+
+  template <std::invocable Commit>
+  void commit(Version const expected_version, Version const num_events,
+              Commit &&commit) {
+    std::lock_guard l_{*this};
+    verify(expected_version);
+    std::invoke(std::forward<Commit>(commit));
+    advance(expected_version, num_events);
+  }
+
+  // An asynchronous commit claims the stream while its records are in flight,
+  // so that no other commit is verified against the version it is about to
+  // advance. The claim is released once the records have been reported.
+  void claim(Version const expected_version) {
+    std::lock_guard l_{m_};
+    verify(expected_version);
+    claimed_ = true;
+  }
+
+  void release(Version const expected_version, Version const num_events,
+               bool const committed) noexcept {
+    std::lock_guard l_{m_};
+    if (committed) {
+      advance(expected_version, num_events);
+    }
+    claimed_ = false;
+  }
+
+  // Advances the version to one indexed from the event log, should another
+  // writer have committed past it.
+  void catch_up(Version const indexed_version) noexcept {
+    std::lock_guard l_{m_};
+    value_ = std::max(value_, indexed_version);
+  }
+
+  // A transaction holds the lock of every stream it writes to while it is
+  // published, checking and advancing each version under that lock.
+  void lock() { m_.lock(); }
+  void unlock() noexcept { m_.unlock(); }
+
+  void verify(Version const expected_version) const {
+    if (claimed_) {
+      std::ostringstream message;
+      message << "Saving events, expected version " << expected_version
+              << ", but a commit after " << value_ << " is in flight";
+      throw optimistic_concurrency_collision{message.str(), expected_version};
+    } else if (expected_version != value_) {
+      std::ostringstream message;
+      message << "Saving events, expected version " << expected_version
+              << ", but found " << value_;
+      throw optimistic_concurrency_collision{message.str(), expected_version};
+    }
+  }
+
+  void advance(Version const expected_version,
+               Version const num_events) noexcept {
+    value_ = std::max<Version>(value_, expected_version + num_events);
+  }
+
+private:
+  mutable std::mutex m_;
+  Version value_;
+  bool claimed_ = false;
+};
+} // namespace event_store_details_
+} // namespace skizzay::cddd::kafka
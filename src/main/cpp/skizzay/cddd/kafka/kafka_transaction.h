@@ -0,0 +1,290 @@
+#pragma once
+
+#include "skizzay/cddd/kafka/kafka_event_log_config.h"
+#include "skizzay/cddd/kafka/kafka_offset_index.h"
+#include "skizzay/cddd/kafka/kafka_producer.h"
+#include "skizzay/cddd/kafka/kafka_record.h"
+#include "skizzay/cddd/kafka/kafka_stream_version.h"
+#include "skizzay/cddd/narrow_cast.h"
+#include "skizzay/cddd/optimistic_concurrency_collision.h"
+
+#include <algorithm>
+#include <concepts>
+#include <condition_variable>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace skizzay::cddd::kafka {
+namespace event_store_details_ {
+
+template <std::unsigned_integral Version>
+void record_locations(offset_index &index, std::string const &key,
+                      Version event_version,
+                      std::span<record_location const> const locations) {
+  for (auto const &location : locations) {
+    index.record(key, location.partition, ++event_version, location.offset);
+  }
+}
+
+// Indexes records already committed. Failing to do so cannot undo the commit,
+// so the index is marked stale instead, to be caught up before it is next read.
+template <std::unsigned_integral Version>
+void index_committed(offset_index &index, std::string const &key,
+                     Version const expected_version,
+                     std::span<record_location const> const locations) noexcept {
+  try {
+    record_locations(index, key, expected_version, locations);
+    index.flush();
+  } catch (...) {
+    index.mark_stale();
+  }
+}
+
+// The events one stream has committed within a transaction.
+template <std::unsigned_integral Version> struct staged_write {
+  std::string key;
+  std::shared_ptr<stream_version<Version>> version;
+  Version expected_version;
+  std::vector<record> records;
+};
+
+// Publishes transactions through a transactional producer. Concurrent commits
+// are grouped: the first committing thread leads, publishing every commit
+// waiting at that time in one Kafka transaction, while the others wait for
+// its outcome. Commits that collide with the stream versions they expected
+// fail on their own without affecting the rest of the group.
+template <std::unsigned_integral Version> struct transaction_coordinator {
+  explicit transaction_coordinator(event_log_config const &config,
+                                   kafka::producer &producer,
+                                   offset_index &index) noexcept
+      : config_{config}, producer_{producer}, index_{index} {}
+
+  void commit(std::vector<staged_write<Version>> &writes) {
+    pending p{writes};
+    std::unique_lock l_{m_};
+    queue_.push_back(&p);
+    for (;;) {
+      cv_.wait(l_, [&p, this]() { return p.done || not leading_; });
+      if (p.done) {
+        break;
+      }
+      lead(l_);
+    }
+    if (p.error) {
+      std::rethrow_exception(p.error);
+    }
+  }
+
+private:
+  struct pending {
+    std::vector<staged_write<Version>> &writes;
+    std::exception_ptr error = nullptr;
+    bool deferred = false;
+    bool done = false;
+  };
+
+  void lead(std::unique_lock<std::mutex> &l_) {
+    leading_ = true;
+    std::vector<pending *> const group = std::exchange(queue_, {});
+    l_.unlock();
+    publish(group);
+    l_.lock();
+    // Deferred commits go back to the front of the queue, to be published by
+    // the next group.
+    std::vector<pending *> deferred;
+    for (pending *const p : group) {
+      if (p->deferred) {
+        p->deferred = false;
+        deferred.push_back(p);
+      } else {
+        p->done = true;
+      }
+    }
+    queue_.insert(std::begin(queue_), std::begin(deferred), std::end(deferred));
+    leading_ = false;
+    cv_.notify_all();
+  }
+
+  // Locks the streams of each commit in the group and checks their versions,
+  // then publishes whatever passed in one Kafka transaction. A commit that
+  // writes to a stream already locked by an earlier commit of the group is
+  // deferred to the next group.
+  void publish(std::span<pending *const> const group) noexcept {
+    std::vector<stream_version<Version> *> locked;
+    std::vector<pending *> accepted;
+    for (pending *const p : group) {
+      if (std::ranges::any_of(p->writes, [&locked](auto const &write) {
+            return std::ranges::find(locked, write.version.get()) !=
+                   std::end(locked);
+          })) {
+        p->deferred = true;
+        continue;
+      }
+      std::size_t const first_locked = std::size(locked);
+      for (staged_write<Version> &write : p->writes) {
+        write.version->lock();
+        locked.push_back(write.version.get());
+      }
+      try {
+        for (staged_write<Version> const &write : p->writes) {
+          write.version->verify(write.expected_version);
+        }
+        accepted.push_back(p);
+      } catch (...) {
+        p->error = std::current_exception();
+        for (std::size_t i = first_locked; i != std::size(locked); ++i) {
+          locked[i]->unlock();
+        }
+        locked.resize(first_locked);
+      }
+    }
+
+    if (not std::empty(accepted)) {
+      try {
+        publish_accepted(accepted);
+      } catch (...) {
+        for (pending *const p : accepted) {
+          p->error = std::current_exception();
+        }
+      }
+    }
+    for (stream_version<Version> *const version : locked) {
+      version->unlock();
+    }
+  }
+
+  void publish_accepted(std::span<pending *const> const accepted) {
+    std::size_t num_records = 0;
+    for (pending const *const p : accepted) {
+      for (staged_write<Version> const &write : p->writes) {
+        num_records += std::size(write.records);
+      }
+    }
+
+    producer_.begin_transaction();
+    producer_details_::delivery_batch batch{num_records};
+    std::size_t remaining = num_records;
+    bool sending = true;
+    for (pending *const p : accepted) {
+      for (staged_write<Version> &write : p->writes) {
+        if (not sending) {
+          continue;
+        }
+        remaining -= std::size(write.records);
+        if (not producer_.send(config_.topic_name(), write.key, write.records,
+                               batch)) {
+          batch.abandon(remaining);
+          sending = false;
+        }
+      }
+    }
+    producer_.wait_for(batch);
+    std::vector<record_location> locations;
+    try {
+      locations = batch.take_locations();
+    } catch (...) {
+      producer_.abort_transaction();
+      throw;
+    }
+    producer_.commit_transaction();
+
+    // The records are durable from here on, so the streams advance whatever
+    // becomes of the index.
+    for (pending *const p : accepted) {
+      for (staged_write<Version> &write : p->writes) {
+        write.version->advance(
+            write.expected_version,
+            narrow_cast<Version>(std::size(write.records)));
+      }
+    }
+    try {
+      auto next = std::begin(locations);
+      for (pending *const p : accepted) {
+        for (staged_write<Version> const &write : p->writes) {
+          std::size_t const num_events = std::size(write.records);
+          record_locations(index_, write.key, write.expected_version,
+                           std::span{next, num_events});
+          next += narrow_cast<std::ptrdiff_t>(num_events);
+        }
+      }
+      index_.flush();
+    } catch (...) {
+      index_.mark_stale();
+    }
+  }
+
+  event_log_config const &config_;
+  kafka::producer &producer_;
+  offset_index &index_;
+  std::mutex m_;
+  std::condition_variable cv_;
+  std::vector<pending *> queue_;
+  bool leading_ = false;
+};
+
+// Events committed to the streams enlisted in a transaction are only staged.
+// They are published together, atomically, when the transaction commits, and
+// are discarded if any of the streams has moved past the version its commit
+// expected.
+template <std::unsigned_integral Version> struct transaction {
+  explicit transaction(transaction_coordinator<Version> &coordinator) noexcept
+      : coordinator_{coordinator} {}
+
+  transaction(transaction &&) = default;
+  transaction(transaction const &) = delete;
+  transaction &operator=(transaction const &) = delete;
+
+  // The records are moved out of the given span.
+  void stage(std::string const &key,
+             std::shared_ptr<stream_version<Version>> version,
+             Version const expected_version, std::span<record> const records) {
+    auto const staged =
+        std::ranges::find(writes_, version, &staged_write<Version>::version);
+    if (std::end(writes_) == staged) {
+      writes_.push_back(staged_write<Version>{
+          key, std::move(version), expected_version,
+          std::vector<record>(std::make_move_iterator(std::begin(records)),
+                              std::make_move_iterator(std::end(records)))});
+      return;
+    }
+
+    Version const staged_version =
+        staged->expected_version +
+        narrow_cast<Version>(std::size(staged->records));
+    if (expected_version != staged_version) {
+      std::ostringstream message;
+      message << "Staging events, expected version " << expected_version
+              << ", but found " << staged_version;
+      throw optimistic_concurrency_collision{message.str(), expected_version};
+    }
+    staged->records.insert(std::end(staged->records),
+                           std::make_move_iterator(std::begin(records)),
+                           std::make_move_iterator(std::end(records)));
+  }
+
+  void commit() {
+    std::vector<staged_write<Version>> writes = std::exchange(writes_, {});
+    if (not std::empty(writes)) {
+      coordinator_.commit(writes);
+    }
+  }
+
+  void rollback() noexcept { writes_.clear(); }
+
+private:
+  transaction_coordinator<Version> &coordinator_;
+  std::vector<staged_write<Version>> writes_;
+};
+} // namespace event_store_details_
+
+template <std::unsigned_integral Version>
+using transaction = event_store_details_::transaction<Version>;
+
+} // namespace skizzay::cddd::kafka
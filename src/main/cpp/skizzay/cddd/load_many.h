@@ -0,0 +1,249 @@
+#pragma once
+
+#include "skizzay/cddd/event_sourced.h"
+#include "skizzay/cddd/event_store.h"
+#include "skizzay/cddd/executor.h"
+#include "skizzay/cddd/identifier.h"
+#include "skizzay/cddd/version.h"
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace skizzay::cddd {
+namespace load_many_details_ {
+
+template <typename Store, typename Aggregate, typename Executor,
+          typename Loaded>
+struct loading
+    : std::enable_shared_from_this<loading<Store, Aggregate, Executor,
+                                           Loaded>> {
+  using id_type = std::remove_cvref_t<id_t<Aggregate>>;
+  using version_type = version_t<Aggregate>;
+
+  loading(Store &store, Executor &executor, std::vector<id_type> ids,
+          std::vector<version_type> target_versions, Loaded loaded)
+      : store{store}, executor{executor}, ids{std::move(ids)},
+        target_versions{std::move(target_versions)},
+        loaded{std::move(loaded)} {}
+
+  // Starts the next load not yet started, if any. Loads completed while being
+  // started are followed by the next one in this loop rather than from within
+  // their completion, so that an inline executor or an event source loading
+  // synchronously does not recurse once per id.
+  void start_next() {
+    for (;;) {
+      std::size_t i;
+      {
+        std::lock_guard l_{m};
+        if (std::size(ids) == next) {
+          return;
+        }
+        i = next++;
+      }
+      // Whichever of the start returning and the load completing comes second
+      // moves on to the next load.
+      auto const starting = std::make_shared<std::atomic<bool>>(true);
+      start(i, starting);
+      if (starting->exchange(false)) {
+        return;
+      }
+    }
+  }
+
+  void start(std::size_t const i,
+             std::shared_ptr<std::atomic<bool>> const &starting) {
+    using event_source_type =
+        decltype(get_event_source(store, std::declval<id_type const &>()));
+    struct slot {
+      event_source_type event_source;
+      Aggregate aggregate;
+    };
+
+    auto const hydrating = std::make_shared<slot>(
+        slot{get_event_source(store, ids[i]), Aggregate{ids[i]}});
+    auto finished = [self = this->shared_from_this(), hydrating, i,
+                     starting](std::exception_ptr const error) {
+      {
+        std::lock_guard l_{self->loaded_m};
+        self->loaded(i, std::move(hydrating->aggregate), error);
+      }
+      if (not starting->exchange(false)) {
+        self->start_next();
+      }
+    };
+    if constexpr (cpo_details_::has_load_from_history_async<event_source_type,
+                                                         Aggregate>) {
+      try {
+        hydrating->event_source.load_from_history_async(
+            hydrating->aggregate, target_versions[i], finished);
+      } catch (...) {
+        finished(std::current_exception());
+      }
+    } else {
+      executor.post([hydrating, finished = std::move(finished),
+                     target_version = target_versions[i]]() {
+        try {
+          load_from_history(hydrating->event_source, hydrating->aggregate,
+                            target_version);
+        } catch (...) {
+          finished(std::current_exception());
+          return;
+        }
+        finished(nullptr);
+      });
+    }
+  }
+
+  Store &store;
+  Executor &executor;
+  std::vector<id_type> const ids;
+  std::vector<version_type> const target_versions;
+  Loaded loaded;
+  std::mutex m;
+  std::size_t next = 0;
+  std::mutex loaded_m;
+};
+
+template <typename Aggregate, std::ranges::input_range Ids>
+std::vector<std::remove_cvref_t<id_t<Aggregate>>> to_ids(Ids &&ids) {
+  std::vector<std::remove_cvref_t<id_t<Aggregate>>> result;
+  std::ranges::copy(ids, std::back_inserter(result));
+  return result;
+}
+} // namespace load_many_details_
+
+// Hydrates the aggregates with the ids, each up to the target version at the
+// same position, with at most max_in_flight of them loading at any time.
+// Event sources that load asynchronously do so themselves; the others are
+// loaded on the executor. As each aggregate is loaded, loaded is invoked with
+// its position in ids, the aggregate and what the load threw, if anything, in
+// which case the aggregate is only partly hydrated. Invocations are made one
+// at a time, in the order the loads complete, on whichever thread completed
+// them, and must not throw. The store must outlive the loads.
+template <typename Aggregate, concepts::event_store Store,
+          concepts::executor Executor, std::ranges::input_range Ids,
+          std::ranges::input_range TargetVersions,
+          std::invocable<std::size_t, Aggregate &&, std::exception_ptr> Loaded>
+requires concepts::versioned<Aggregate> &&
+    std::constructible_from<Aggregate, std::remove_cvref_t<id_t<Aggregate>>>
+void load_many(Store &store, Executor &executor, Ids &&ids,
+               TargetVersions &&target_versions,
+               std::size_t const max_in_flight, Loaded loaded) {
+  auto id_values = load_many_details_::to_ids<Aggregate>(ids);
+  std::vector<version_t<Aggregate>> version_values;
+  std::ranges::copy(target_versions, std::back_inserter(version_values));
+  if (std::size(id_values) != std::size(version_values)) {
+    throw std::invalid_argument{
+        "Each aggregate to load needs exactly one target version"};
+  }
+
+  auto const state = std::make_shared<load_many_details_::loading<
+      Store, Aggregate, Executor, Loaded>>(store, executor,
+                                           std::move(id_values),
+                                           std::move(version_values),
+                                           std::move(loaded));
+  for (std::size_t i = 0;
+       i != std::min(std::max<std::size_t>(1, max_in_flight),
+                     std::size(state->ids));
+       ++i) {
+    state->start_next();
+  }
+}
+
+// Hydrates the aggregates to their latest versions.
+template <typename Aggregate, concepts::event_store Store,
+          concepts::executor Executor, std::ranges::sized_range Ids,
+          std::invocable<std::size_t, Aggregate &&, std::exception_ptr> Loaded>
+void load_many(Store &store, Executor &executor, Ids &&ids,
+               std::size_t const max_in_flight, Loaded loaded) {
+  load_many<Aggregate>(
+      store, executor, ids,
+      std::vector<version_t<Aggregate>>(
+          std::ranges::size(ids),
+          std::numeric_limits<version_t<Aggregate>>::max()),
+      max_in_flight, std::move(loaded));
+}
+
+// The aggregates in the order of their ids, once all of them are loaded. The
+// first failure, by position, is rethrown instead.
+template <typename Aggregate, concepts::event_store Store,
+          concepts::executor Executor, std::ranges::input_range Ids,
+          std::ranges::input_range TargetVersions>
+std::future<std::vector<Aggregate>>
+load_many(Store &store, Executor &executor, Ids &&ids,
+          TargetVersions &&target_versions, std::size_t const max_in_flight) {
+  struct collected {
+    explicit collected(std::size_t const n) : remaining{n}, results(n) {}
+
+    std::promise<std::vector<Aggregate>> promise;
+    std::size_t remaining;
+    std::vector<std::optional<Aggregate>> results;
+    std::vector<std::exception_ptr> errors = std::vector<std::exception_ptr>(
+        std::size(results));
+
+    void complete() {
+      auto const failed = std::ranges::find_if(
+          errors, [](std::exception_ptr const &e) { return nullptr != e; });
+      if (std::end(errors) != failed) {
+        promise.set_exception(*failed);
+        return;
+      }
+      std::vector<Aggregate> aggregates;
+      aggregates.reserve(std::size(results));
+      for (std::optional<Aggregate> &result : results) {
+        aggregates.push_back(std::move(*result));
+      }
+      promise.set_value(std::move(aggregates));
+    }
+  };
+
+  auto id_values = load_many_details_::to_ids<Aggregate>(ids);
+  auto const state = std::make_shared<collected>(std::size(id_values));
+  std::future<std::vector<Aggregate>> result = state->promise.get_future();
+  if (std::empty(id_values)) {
+    state->complete();
+    return result;
+  }
+  // Invocations of the callback are serialized, so the state needs no lock.
+  load_many<Aggregate>(
+      store, executor, std::move(id_values), target_versions, max_in_flight,
+      [state](std::size_t const i, Aggregate &&aggregate,
+              std::exception_ptr const error) {
+        state->results[i].emplace(std::move(aggregate));
+        state->errors[i] = error;
+        if (0 == --state->remaining) {
+          state->complete();
+        }
+      });
+  return result;
+}
+
+template <typename Aggregate, concepts::event_store Store,
+          concepts::executor Executor, std::ranges::sized_range Ids>
+std::future<std::vector<Aggregate>> load_many(Store &store,
+                                              Executor &executor, Ids &&ids,
+                                              std::size_t const max_in_flight) {
+  return load_many<Aggregate>(
+      store, executor, ids,
+      std::vector<version_t<Aggregate>>(
+          std::ranges::size(ids),
+          std::numeric_limits<version_t<Aggregate>>::max()),
+      max_in_flight);
+}
+
+} // namespace skizzay::cddd
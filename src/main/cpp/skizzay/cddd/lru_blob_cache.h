@@ -0,0 +1,73 @@
+#pragma once
+
+#include "skizzay/cddd/blob_store.h"
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace skizzay::cddd {
+// Read-through, write-through cache in front of another blob store. Blobs are
+// evicted least recently used first once the cached bytes exceed capacity.
+struct lru_blob_cache final : blob_store {
+  explicit lru_blob_cache(blob_store &backing_store,
+                          std::size_t const capacity_in_bytes) noexcept
+      : backing_store_{backing_store}, capacity_{capacity_in_bytes} {}
+
+  void put_blob(std::string const &key,
+                std::span<std::byte const> const data) override {
+    backing_store_.put_blob(key, data);
+    insert(key, make_blob(data));
+  }
+
+  blob get_blob(std::string const &key) override {
+    {
+      std::lock_guard l_{m_};
+      if (auto const entry = entries_.find(key); std::end(entries_) != entry) {
+        lru_.splice(std::begin(lru_), lru_, entry->second);
+        return entry->second->second;
+      }
+    }
+    blob result = backing_store_.get_blob(key);
+    insert(key, result);
+    return result;
+  }
+
+  std::size_t size_in_bytes() const noexcept {
+    std::lock_guard l_{m_};
+    return size_;
+  }
+
+private:
+  void insert(std::string const &key, blob value) {
+    std::size_t const value_size = std::size(*value);
+    if (value_size > capacity_) {
+      return;
+    }
+    std::lock_guard l_{m_};
+    if (entries_.contains(key)) {
+      return;
+    }
+    lru_.emplace_front(key, std::move(value));
+    entries_.emplace(key, std::begin(lru_));
+    size_ += value_size;
+    while (size_ > capacity_) {
+      auto &[evicted_key, evicted_value] = lru_.back();
+      size_ -= std::size(*evicted_value);
+      entries_.erase(evicted_key);
+      lru_.pop_back();
+    }
+  }
+
+  using entry_list = std::list<std::pair<std::string, blob>>;
+
+  blob_store &backing_store_;
+  std::size_t const capacity_;
+  mutable std::mutex m_;
+  entry_list lru_;
+  std::unordered_map<std::string, entry_list::iterator> entries_;
+  std::size_t size_ = 0;
+};
+} // namespace skizzay::cddd
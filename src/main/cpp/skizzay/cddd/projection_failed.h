@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdexcept>
+
+namespace skizzay::cddd {
+struct projection_failed : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+} // namespace skizzay::cddd
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <random>
+#include <thread>
+
+namespace skizzay::cddd {
+
+// Bounds the attempts made at an operation. Before each retry the caller
+// sleeps for a uniformly random duration of up to base_delay doubled per
+// failed attempt, capped at max_delay, so callers failing together spread out
+// rather than retry in lockstep.
+struct retry_policy {
+  std::size_t max_attempts = 5;
+  std::chrono::microseconds base_delay = std::chrono::milliseconds{1};
+  std::chrono::microseconds max_delay = std::chrono::milliseconds{100};
+};
+
+namespace retry_policy_details_ {
+inline constexpr std::size_t max_doublings = 30;
+
+inline std::mt19937_64 &generator() {
+  thread_local std::mt19937_64 generator{std::random_device{}()};
+  return generator;
+}
+} // namespace retry_policy_details_
+
+// How long to wait before the next attempt once failed_attempts have failed.
+inline std::chrono::microseconds
+backoff_delay(retry_policy const &policy, std::size_t const failed_attempts) {
+  using rep = std::chrono::microseconds::rep;
+  std::size_t const doublings =
+      std::min(std::max(failed_attempts, std::size_t{1}) - 1,
+               retry_policy_details_::max_doublings);
+  rep const ceiling = std::min(policy.max_delay.count(),
+                               policy.base_delay.count() << doublings);
+  if (0 >= ceiling) {
+    return std::chrono::microseconds::zero();
+  }
+  std::uniform_int_distribution<rep> delay{0, ceiling};
+  return std::chrono::microseconds{delay(retry_policy_details_::generator())};
+}
+
+inline void back_off(retry_policy const &policy,
+                     std::size_t const failed_attempts) {
+  std::this_thread::sleep_for(backoff_delay(policy, failed_attempts));
+}
+
+} // namespace skizzay::cddd
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace skizzay::cddd {
+
+// A contiguous sequence that keeps up to N elements inline and only spills to
+// the heap past that. Once spilled, the heap storage is kept by clear, so a
+// buffer refilled after every commit allocates at most once. Heap storage
+// comes from the allocator; inline elements never touch it.
+template <typename T, std::size_t N, typename Allocator = std::allocator<T>>
+requires(0 < N) struct small_vector {
+  using value_type = T;
+  using allocator_type = Allocator;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = T &;
+  using const_reference = T const &;
+  using pointer = T *;
+  using const_pointer = T const *;
+  using iterator = T *;
+  using const_iterator = T const *;
+
+  small_vector() noexcept(noexcept(Allocator())) = default;
+
+  explicit small_vector(Allocator const &allocator) noexcept
+      : allocator_{allocator} {}
+
+  small_vector(small_vector &&other) noexcept(
+      std::is_nothrow_move_constructible_v<T>)
+      : allocator_{std::move(other.allocator_)} {
+    take(other);
+  }
+
+  small_vector(small_vector const &other) requires std::copy_constructible<T>
+      : small_vector{other, alloc_traits::select_on_container_copy_construction(
+                                other.allocator_)} {}
+
+  small_vector(small_vector const &other,
+               Allocator const &allocator) requires std::copy_constructible<T>
+      : allocator_{allocator} {
+    reserve(other.size_);
+    for (T const &element : other) {
+      construct_back(element);
+    }
+  }
+
+  small_vector &operator=(small_vector &&other) noexcept(
+      std::is_nothrow_move_constructible_v<T> &&
+      (alloc_traits::propagate_on_container_move_assignment::value ||
+       alloc_traits::is_always_equal::value)) {
+    if (this != &other) {
+      release();
+      if constexpr (alloc_traits::propagate_on_container_move_assignment::
+                        value) {
+        allocator_ = std::move(other.allocator_);
+      }
+      take(other);
+    }
+    return *this;
+  }
+
+  small_vector &
+  operator=(small_vector const &other) requires std::copy_constructible<T> {
+    if (this != &other) {
+      if constexpr (alloc_traits::propagate_on_container_copy_assignment::
+                        value) {
+        release();
+        allocator_ = other.allocator_;
+      }
+      small_vector copy{other, allocator_};
+      *this = std::move(copy);
+    }
+    return *this;
+  }
+
+  ~small_vector() { release(); }
+
+  allocator_type get_allocator() const noexcept { return allocator_; }
+
+  iterator begin() noexcept { return data_; }
+  const_iterator begin() const noexcept { return data_; }
+  iterator end() noexcept { return data_ + size_; }
+  const_iterator end() const noexcept { return data_ + size_; }
+
+  pointer data() noexcept { return data_; }
+  const_pointer data() const noexcept { return data_; }
+  size_type size() const noexcept { return size_; }
+  size_type capacity() const noexcept { return capacity_; }
+  bool empty() const noexcept { return 0 == size_; }
+
+  // Whether the elements are held in the inline buffer.
+  bool is_inline() const noexcept { return inline_data() == data_; }
+
+  reference operator[](size_type const index) noexcept { return data_[index]; }
+  const_reference operator[](size_type const index) const noexcept {
+    return data_[index];
+  }
+
+  reference front() noexcept { return data_[0]; }
+  const_reference front() const noexcept { return data_[0]; }
+  reference back() noexcept { return data_[size_ - 1]; }
+  const_reference back() const noexcept { return data_[size_ - 1]; }
+
+  template <typename... Args>
+  requires std::constructible_from<T, Args...>
+  reference emplace_back(Args &&...args) {
+    if (size_ == capacity_) {
+      // The arguments may refer to an element, so the value is made before
+      // the elements are moved.
+      T value(std::forward<Args>(args)...);
+      reserve(2 * capacity_);
+      return construct_back(std::move(value));
+    }
+    return construct_back(std::forward<Args>(args)...);
+  }
+
+  void push_back(T const &value) requires std::copy_constructible<T> {
+    emplace_back(value);
+  }
+
+  void push_back(T &&value) { emplace_back(std::move(value)); }
+
+  void reserve(size_type const new_capacity) {
+    if (new_capacity <= capacity_) {
+      return;
+    }
+    T *const new_data = alloc_traits::allocate(allocator_, new_capacity);
+    size_type moved = 0;
+    try {
+      for (; moved != size_; ++moved) {
+        alloc_traits::construct(allocator_, new_data + moved,
+                                std::move_if_noexcept(data_[moved]));
+      }
+    } catch (...) {
+      destroy(new_data, new_data + moved);
+      alloc_traits::deallocate(allocator_, new_data, new_capacity);
+      throw;
+    }
+    destroy(begin(), end());
+    deallocate();
+    data_ = new_data;
+    capacity_ = new_capacity;
+  }
+
+  // Destroys the elements, keeping whatever storage is in use.
+  void clear() noexcept {
+    destroy(begin(), end());
+    size_ = 0;
+  }
+
+private:
+  using alloc_traits = std::allocator_traits<Allocator>;
+
+  template <typename... Args> reference construct_back(Args &&...args) {
+    T *const element = data_ + size_;
+    alloc_traits::construct(allocator_, element, std::forward<Args>(args)...);
+    ++size_;
+    return *element;
+  }
+
+  T *inline_data() noexcept { return reinterpret_cast<T *>(buffer_); }
+  T const *inline_data() const noexcept {
+    return reinterpret_cast<T const *>(buffer_);
+  }
+
+  // Heap storage is only taken over when it can be given back to the
+  // allocator it came from; otherwise the elements are moved one by one.
+  void take(small_vector &other) {
+    if (other.is_inline() || allocator_ != other.allocator_) {
+      reserve(other.size_);
+      for (T &element : other) {
+        construct_back(std::move(element));
+      }
+      other.clear();
+    } else {
+      data_ = std::exchange(other.data_, other.inline_data());
+      size_ = std::exchange(other.size_, 0);
+      capacity_ = std::exchange(other.capacity_, N);
+    }
+  }
+
+  void release() noexcept {
+    clear();
+    deallocate();
+    data_ = inline_data();
+    capacity_ = N;
+  }
+
+  void deallocate() noexcept {
+    if (not is_inline()) {
+      alloc_traits::deallocate(allocator_, data_, capacity_);
+    }
+  }
+
+  void destroy(T *first, T *const last) noexcept {
+    for (; first != last; ++first) {
+      alloc_traits::destroy(allocator_, first);
+    }
+  }
+
+  alignas(T) std::byte buffer_[N * sizeof(T)];
+  T *data_ = inline_data();
+  size_type size_ = 0;
+  size_type capacity_ = N;
+  [[no_unique_address]] Allocator allocator_;
+};
+
+} // namespace skizzay::cddd
@@ -0,0 +1,230 @@
+#pragma once
+
+#include "skizzay/cddd/event_loop.h"
+
+#include <atomic>
+#include <concepts>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace skizzay::cddd {
+namespace task_details_ {
+
+struct promise_base {
+  struct final_awaiter {
+    bool await_ready() const noexcept { return false; }
+
+    template <typename Promise>
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<Promise> const finished) noexcept {
+      return finished.promise().continuation_;
+    }
+
+    void await_resume() const noexcept {}
+  };
+
+  std::suspend_always initial_suspend() const noexcept { return {}; }
+  final_awaiter final_suspend() const noexcept { return {}; }
+
+  void unhandled_exception() noexcept { error_ = std::current_exception(); }
+
+  void rethrow_if_failed() const {
+    if (nullptr != error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+  std::coroutine_handle<> continuation_ = std::noop_coroutine();
+  event_loop *loop_ = nullptr;
+  std::exception_ptr error_;
+};
+
+// The loop a coroutine runs on, if it is one of ours and has one.
+template <typename Promise>
+event_loop *loop_of(std::coroutine_handle<Promise> const handle) noexcept {
+  if constexpr (std::derived_from<Promise, promise_base>) {
+    return handle.promise().loop_;
+  } else {
+    return nullptr;
+  }
+}
+
+template <typename T> struct promise : promise_base {
+  template <std::convertible_to<T> U> void return_value(U &&value) {
+    value_.emplace(std::forward<U>(value));
+  }
+
+  T result() {
+    rethrow_if_failed();
+    return std::move(*value_);
+  }
+
+  std::optional<T> value_;
+};
+
+template <> struct promise<void> : promise_base {
+  void return_void() const noexcept {}
+
+  void result() const { rethrow_if_failed(); }
+};
+} // namespace task_details_
+
+// A lazily started coroutine producing a T. Awaiting a task starts it, and
+// the awaiting coroutine is resumed by symmetric transfer once it finishes,
+// so chains of tasks neither block nor grow the stack. Tasks run on the event
+// loop of the coroutine awaiting them.
+template <typename T = void> struct [[nodiscard]] task {
+  struct promise_type : task_details_::promise<T> {
+    task get_return_object() noexcept {
+      return task{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+  };
+
+  task(task &&other) noexcept
+      : coroutine_{std::exchange(other.coroutine_, nullptr)} {}
+
+  task &operator=(task &&other) noexcept {
+    if (this != &other) {
+      destroy();
+      coroutine_ = std::exchange(other.coroutine_, nullptr);
+    }
+    return *this;
+  }
+
+  ~task() { destroy(); }
+
+  auto operator co_await() &&noexcept { return awaiter{coroutine_}; }
+
+private:
+  struct awaiter {
+    bool await_ready() const noexcept { return false; }
+
+    template <typename Promise>
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<Promise> const awaiting) noexcept {
+      coroutine.promise().continuation_ = awaiting;
+      coroutine.promise().loop_ = task_details_::loop_of(awaiting);
+      return coroutine;
+    }
+
+    T await_resume() { return coroutine.promise().result(); }
+
+    std::coroutine_handle<promise_type> coroutine;
+  };
+
+  explicit task(std::coroutine_handle<promise_type> const coroutine) noexcept
+      : coroutine_{coroutine} {}
+
+  void destroy() noexcept {
+    if (nullptr != coroutine_) {
+      coroutine_.destroy();
+    }
+  }
+
+  std::coroutine_handle<promise_type> coroutine_;
+};
+
+namespace task_details_ {
+// Owns itself once started, and is destroyed when it finishes.
+struct detached {
+  struct promise_type : promise_base {
+    detached get_return_object() noexcept {
+      return detached{
+          std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+
+    std::suspend_never final_suspend() const noexcept { return {}; }
+
+    void return_void() const noexcept {}
+  };
+
+  std::coroutine_handle<promise_type> coroutine;
+};
+
+inline detached run_detached(event_loop &loop, task<> spawned) {
+  try {
+    co_await std::move(spawned);
+  } catch (...) {
+    loop.fail(std::current_exception());
+  }
+  loop.work_finished();
+}
+} // namespace task_details_
+
+// Starts the task on the loop. A failure of the task is rethrown from run.
+inline void spawn(event_loop &loop, task<> spawned) {
+  task_details_::detached const started =
+      task_details_::run_detached(loop, std::move(spawned));
+  started.coroutine.promise().loop_ = &loop;
+  loop.work_started();
+  loop.post(started.coroutine);
+}
+
+// Suspends the awaiting coroutine until the operation started with a
+// completion callback completes, rethrowing its failure. The operation may
+// complete on any thread; the coroutine is resumed on its event loop, or on
+// the completing thread when it has none. Operations completing before
+// returning from start do not suspend the coroutine at all; a start that
+// throws must not complete.
+template <std::invocable<std::function<void(std::exception_ptr)>> Start>
+struct completion_awaiter {
+  explicit completion_awaiter(Start start) noexcept(
+      std::is_nothrow_move_constructible_v<Start>)
+      : start_{std::move(start)} {}
+
+  bool await_ready() const noexcept { return false; }
+
+  template <typename Promise>
+  bool await_suspend(std::coroutine_handle<Promise> const awaiting) {
+    event_loop *const loop = task_details_::loop_of(awaiting);
+    state_ = std::make_shared<state>();
+    if (nullptr != loop) {
+      loop->work_started();
+    }
+    auto const resume = [state = state_, awaiting,
+                         loop](std::exception_ptr const error) {
+      state->error = error;
+      if (state->arrived.exchange(true, std::memory_order_acq_rel)) {
+        if (nullptr == loop) {
+          awaiting.resume();
+        } else {
+          loop->post(awaiting);
+          loop->work_finished();
+        }
+      } else if (nullptr != loop) {
+        loop->work_finished();
+      }
+    };
+    try {
+      std::invoke(start_, std::function<void(std::exception_ptr)>{resume});
+    } catch (...) {
+      if (nullptr != loop) {
+        loop->work_finished();
+      }
+      throw;
+    }
+    return not state_->arrived.exchange(true, std::memory_order_acq_rel);
+  }
+
+  void await_resume() const {
+    if (nullptr != state_->error) {
+      std::rethrow_exception(state_->error);
+    }
+  }
+
+private:
+  struct state {
+    std::atomic<bool> arrived = false;
+    std::exception_ptr error;
+  };
+
+  Start start_;
+  std::shared_ptr<state> state_;
+};
+
+} // namespace skizzay::cddd
@@ -0,0 +1,299 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace skizzay::cddd {
+
+// Runs the work posted to it on a fixed set of worker threads. Each worker
+// has a queue of its own: work posted from a worker goes to the back of its
+// queue, which it takes from the front, so work it keeps posting does not
+// starve what was queued before it. Idle workers steal from the front of the
+// others' queues. Work posted from other threads is spread across the
+// workers.
+// A worker finding no work parks on a semaphore of its own; posting only
+// takes the pool's lock to wake one when any are parked.
+//
+// Work posted with a key runs in the order it was posted, one item at a time,
+// with respect to all other work posted with an equal key, while work posted
+// under other keys runs alongside it. Keys are hashed onto a fixed number of
+// strands, so unrelated keys may share one.
+//
+// Work must not throw. Work still queued when the pool is destroyed is run
+// before the workers are joined.
+struct thread_pool {
+  static std::size_t default_concurrency() noexcept {
+    return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+  }
+
+  // Pinning binds each worker to one of the CPUs the process may run on,
+  // round robin, where the platform supports it, and throws std::system_error
+  // should that fail.
+  explicit thread_pool(std::size_t const num_threads = default_concurrency(),
+                       bool const pin_threads = false)
+      : strands_(std::max<std::size_t>(1, num_threads) * strands_per_worker),
+        workers_(std::max<std::size_t>(1, num_threads)) {
+    for (std::unique_ptr<strand> &s : strands_) {
+      s = std::make_unique<strand>();
+    }
+    for (std::unique_ptr<worker> &w : workers_) {
+      w = std::make_unique<worker>();
+    }
+    std::vector<int> const cpus = pin_threads ? allowed_cpus()
+                                              : std::vector<int>{};
+    try {
+      for (std::size_t i = 0; i != std::size(workers_); ++i) {
+        workers_[i]->thread = std::thread{[this, i]() { work(i); }};
+        if (pin_threads) {
+          pin(workers_[i]->thread, cpus, i);
+        }
+      }
+    } catch (...) {
+      stop();
+      throw;
+    }
+  }
+
+  thread_pool(thread_pool const &) = delete;
+  thread_pool &operator=(thread_pool const &) = delete;
+
+  ~thread_pool() { stop(); }
+
+  std::size_t size() const noexcept { return std::size(workers_); }
+
+  void post(std::function<void()> work) {
+    std::size_t const i = this == current_pool_
+                              ? current_worker_
+                              : next_worker_.fetch_add(1) % std::size(workers_);
+    {
+      std::lock_guard l_{workers_[i]->m};
+      workers_[i]->queue.push_back(std::move(work));
+    }
+    wake_one();
+  }
+
+  template <typename Key>
+  void post(Key const &key, std::function<void()> work) {
+    strand &s = *strands_[std::hash<Key>{}(key) % std::size(strands_)];
+    {
+      std::lock_guard l_{s.m};
+      s.queue.push_back(std::move(work));
+      if (std::exchange(s.scheduled, true)) {
+        return;
+      }
+    }
+    post([this, &s]() { run(s); });
+  }
+
+private:
+  static constexpr std::size_t strands_per_worker = 16;
+
+  struct worker {
+    std::mutex m;
+    std::deque<std::function<void()>> queue;
+    std::binary_semaphore parked{0};
+    std::thread thread;
+  };
+
+  struct strand {
+    std::mutex m;
+    std::deque<std::function<void()>> queue;
+    bool scheduled = false;
+  };
+
+  static std::vector<int> allowed_cpus() {
+    std::vector<int> result;
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (0 != sched_getaffinity(0, sizeof(cpus), &cpus)) {
+      throw std::system_error{errno, std::system_category(),
+                              "Could not read the process's CPU affinity"};
+    }
+    for (int cpu = 0; cpu != CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &cpus)) {
+        result.push_back(cpu);
+      }
+    }
+#endif
+    return result;
+  }
+
+  static void pin([[maybe_unused]] std::thread &thread,
+                  [[maybe_unused]] std::vector<int> const &cpus,
+                  [[maybe_unused]] std::size_t const i) {
+#ifdef __linux__
+    cpu_set_t cpu;
+    CPU_ZERO(&cpu);
+    CPU_SET(cpus[i % std::size(cpus)], &cpu);
+    if (int const error = pthread_setaffinity_np(thread.native_handle(),
+                                                 sizeof(cpu), &cpu);
+        0 != error) {
+      throw std::system_error{error, std::system_category(),
+                              "Could not pin a worker thread"};
+    }
+#endif
+  }
+
+  void stop() noexcept {
+    {
+      std::lock_guard l_{m_};
+      stopping_ = true;
+      for (std::size_t const i : parked_) {
+        workers_[i]->parked.release();
+      }
+      parked_.clear();
+      num_parked_.store(0, std::memory_order_seq_cst);
+    }
+    for (std::unique_ptr<worker> &w : workers_) {
+      if (w->thread.joinable()) {
+        w->thread.join();
+      }
+    }
+  }
+
+  // The queue was pushed to before the parked workers are counted, and a
+  // worker is counted before it looks at the queues one last time, so either
+  // it finds the work or it is woken for it.
+  void wake_one() {
+    if (0 == num_parked_.load(std::memory_order_seq_cst)) {
+      return;
+    }
+    std::size_t i;
+    {
+      std::lock_guard l_{m_};
+      if (std::empty(parked_)) {
+        return;
+      }
+      i = parked_.back();
+      parked_.pop_back();
+      num_parked_.fetch_sub(1, std::memory_order_seq_cst);
+    }
+    workers_[i]->parked.release();
+  }
+
+  void work(std::size_t const i) {
+    current_pool_ = this;
+    current_worker_ = i;
+    std::function<void()> item;
+    for (;;) {
+      if (take(i, item) || park(i, item)) {
+        item();
+        item = nullptr;
+      } else {
+        return;
+      }
+    }
+  }
+
+  // Parks the worker until it is woken for work, which is then taken. Returns
+  // false once the pool is stopping and there is no work left.
+  bool park(std::size_t const i, std::function<void()> &item) {
+    for (;;) {
+      {
+        std::lock_guard l_{m_};
+        if (stopping_) {
+          return take(i, item);
+        }
+        parked_.push_back(i);
+        num_parked_.fetch_add(1, std::memory_order_seq_cst);
+      }
+      if (take(i, item)) {
+        unpark(i);
+        return true;
+      }
+      workers_[i]->parked.acquire();
+      if (take(i, item)) {
+        return true;
+      }
+    }
+  }
+
+  // Withdraws a worker that found work after all. Should a poster have
+  // already chosen it, the wake it is about to send is consumed.
+  void unpark(std::size_t const i) {
+    {
+      std::lock_guard l_{m_};
+      if (auto const parked = std::ranges::find(parked_, i);
+          std::end(parked_) != parked) {
+        parked_.erase(parked);
+        num_parked_.fetch_sub(1, std::memory_order_seq_cst);
+        return;
+      }
+    }
+    workers_[i]->parked.acquire();
+  }
+
+  bool take(std::size_t const i, std::function<void()> &item) {
+    {
+      worker &own = *workers_[i];
+      std::lock_guard l_{own.m};
+      if (not std::empty(own.queue)) {
+        item = std::move(own.queue.front());
+        own.queue.pop_front();
+        return true;
+      }
+    }
+    for (std::size_t n = 1; n != std::size(workers_); ++n) {
+      worker &victim = *workers_[(i + n) % std::size(workers_)];
+      std::lock_guard l_{victim.m};
+      if (not std::empty(victim.queue)) {
+        item = std::move(victim.queue.front());
+        victim.queue.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Runs the strand's next item, then posts itself again for the one after
+  // it rather than draining the strand, so the work queued before it runs
+  // first and idle workers may steal it.
+  void run(strand &s) {
+    std::function<void()> item;
+    {
+      std::lock_guard l_{s.m};
+      item = std::move(s.queue.front());
+      s.queue.pop_front();
+    }
+    item();
+    {
+      std::lock_guard l_{s.m};
+      if (std::empty(s.queue)) {
+        s.scheduled = false;
+        return;
+      }
+    }
+    post([this, &s]() { run(s); });
+  }
+
+  inline static thread_local thread_pool const *current_pool_ = nullptr;
+  inline static thread_local std::size_t current_worker_ = 0;
+
+  std::vector<std::unique_ptr<strand>> strands_;
+  std::vector<std::unique_ptr<worker>> workers_;
+  std::atomic<std::size_t> next_worker_ = 0;
+  // Guards the parked workers; taken to park and to wake.
+  std::mutex m_;
+  std::vector<std::size_t> parked_;
+  std::atomic<std::size_t> num_parked_ = 0;
+  bool stopping_ = false;
+};
+
+} // namespace skizzay::cddd
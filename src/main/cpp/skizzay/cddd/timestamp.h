@@ -1,7 +1,9 @@
 #pragma once
 
 #include <chrono>
+#include <functional>
 #include <type_traits>
+#include <variant>
 
 namespace skizzay::cddd {
 template <typename> struct is_time_point : std::false_type {};
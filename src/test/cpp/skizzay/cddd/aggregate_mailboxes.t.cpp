@@ -0,0 +1,182 @@
+#include <skizzay/cddd/aggregate_mailboxes.h>
+
+#include "skizzay/cddd/command_executor.h"
+#include "skizzay/cddd/event_loop.h"
+#include "skizzay/cddd/event_store.h"
+#include "skizzay/cddd/executor.h"
+#include "skizzay/cddd/in_memory_event_store.h"
+#include "skizzay/cddd/timestamp.h"
+
+#include <catch.hpp>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace skizzay::cddd;
+
+namespace {
+struct fake_clock {
+  std::chrono::system_clock::time_point now() noexcept {
+    return skizzay::cddd::now(system_clock);
+  }
+
+  [[no_unique_address]] std::chrono::system_clock system_clock;
+};
+
+template <std::size_t N>
+struct test_event : basic_domain_event<test_event<N>, std::string, std::size_t,
+                                       timestamp_t<fake_clock>> {};
+
+struct fake_aggregate {
+  template <std::size_t N>
+  requires(1 == N) || (2 == N) void apply(test_event<N> const &event) {
+    version = skizzay::cddd::version(event);
+  }
+
+  std::string id;
+  std::size_t version = {};
+};
+
+using store_type =
+    in_memory_event_store<fake_clock, test_event<1>, test_event<2>>;
+
+template <typename Executor>
+using mailboxes_type = aggregate_mailboxes<store_type, fake_aggregate,
+                                           Executor, test_event<1>,
+                                           test_event<2>>;
+} // namespace
+
+SCENARIO("Commands for an aggregate are serialized through its mailbox",
+         "[unit][aggregate_mailboxes]") {
+  GIVEN("mailboxes over an in-memory event store") {
+    store_type store;
+    std::string const id = "abc";
+
+    WHEN("commands are submitted and run on the submitting thread") {
+      inline_executor executor;
+      mailboxes_type<inline_executor> target{store, executor};
+      for (std::size_t i = 0; i != 3; ++i) {
+        REQUIRE_NOTHROW(
+            target
+                .submit(id,
+                        [](fake_aggregate const &, auto &events) {
+                          add_event(events, test_event<1>{});
+                        })
+                .get());
+      }
+
+      THEN("each command was committed") {
+        REQUIRE(3 == version(get_event_stream(store, id)));
+      }
+    }
+
+    WHEN("commands queue up before their mailbox is drained") {
+      event_loop loop;
+      mailboxes_type<event_loop> target{store, loop};
+      std::vector<std::size_t> versions_seen;
+      std::vector<std::future<void>> results;
+      for (std::size_t i = 0; i != 4; ++i) {
+        results.push_back(target.submit(
+            id, [&versions_seen, i](fake_aggregate const &aggregate,
+                                    auto &events) {
+              versions_seen.push_back(aggregate.version);
+              if (2 == i) {
+                throw std::invalid_argument{"rejected"};
+              }
+              add_event(events, test_event<2>{});
+            }));
+      }
+      results.push_back(target.submit(
+          "def", [](fake_aggregate const &, auto &events) {
+            add_event(events, test_event<1>{});
+          }));
+      loop.run();
+
+      THEN("they were executed in turn, each seeing the events of those "
+           "before it") {
+        REQUIRE(std::vector<std::size_t>{0, 1, 2, 2} == versions_seen);
+      }
+
+      THEN("the rejected command failed alone") {
+        REQUIRE_NOTHROW(results[0].get());
+        REQUIRE_NOTHROW(results[1].get());
+        REQUIRE_THROWS_AS(results[2].get(), std::invalid_argument);
+        REQUIRE_NOTHROW(results[3].get());
+        REQUIRE(3 == version(get_event_stream(store, id)));
+      }
+
+      THEN("the commands for another aggregate were committed to its own "
+           "stream") {
+        REQUIRE_NOTHROW(results[4].get());
+        REQUIRE(1 == version(get_event_stream(store, "def")));
+      }
+    }
+
+    WHEN("a hot aggregate keeps its mailbox busy") {
+      event_loop loop;
+      mailboxes_type<event_loop> target{store, loop,
+                                        command_executor<test_event<1>,
+                                                         test_event<2>>{},
+                                        1};
+      std::vector<std::string> ids_seen;
+      auto const record = [&ids_seen](fake_aggregate const &aggregate,
+                                      auto &events) {
+        ids_seen.push_back(aggregate.id);
+        add_event(events, test_event<1>{});
+      };
+      std::vector<std::future<void>> results;
+      for (std::size_t i = 0; i != 3; ++i) {
+        results.push_back(target.submit(id, record));
+      }
+      results.push_back(target.submit("def", record));
+      loop.run();
+
+      THEN("the other aggregate's commands were run between its batches") {
+        REQUIRE(std::vector<std::string>{id, "def", id, id} == ids_seen);
+        for (std::future<void> &result : results) {
+          REQUIRE_NOTHROW(result.get());
+        }
+        REQUIRE(3 == version(get_event_stream(store, id)));
+      }
+    }
+
+    WHEN("more mailboxes go idle than are kept") {
+      event_loop loop;
+      mailboxes_type<event_loop> target{
+          store, loop, command_executor<test_event<1>, test_event<2>>{},
+          mailboxes_type<event_loop>::default_max_batch_size, 2};
+      std::vector<std::future<void>> results;
+      for (std::string const other_id : {"a", "b", "c", "d"}) {
+        results.push_back(target.submit(
+            other_id, [](fake_aggregate const &, auto &events) {
+              add_event(events, test_event<1>{});
+            }));
+      }
+      loop.run();
+
+      THEN("only the most recently idle are kept") {
+        REQUIRE(2 == target.size());
+      }
+
+      AND_WHEN("a dropped aggregate is sent another command") {
+        results.push_back(
+            target.submit("a", [](fake_aggregate const &aggregate,
+                                  auto &events) {
+              REQUIRE(1 == aggregate.version);
+              add_event(events, test_event<2>{});
+            }));
+        loop.run();
+
+        THEN("it is loaded afresh and the command committed") {
+          for (std::future<void> &result : results) {
+            REQUIRE_NOTHROW(result.get());
+          }
+          REQUIRE(2 == version(get_event_stream(store, "a")));
+          REQUIRE(2 == target.size());
+        }
+      }
+    }
+  }
+}
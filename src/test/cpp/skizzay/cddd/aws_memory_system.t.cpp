@@ -0,0 +1,118 @@
+#include <skizzay/cddd/dynamodb/aws_memory_system.h>
+
+#include <algorithm>
+#include <catch.hpp>
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace skizzay::cddd;
+
+namespace {
+bool is_aligned(void const *memory, std::size_t const alignment) {
+  return 0 == (reinterpret_cast<std::uintptr_t>(memory) & (alignment - 1));
+}
+} // namespace
+
+SCENARIO("AWS SDK allocations can be served from pooled arenas",
+         "[unit][dynamodb][memory]") {
+  GIVEN("a pooled memory system") {
+    dynamodb::pooled_memory_system target;
+    target.Begin();
+
+    WHEN("small blocks are allocated") {
+      std::vector<void *> blocks;
+      for (std::size_t size = 1; size <= 2048; size *= 2) {
+        void *const block = target.AllocateMemory(size, 16);
+        std::memset(block, 0xab, size);
+        blocks.push_back(block);
+      }
+
+      THEN("the blocks are aligned and served from the pools") {
+        for (void *const block : blocks) {
+          CHECK(is_aligned(block, 16));
+        }
+        auto const statistics = target.statistics();
+        CHECK(std::size(blocks) == statistics.allocations);
+        CHECK(std::size(blocks) == statistics.pooled_allocations);
+        CHECK(0 == statistics.large_allocations);
+      }
+
+      AND_WHEN("the blocks are freed and reallocated") {
+        for (void *const block : blocks) {
+          target.FreeMemory(block);
+        }
+        auto const chunks_reserved = target.statistics().chunks_reserved;
+        void *const block = target.AllocateMemory(2048, 16);
+
+        THEN("the freed block is reused") {
+          CHECK(block == blocks.back());
+          CHECK(chunks_reserved == target.statistics().chunks_reserved);
+          CHECK(std::size(blocks) == target.statistics().deallocations);
+        }
+        target.FreeMemory(block);
+      }
+    }
+
+    WHEN("a large or over-aligned block is allocated") {
+      void *const large = target.AllocateMemory(1 << 20, 16);
+      void *const over_aligned = target.AllocateMemory(64, 256);
+
+      THEN("the blocks come from the global heap") {
+        CHECK(is_aligned(large, 16));
+        CHECK(is_aligned(over_aligned, 256));
+        CHECK(2 == target.statistics().large_allocations);
+      }
+      target.FreeMemory(large);
+      target.FreeMemory(over_aligned);
+    }
+
+    WHEN("a block is freed on another thread") {
+      void *const block = target.AllocateMemory(100, 16);
+      std::thread{[&]() { target.FreeMemory(block); }}.join();
+
+      THEN("the deallocation is counted") {
+        CHECK(1 == target.statistics().deallocations);
+      }
+    }
+
+    WHEN("blocks allocated on one thread are repeatedly freed on another") {
+      auto const allocate = [&target]() {
+        std::vector<void *> blocks(1000);
+        for (void *&block : blocks) {
+          block = target.AllocateMemory(100, 16);
+        }
+        return blocks;
+      };
+      auto const free_elsewhere = [&target](std::vector<void *> const &blocks) {
+        std::thread{[&]() {
+          for (void *const block : blocks) {
+            target.FreeMemory(block);
+          }
+        }}.join();
+      };
+      std::vector<void *> const first = allocate();
+      std::set<void *> const first_blocks(std::begin(first), std::end(first));
+      free_elsewhere(first);
+      auto const chunks_reserved = target.statistics().chunks_reserved;
+      std::size_t num_reused = 0;
+      for (std::size_t round = 0; round != 50; ++round) {
+        std::vector<void *> const blocks = allocate();
+        num_reused += static_cast<std::size_t>(
+            std::ranges::count_if(blocks, [&](void *const block) {
+              return first_blocks.contains(block);
+            }));
+        free_elsewhere(blocks);
+      }
+
+      THEN("the freed blocks are reused rather than new chunks reserved") {
+        CHECK(chunks_reserved == target.statistics().chunks_reserved);
+        CHECK(0 < num_reused);
+      }
+    }
+
+    target.End();
+  }
+}
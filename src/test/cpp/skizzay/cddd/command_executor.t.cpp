@@ -0,0 +1,103 @@
+#include <skizzay/cddd/command_executor.h>
+
+#include "skizzay/cddd/event_store.h"
+#include "skizzay/cddd/in_memory_event_store.h"
+#include "skizzay/cddd/optimistic_concurrency_collision.h"
+#include "skizzay/cddd/timestamp.h"
+
+#include <catch.hpp>
+#include <chrono>
+#include <string>
+
+using namespace skizzay::cddd;
+
+namespace {
+struct fake_clock {
+  std::chrono::system_clock::time_point now() noexcept {
+    return skizzay::cddd::now(system_clock);
+  }
+
+  [[no_unique_address]] std::chrono::system_clock system_clock;
+};
+
+template <std::size_t N>
+struct test_event : basic_domain_event<test_event<N>, std::string, std::size_t,
+                                       timestamp_t<fake_clock>> {};
+
+struct fake_aggregate {
+  template <std::size_t N>
+  requires(1 == N) || (2 == N) void apply(test_event<N> const &event) {
+    version = skizzay::cddd::version(event);
+    ++num_events[N - 1];
+  }
+
+  std::string id;
+  std::size_t version = {};
+  std::size_t num_events[2] = {};
+};
+
+using executor_type = command_executor<test_event<1>, test_event<2>>;
+
+retry_policy const no_delay{5, std::chrono::microseconds{0},
+                            std::chrono::microseconds{0}};
+} // namespace
+
+SCENARIO("Commands are retried after optimistic concurrency collisions",
+         "[unit][command_executor]") {
+  GIVEN("an aggregate loaded before another writer committed to its stream") {
+    in_memory_event_store<fake_clock, test_event<1>, test_event<2>> store;
+    std::string const id = "abc";
+    fake_aggregate aggregate{id};
+    {
+      auto event_stream = get_event_stream(store, id);
+      add_event(event_stream, test_event<2>{});
+      commit_events(event_stream, 0);
+    }
+    std::size_t executions = 0;
+    auto const command = [&executions](fake_aggregate const &,
+                                       auto &events) {
+      ++executions;
+      add_event(events, test_event<1>{});
+    };
+
+    WHEN("a command is executed") {
+      executor_type execute{no_delay};
+      execute(store, aggregate, command);
+
+      THEN("it was executed again against the caught up aggregate") {
+        REQUIRE(2 == executions);
+        REQUIRE(1 == aggregate.num_events[1]);
+      }
+
+      THEN("its events were committed after the other writer's") {
+        REQUIRE(2 == version(get_event_stream(store, id)));
+        REQUIRE(2 == aggregate.version);
+        REQUIRE(1 == aggregate.num_events[0]);
+      }
+    }
+
+    WHEN("a command is executed whose events do not conflict with the other "
+         "writer's") {
+      executor_type execute{no_delay};
+      execute.without_conflict<test_event<2>, test_event<1>>();
+      execute(store, aggregate, command);
+
+      THEN("its events were committed again without executing it again") {
+        REQUIRE(1 == executions);
+        REQUIRE(2 == version(get_event_stream(store, id)));
+        REQUIRE(2 == aggregate.version);
+      }
+    }
+
+    WHEN("a command is executed with a single attempt") {
+      executor_type execute{retry_policy{1, std::chrono::microseconds{0},
+                                         std::chrono::microseconds{0}}};
+
+      THEN("the collision is rethrown") {
+        REQUIRE_THROWS_AS(execute(store, aggregate, command),
+                          optimistic_concurrency_collision);
+        REQUIRE(1 == version(get_event_stream(store, id)));
+      }
+    }
+  }
+}
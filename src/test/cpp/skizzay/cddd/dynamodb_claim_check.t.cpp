@@ -0,0 +1,210 @@
+#include <skizzay/cddd/dynamodb/dynamodb_claim_check.h>
+
+#include "skizzay/cddd/blob_store.h"
+
+#include <algorithm>
+#include <atomic>
+#include <catch.hpp>
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace skizzay::cddd;
+using Aws::DynamoDB::Model::AttributeValue;
+using Aws::DynamoDB::Model::ValueType;
+
+namespace {
+// Gets may run concurrently; the most seen in flight at once is recorded.
+struct fake_blob_store final : blob_store {
+  void put_blob(std::string const &key,
+                std::span<std::byte const> const data) override {
+    std::lock_guard l_{m};
+    blobs.insert_or_assign(key, make_blob(data));
+  }
+
+  blob get_blob(std::string const &key) override {
+    std::size_t const now_in_flight = ++in_flight;
+    std::size_t seen = max_in_flight;
+    while (seen < now_in_flight &&
+           not max_in_flight.compare_exchange_weak(seen, now_in_flight)) {
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    --in_flight;
+    std::lock_guard l_{m};
+    ++number_of_gets;
+    if (auto const entry = blobs.find(key); std::end(blobs) != entry) {
+      return entry->second;
+    }
+    throw blob_not_found{"Could not find blob '" + key + "'"};
+  }
+
+  std::mutex m;
+  std::map<std::string, blob> blobs;
+  std::size_t number_of_gets = 0;
+  std::atomic<std::size_t> in_flight = 0;
+  std::atomic<std::size_t> max_in_flight = 0;
+};
+
+Aws::DynamoDB::Model::Put make_put(AttributeValue const &payload) {
+  Aws::DynamoDB::Model::Put put;
+  put.AddItem("id", AttributeValue{}.SetS("abc"));
+  put.AddItem("payload", payload);
+  return put;
+}
+
+Aws::Utils::ByteBuffer make_bytes(std::size_t const size) {
+  std::vector<unsigned char> const data(size, 42);
+  return Aws::Utils::ByteBuffer{data.data(), size};
+}
+
+bool same_bytes(Aws::Utils::ByteBuffer const &lhs,
+                Aws::Utils::ByteBuffer const &rhs) {
+  return lhs.GetLength() == rhs.GetLength() &&
+         std::equal(lhs.GetUnderlyingData(),
+                    lhs.GetUnderlyingData() + lhs.GetLength(),
+                    rhs.GetUnderlyingData());
+}
+} // namespace
+
+SCENARIO("Oversized payloads are claim-checked into a blob store",
+         "[unit][dynamodb][claim_check]") {
+  fake_blob_store store;
+  dynamodb::claim_check const target{{"payload", 16}, store};
+
+  GIVEN("a string payload above the threshold") {
+    Aws::String const payload(64, 'x');
+    Aws::DynamoDB::Model::Put put = make_put(AttributeValue{}.SetS(payload));
+
+    WHEN("the put is offloaded") {
+      target.offload(put);
+
+      THEN("the payload was replaced by a reference to its blob") {
+        REQUIRE_FALSE(put.GetItem().contains("payload"));
+        REQUIRE(put.GetItem().contains(target.reference_name()));
+        REQUIRE("abc" == put.GetItem().at("id").GetS());
+        REQUIRE(1 == std::size(store.blobs));
+      }
+
+      AND_WHEN("another put of the same payload is offloaded") {
+        Aws::DynamoDB::Model::Put other =
+            make_put(AttributeValue{}.SetS(payload));
+        target.offload(other);
+
+        THEN("it refers to the same blob") {
+          REQUIRE(1 == std::size(store.blobs));
+          REQUIRE(put.GetItem().at(target.reference_name()).GetS() ==
+                  other.GetItem().at(target.reference_name()).GetS());
+        }
+      }
+
+      AND_WHEN("items holding the reference are resolved") {
+        Aws::Vector<dynamodb::claim_check::item_type> items{put.GetItem(),
+                                                            put.GetItem()};
+        REQUIRE(target.has_references(items));
+        target.resolve(items);
+
+        THEN("the string payload was restored, its blob fetched once") {
+          for (auto const &item : items) {
+            REQUIRE(ValueType::STRING == item.at("payload").GetType());
+            REQUIRE(payload == item.at("payload").GetS());
+            REQUIRE_FALSE(item.contains(target.reference_name()));
+          }
+          REQUIRE(1 == store.number_of_gets);
+        }
+      }
+
+      AND_WHEN("items holding the reference are resolved into copies") {
+        Aws::Vector<dynamodb::claim_check::item_type> const items{
+            put.GetItem(), make_put(AttributeValue{}.SetS("small")).GetItem()};
+        auto const copies = target.resolve_copies(items);
+
+        THEN("only the item holding the reference was copied and restored") {
+          REQUIRE(1 == std::size(copies));
+          auto const &copy = copies.at(&items.front());
+          REQUIRE(payload == copy.at("payload").GetS());
+          REQUIRE("abc" == copy.at("id").GetS());
+          REQUIRE_FALSE(copy.contains(target.reference_name()));
+          REQUIRE(items.front().contains(target.reference_name()));
+        }
+      }
+    }
+  }
+
+  GIVEN("a binary payload above the threshold") {
+    Aws::Utils::ByteBuffer const payload = make_bytes(64);
+    Aws::DynamoDB::Model::Put put = make_put(AttributeValue{}.SetB(payload));
+
+    WHEN("the put is offloaded and its item resolved") {
+      target.offload(put);
+      REQUIRE_FALSE(put.GetItem().contains("payload"));
+      Aws::Vector<dynamodb::claim_check::item_type> items{put.GetItem()};
+      target.resolve(items);
+
+      THEN("the binary payload was restored") {
+        REQUIRE(ValueType::BYTEBUFFER == items.front().at("payload").GetType());
+        REQUIRE(same_bytes(payload, items.front().at("payload").GetB()));
+        REQUIRE_FALSE(items.front().contains(target.reference_name()));
+      }
+    }
+  }
+
+  GIVEN("items referring to more distinct blobs than are fetched at once") {
+    dynamodb::claim_check const bounded{{"payload", 16, 3}, store};
+    Aws::Vector<dynamodb::claim_check::item_type> items;
+    for (std::size_t i = 0; i != 10; ++i) {
+      Aws::DynamoDB::Model::Put put =
+          make_put(AttributeValue{}.SetS(Aws::String(32 + i, 'x')));
+      bounded.offload(put);
+      items.push_back(put.GetItem());
+      items.push_back(put.GetItem());
+    }
+
+    WHEN("they are resolved") {
+      bounded.resolve(items);
+
+      THEN("each blob was fetched once, no more than the bound at a time") {
+        REQUIRE(10 == store.number_of_gets);
+        REQUIRE(3 >= store.max_in_flight);
+        for (std::size_t i = 0; i != std::size(items); ++i) {
+          REQUIRE(Aws::String(32 + i / 2, 'x') ==
+                  items[i].at("payload").GetS());
+        }
+      }
+    }
+
+    WHEN("one of the blobs is missing") {
+      store.blobs.erase(std::begin(store.blobs));
+
+      THEN("resolving them fails") {
+        REQUIRE_THROWS_AS(bounded.resolve(items), blob_not_found);
+      }
+    }
+  }
+
+  GIVEN("payloads at the threshold") {
+    Aws::DynamoDB::Model::Put string_put =
+        make_put(AttributeValue{}.SetS(Aws::String(16, 'x')));
+    Aws::DynamoDB::Model::Put binary_put =
+        make_put(AttributeValue{}.SetB(make_bytes(16)));
+
+    WHEN("the puts are offloaded") {
+      target.offload(string_put);
+      target.offload(binary_put);
+
+      THEN("they were left inline") {
+        REQUIRE(Aws::String(16, 'x') ==
+                string_put.GetItem().at("payload").GetS());
+        REQUIRE(same_bytes(make_bytes(16),
+                           binary_put.GetItem().at("payload").GetB()));
+        REQUIRE(std::empty(store.blobs));
+        REQUIRE_FALSE(target.has_references(
+            {string_put.GetItem(), binary_put.GetItem()}));
+      }
+    }
+  }
+}
@@ -5,6 +5,10 @@
 #include "skizzay/cddd/dynamodb/dynamodb_event_stream.h"
 
 #include <catch.hpp>
+#include <exception>
+#include <future>
+#include <limits>
+#include <thread>
 
 using namespace skizzay::cddd;
 
@@ -52,6 +56,49 @@ struct fake_aggregate final {
   std::size_t version_ = 0;
   timestamp_t<fake_clock> timestamp_;
   std::size_t number_of_events_seen = 0;
+  std::size_t snapshot_version = 0;
+};
+
+struct fake_view_aggregate final {
+  explicit fake_view_aggregate(std::string id) : id_{std::move(id)} {}
+
+  std::string const &id() const noexcept { return id_; }
+  std::size_t version() const noexcept { return version_; }
+
+  void apply(dynamodb::event_view<test_event<1>> const &event_view) {
+    CHECK("test event 1" ==
+          dynamodb::get_value_from_item<std::string>(
+              event_view.representation(), "type"));
+    version_ = skizzay::cddd::version(event_view);
+    ++number_of_views_seen;
+  }
+
+  template <std::size_t N> void apply(test_event<N> const &event) {
+    version_ = skizzay::cddd::version(event);
+    ++number_of_events_seen;
+  }
+
+  std::string id_;
+  std::size_t version_ = 0;
+  std::size_t number_of_views_seen = 0;
+  std::size_t number_of_events_seen = 0;
+};
+
+struct fake_snapshot_serializer final
+    : dynamodb::snapshot_serializer<fake_aggregate> {
+  Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>
+  serialize(fake_aggregate const &aggregate) const override {
+    return {{"state", Aws::DynamoDB::Model::AttributeValue{}.SetN(
+                          std::to_string(aggregate.version()))}};
+  }
+
+  void deserialize(
+      Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> const &item,
+      fake_aggregate &aggregate) const override {
+    aggregate.version_ =
+        dynamodb::get_value_from_item<std::size_t>(item, "state");
+    aggregate.snapshot_version = aggregate.version_;
+  }
 };
 
 struct fake_serializer : dynamodb::serializer<test_event<1>, test_event<2>> {
@@ -72,6 +119,19 @@ struct fake_serializer : dynamodb::serializer<test_event<1>, test_event<2>> {
   }
 };
 
+// Counts the queries issued, one per page read.
+struct query_counting_client final : Aws::DynamoDB::DynamoDBClient {
+  using Aws::DynamoDB::DynamoDBClient::DynamoDBClient;
+
+  Aws::DynamoDB::Model::QueryOutcome
+  Query(Aws::DynamoDB::Model::QueryRequest const &request) const override {
+    ++number_of_queries;
+    return Aws::DynamoDB::DynamoDBClient::Query(request);
+  }
+
+  mutable std::size_t number_of_queries = 0;
+};
+
 inline auto random_number_generator =
     Catch::Generators::random(std::size_t{1}, std::size_t{50});
 
@@ -133,6 +193,8 @@ SCENARIO("Aggregates can be loaded from a DynamoDB event source",
         }
       }
       skizzay::cddd::commit_events(event_stream, std::size_t{0});
+      // The stream stamps its commits with a copy of the clock.
+      auto const committed_at = std::chrono::system_clock::now();
 
       WHEN("an aggregate is loaded from history") {
         skizzay::cddd::load_from_history(target, aggregate);
@@ -142,6 +204,316 @@ SCENARIO("Aggregates can be loaded from a DynamoDB event source",
           CHECK(num_events_to_add == skizzay::cddd::version(aggregate));
         }
       }
+
+      WHEN("an aggregate applying views is loaded from history") {
+        fake_view_aggregate view_aggregate{aggregate_id};
+        skizzay::cddd::load_from_history(target, view_aggregate);
+
+        THEN("it was handed views of the events it reads from their item") {
+          CHECK(num_events_to_add == view_aggregate.version());
+          CHECK((num_events_to_add + 1) / 2 ==
+                view_aggregate.number_of_views_seen);
+          CHECK(num_events_to_add / 2 == view_aggregate.number_of_events_seen);
+        }
+      }
+
+      AND_GIVEN("an event source reading a few events per page") {
+        auto const few_per_page = []() {
+          return Aws::DynamoDB::Model::QueryRequest{}.WithLimit(7);
+        };
+        dynamodb::event_source paged{event_dispatcher, event_log_config, client,
+                                     few_per_page};
+
+        WHEN("an aggregate is loaded from history") {
+          skizzay::cddd::load_from_history(paged, aggregate);
+
+          THEN("the events of every page have been applied") {
+            CHECK(num_events_to_add == aggregate.number_of_events_seen);
+          }
+        }
+
+        WHEN("an aggregate is loaded from history asynchronously") {
+          std::promise<void> done;
+          paged.load_from_history_async(
+              aggregate, std::numeric_limits<std::size_t>::max(),
+              [&done](std::exception_ptr const error) {
+                if (nullptr == error) {
+                  done.set_value();
+                } else {
+                  done.set_exception(error);
+                }
+              });
+          done.get_future().get();
+
+          THEN("the events of every page have been applied") {
+            CHECK(num_events_to_add == aggregate.number_of_events_seen);
+          }
+        }
+      }
+
+      WHEN("an aggregate is loaded as of the commit") {
+        skizzay::cddd::load_as_of(target, aggregate, committed_at);
+
+        THEN("the events have been applied to the aggregate") {
+          CHECK(num_events_to_add == aggregate.number_of_events_seen);
+        }
+      }
+
+      WHEN("an aggregate is loaded as of a time before the commit") {
+        skizzay::cddd::load_as_of(target, aggregate,
+                                  clock.result - std::chrono::seconds{1});
+
+        THEN("no events have been applied to the aggregate") {
+          CHECK(0 == aggregate.number_of_events_seen);
+        }
+      }
+
+      AND_GIVEN("several pages of events committed after them") {
+        int const page_size = 7;
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        for (int i = 0; i != 3 * page_size; ++i) {
+          skizzay::cddd::add_event(event_stream, test_event<1>{});
+        }
+        skizzay::cddd::commit_events(event_stream, num_events_to_add);
+        query_counting_client counting_client{client_configuration};
+        dynamodb::event_source paged{
+            event_dispatcher, event_log_config, counting_client, [=]() {
+              return Aws::DynamoDB::Model::QueryRequest{}.WithLimit(page_size);
+            }};
+
+        WHEN("an aggregate is loaded as of the first commit") {
+          skizzay::cddd::load_as_of(paged, aggregate, committed_at);
+
+          THEN("only the events of the first commit have been applied") {
+            CHECK(num_events_to_add == aggregate.number_of_events_seen);
+            CHECK(num_events_to_add == skizzay::cddd::version(aggregate));
+          }
+
+          THEN("no page past the first one filtered out was read") {
+            CHECK(num_events_to_add / page_size + 1 ==
+                  counting_client.number_of_queries);
+          }
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("The tail of a DynamoDB event stream can be read",
+         "[unit][dynamodb][event_store]") {
+  dynamodb::event_log_config const event_log_config{
+      "hk",
+      "sk",
+      "ts",
+      "type",
+      "TestEventLog",
+      "ttl",
+      std::chrono::duration_cast<std::chrono::seconds>(std::chrono::years{1})};
+  Aws::SDKOptions options;
+  dynamodb::aws_sdk_raii aws_sdk{options};
+  Aws::Client::ClientConfiguration client_configuration("default");
+  client_configuration.endpointOverride = "http://localhost:4566";
+  Aws::DynamoDB::DynamoDBClient client{client_configuration};
+  dynamodb::event_log_table event_log_table{client, event_log_config};
+  dynamodb::event_dispatcher<test_event<1>, test_event<2>> event_dispatcher{
+      event_log_config};
+  fake_clock clock;
+  std::string aggregate_id = "abcd";
+  fake_aggregate aggregate{aggregate_id};
+
+  event_dispatcher.register_translator("test event 1",
+                                       test_event<1>::from_item);
+  event_dispatcher.register_translator("test event 2",
+                                       test_event<2>::from_item);
+  random_number_generator.next();
+
+  GIVEN("a DynamoDB event source") {
+    dynamodb::event_source target{event_dispatcher, event_log_config, client};
+
+    WHEN("the latest event of a type is requested") {
+      auto const latest =
+          target.latest_event(aggregate_id, event_type<test_event<1>>{});
+
+      THEN("no event was found") { CHECK_FALSE(latest.has_value()); }
+    }
+
+    AND_GIVEN("there are events on the stream") {
+      fake_serializer serializer;
+      dynamodb::event_stream<fake_clock, test_event<1>, test_event<2>>
+          event_stream{aggregate_id, serializer, event_log_config, client,
+                       clock};
+      std::size_t const num_events_to_add = random_number_generator.get() + 1;
+      for (std::size_t i = 0; i != num_events_to_add; ++i) {
+        if (0 == (i % 2)) {
+          skizzay::cddd::add_event(event_stream, test_event<1>{});
+        } else {
+          skizzay::cddd::add_event(event_stream, test_event<2>{});
+        }
+      }
+      skizzay::cddd::commit_events(event_stream, std::size_t{0});
+
+      WHEN("the latest events are loaded") {
+        auto visitor = as_event_visitor<test_event<1>, test_event<2>>(aggregate);
+        target.load_latest(aggregate_id, 2, visitor);
+
+        THEN("only the tail has been applied to the aggregate") {
+          CHECK(2 == aggregate.number_of_events_seen);
+          CHECK(num_events_to_add == skizzay::cddd::version(aggregate));
+        }
+      }
+
+      WHEN("the latest event of a type is requested") {
+        auto const latest =
+            target.latest_event(aggregate_id, event_type<test_event<2>>{});
+
+        THEN("the most recent event of that type was found") {
+          REQUIRE(latest.has_value());
+          CHECK(num_events_to_add - (num_events_to_add % 2) ==
+                skizzay::cddd::version(*latest));
+        }
+      }
+    }
+
+    AND_GIVEN("an event followed by several pages of another type") {
+      int const page_size = 3;
+      int const num_pages = 4;
+      fake_serializer serializer;
+      dynamodb::event_stream<fake_clock, test_event<1>, test_event<2>>
+          event_stream{aggregate_id, serializer, event_log_config, client,
+                       clock};
+      skizzay::cddd::add_event(event_stream, test_event<1>{});
+      for (int i = 0; i != page_size * num_pages; ++i) {
+        skizzay::cddd::add_event(event_stream, test_event<2>{});
+      }
+      skizzay::cddd::commit_events(event_stream, std::size_t{0});
+      query_counting_client counting_client{client_configuration};
+      dynamodb::event_source counted{event_dispatcher, event_log_config,
+                                     counting_client};
+
+      WHEN("the latest event of that type is requested within fewer pages") {
+        auto const latest = counted.latest_event(
+            aggregate_id, event_type<test_event<1>>{}, page_size, num_pages);
+
+        THEN("no event was found") { CHECK_FALSE(latest.has_value()); }
+
+        THEN("no more pages than allowed were read") {
+          CHECK(num_pages == counting_client.number_of_queries);
+        }
+      }
+
+      WHEN("the latest event of that type is requested within enough pages") {
+        auto const latest = counted.latest_event(
+            aggregate_id, event_type<test_event<1>>{}, page_size,
+            num_pages + 1);
+
+        THEN("the event was found") {
+          REQUIRE(latest.has_value());
+          CHECK(1 == skizzay::cddd::version(*latest));
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("Aggregates can be loaded from a snapshot and the events after it",
+         "[unit][dynamodb][event_store]") {
+  dynamodb::event_log_config const event_log_config{
+      "hk",
+      "sk",
+      "ts",
+      "type",
+      "TestEventLog",
+      "ttl",
+      std::chrono::duration_cast<std::chrono::seconds>(std::chrono::years{1})};
+  Aws::SDKOptions options;
+  dynamodb::aws_sdk_raii aws_sdk{options};
+  Aws::Client::ClientConfiguration client_configuration("default");
+  client_configuration.endpointOverride = "http://localhost:4566";
+  Aws::DynamoDB::DynamoDBClient client{client_configuration};
+  dynamodb::event_log_table event_log_table{client, event_log_config};
+  dynamodb::event_dispatcher<test_event<1>, test_event<2>> event_dispatcher{
+      event_log_config};
+  fake_clock clock;
+  std::string aggregate_id = "abcd";
+  fake_aggregate aggregate{aggregate_id};
+  fake_snapshot_serializer snapshot_serializer;
+  dynamodb::snapshot_store<fake_aggregate> snapshots{
+      snapshot_serializer, event_log_config, client};
+  // Small enough pages that the history takes several of them.
+  int const page_size = 4;
+  std::size_t const num_events = 25;
+
+  event_dispatcher.register_translator("test event 1",
+                                       test_event<1>::from_item);
+  event_dispatcher.register_translator("test event 2",
+                                       test_event<2>::from_item);
+
+  GIVEN("a DynamoDB event source over a stream with events") {
+    dynamodb::event_source target{event_dispatcher, event_log_config, client};
+    fake_serializer serializer;
+    dynamodb::event_stream<fake_clock, test_event<1>, test_event<2>>
+        event_stream{aggregate_id, serializer, event_log_config, client, clock};
+    for (std::size_t i = 0; i != num_events; ++i) {
+      if (0 == (i % 2)) {
+        skizzay::cddd::add_event(event_stream, test_event<1>{});
+      } else {
+        skizzay::cddd::add_event(event_stream, test_event<2>{});
+      }
+    }
+    skizzay::cddd::commit_events(event_stream, std::size_t{0});
+    auto const save_snapshot_at = [&](std::size_t const version) {
+      fake_aggregate snapshot{aggregate_id};
+      snapshot.version_ = version;
+      snapshots.save_snapshot(snapshot);
+    };
+
+    WHEN("the aggregate is loaded with no snapshot taken") {
+      target.load_from_snapshot_and_history(snapshots, aggregate, num_events,
+                                            page_size);
+
+      THEN("every event has been applied") {
+        CHECK(0 == aggregate.snapshot_version);
+        CHECK(num_events == aggregate.number_of_events_seen);
+        CHECK(num_events == skizzay::cddd::version(aggregate));
+      }
+    }
+
+    WHEN("the aggregate is loaded from a snapshot newer than the tail page") {
+      save_snapshot_at(num_events - 2);
+      target.load_from_snapshot_and_history(snapshots, aggregate, num_events,
+                                            page_size);
+
+      THEN("only the events after the snapshot have been applied") {
+        CHECK(num_events - 2 == aggregate.snapshot_version);
+        CHECK(2 == aggregate.number_of_events_seen);
+        CHECK(num_events == skizzay::cddd::version(aggregate));
+      }
+    }
+
+    WHEN("the aggregate is loaded from a snapshot older than several pages") {
+      save_snapshot_at(5);
+      target.load_from_snapshot_and_history(snapshots, aggregate, num_events,
+                                            page_size);
+
+      THEN("every event after the snapshot has been applied once") {
+        CHECK(5 == aggregate.snapshot_version);
+        CHECK(num_events - 5 == aggregate.number_of_events_seen);
+        CHECK(num_events == skizzay::cddd::version(aggregate));
+      }
+    }
+
+    WHEN("the aggregate is loaded up to a version below its latest snapshot") {
+      save_snapshot_at(5);
+      save_snapshot_at(20);
+      target.load_from_snapshot_and_history(snapshots, aggregate,
+                                            std::size_t{12}, page_size);
+
+      THEN("the latest snapshot not past the target and the events after it "
+           "up to the target have been applied") {
+        CHECK(5 == aggregate.snapshot_version);
+        CHECK(7 == aggregate.number_of_events_seen);
+        CHECK(12 == skizzay::cddd::version(aggregate));
+      }
     }
   }
-}
\ No newline at end of file
+}
@@ -3,10 +3,14 @@
 #include "skizzay/cddd/dynamodb/aws_sdk_raii.h"
 #include "skizzay/cddd/dynamodb/dynamodb_event_log_table.h"
 #include "skizzay/cddd/event_stream.h"
+#include "skizzay/cddd/optimistic_concurrency_collision.h"
 #include "skizzay/cddd/timestamp.h"
 #include "skizzay/cddd/version.h"
 #include <aws/dynamodb/model/TransactWriteItemsRequest.h>
 #include <catch.hpp>
+#include <future>
+#include <utility>
+#include <vector>
 
 using namespace skizzay::cddd;
 
@@ -43,6 +47,28 @@ struct fake_serializer : dynamodb::serializer<test_event<1>, test_event<2>> {
   }
 };
 
+// Writes the first transaction it is given, but reports it as failed, as when
+// the response is lost after the write has landed.
+struct lost_response_client final : Aws::DynamoDB::DynamoDBClient {
+  using Aws::DynamoDB::DynamoDBClient::DynamoDBClient;
+
+  Aws::DynamoDB::Model::TransactWriteItemsOutcome TransactWriteItems(
+      Aws::DynamoDB::Model::TransactWriteItemsRequest const &request)
+      const override {
+    requests.push_back(request);
+    auto outcome = Aws::DynamoDB::DynamoDBClient::TransactWriteItems(request);
+    if (std::exchange(lose_response, false)) {
+      return Aws::DynamoDB::DynamoDBError{
+          Aws::DynamoDB::DynamoDBErrors::INTERNAL_FAILURE, true};
+    }
+    return outcome;
+  }
+
+  mutable bool lose_response = true;
+  mutable std::vector<Aws::DynamoDB::Model::TransactWriteItemsRequest>
+      requests;
+};
+
 inline auto random_number_generator =
     Catch::Generators::random(std::size_t{1}, std::size_t{50});
 
@@ -76,9 +102,9 @@ SCENARIO("Events can be streamed to DynamoDB",
     target_type target{target_id, serializer, event_log_config, client, clock};
 
     AND_GIVEN("events have been added") {
+      std::size_t const num_events_to_add = random_number_generator.get();
       int one_or_two = 1;
-      for (std::size_t i = 0, num_events_to_add = random_number_generator.get();
-           i != num_events_to_add; ++i) {
+      for (std::size_t i = 0; i != num_events_to_add; ++i) {
         if (1 == one_or_two) {
           skizzay::cddd::add_event(target, test_event<1>{});
           one_or_two = 2;
@@ -91,6 +117,70 @@ SCENARIO("Events can be streamed to DynamoDB",
       WHEN("events are committed") {
         skizzay::cddd::commit_events(target, std::size_t{0});
       }
+
+      WHEN("events are committed asynchronously") {
+        std::future<void> committed =
+            skizzay::cddd::commit_events_async(target, std::size_t{0});
+
+        THEN("the commit completes") { REQUIRE_NOTHROW(committed.get()); }
+      }
+
+      WHEN("events are committed and more are committed after them") {
+        skizzay::cddd::commit_events(target, std::size_t{0});
+        skizzay::cddd::add_event(target, test_event<1>{});
+        skizzay::cddd::add_event(target, test_event<2>{});
+        skizzay::cddd::commit_events(target, num_events_to_add);
+
+        THEN("the version counts the events of both commits") {
+          REQUIRE(num_events_to_add + 2 == skizzay::cddd::version(target));
+        }
+      }
+
+      WHEN("another stream commits at the same version first") {
+        target_type other{target_id, serializer, event_log_config, client,
+                          clock};
+        skizzay::cddd::add_event(other, test_event<1>{});
+        skizzay::cddd::commit_events(other, std::size_t{0});
+
+        THEN("the commit collides") {
+          REQUIRE_THROWS_AS(
+              skizzay::cddd::commit_events(target, std::size_t{0}),
+              optimistic_concurrency_collision);
+        }
+      }
+    }
+
+    AND_GIVEN("a stream whose first commit lands but is reported as failed") {
+      lost_response_client lossy_client{client_configuration};
+      target_type lossy_target{target_id, serializer, event_log_config,
+                               lossy_client, clock};
+      std::size_t const num_events_to_add = random_number_generator.get();
+      for (std::size_t i = 0; i != num_events_to_add; ++i) {
+        skizzay::cddd::add_event(lossy_target, test_event<1>{});
+      }
+      REQUIRE_THROWS(skizzay::cddd::commit_events(lossy_target, std::size_t{0}));
+
+      WHEN("the commit is retried") {
+        skizzay::cddd::commit_events(lossy_target, std::size_t{0});
+
+        THEN("the very same request was sent again") {
+          REQUIRE(2 == std::size(lossy_client.requests));
+          auto const &first = lossy_client.requests.front();
+          auto const &retry = lossy_client.requests.back();
+          REQUIRE(first.GetClientRequestToken() ==
+                  retry.GetClientRequestToken());
+          REQUIRE(num_events_to_add + 1 == std::size(retry.GetTransactItems()));
+          for (auto const &item : retry.GetTransactItems()) {
+            if (item.PutHasBeenSet()) {
+              CHECK(item.GetPut().GetItem().contains("hk"));
+            }
+          }
+        }
+
+        THEN("the events were committed once") {
+          REQUIRE(num_events_to_add == skizzay::cddd::version(lossy_target));
+        }
+      }
     }
   }
 }
\ No newline at end of file
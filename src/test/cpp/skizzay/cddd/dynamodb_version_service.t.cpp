@@ -5,14 +5,20 @@
 #include "skizzay/cddd/dynamodb/dynamodb_event_log_table.h"
 #include "skizzay/cddd/timestamp.h"
 #include "skizzay/cddd/version.h"
+#include <aws/dynamodb/model/BatchGetItemRequest.h>
 #include <aws/dynamodb/model/TransactWriteItemsRequest.h>
+#include <algorithm>
 #include <catch.hpp>
 #include <chrono>
 #include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <optional>
 #include <random>
 #include <string>
 #include <utility>
+#include <vector>
 
 using namespace skizzay::cddd;
 
@@ -31,6 +37,59 @@ template <std::size_t N>
 struct test_event : basic_domain_event<test_event<N>, std::string, std::size_t,
                                        timestamp_t<fake_clock>> {};
 
+// Answers BatchGetItem from a map of versions, leaving the first keys it is
+// asked for unprocessed until num_unprocessed of them have been.
+struct fake_client final : Aws::DynamoDB::DynamoDBClient {
+  using item_type =
+      Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>;
+
+  fake_client(Aws::Client::ClientConfiguration const &client_configuration,
+              dynamodb::event_log_config const &config)
+      : Aws::DynamoDB::DynamoDBClient{client_configuration}, config{config} {}
+
+  Aws::DynamoDB::Model::BatchGetItemOutcome BatchGetItem(
+      Aws::DynamoDB::Model::BatchGetItemRequest const &request) const override {
+    std::lock_guard l_{m};
+    auto const &keys =
+        request.GetRequestItems().at(config.table_name()).GetKeys();
+    request_sizes.push_back(std::size(keys));
+    Aws::Vector<item_type> items;
+    Aws::Vector<item_type> unprocessed;
+    for (item_type const &key : keys) {
+      if (0 != num_unprocessed) {
+        --num_unprocessed;
+        unprocessed.push_back(key);
+        continue;
+      }
+      std::string const id = key.at(config.key_name()).GetS();
+      if (auto const v = versions.find(id); std::end(versions) != v) {
+        items.push_back(
+            {{config.key_name(), dynamodb::attribute_value(id)},
+             {config.max_version_name(),
+              Aws::DynamoDB::Model::AttributeValue{}.SetN(
+                  std::to_string(v->second))}});
+      }
+    }
+    Aws::DynamoDB::Model::BatchGetItemResult result;
+    result.AddResponses(config.table_name(), std::move(items));
+    if (not std::empty(unprocessed)) {
+      result.AddUnprocessedKeys(
+          config.table_name(),
+          Aws::DynamoDB::Model::KeysAndAttributes{}.WithKeys(
+              std::move(unprocessed)));
+    }
+    return Aws::DynamoDB::Model::BatchGetItemOutcome{std::move(result)};
+  }
+
+  dynamodb::event_log_config const &config;
+  std::map<std::string, std::size_t> versions;
+  mutable std::mutex m;
+  mutable std::size_t num_unprocessed = 0;
+  mutable std::vector<std::size_t> request_sizes;
+};
+
+retry_policy const no_delay{3, std::chrono::microseconds{0},
+                            std::chrono::microseconds{0}};
 } // namespace
 
 SCENARIO("Versions can be synced with DynamoDB",
@@ -102,7 +161,8 @@ SCENARIO("Reading and writing versions",
         std::size_t num_items_in_commit = random_number_generator.get();
         auto commit_outcome = client.TransactWriteItems(
             Aws::DynamoDB::Model::TransactWriteItemsRequest{}.AddTransactItems(
-                target.version_record(num_items_in_commit, clock.now())));
+                target.version_record(target_id, num_items_in_commit, 0,
+                                      clock.now())));
         if (commit_outcome.IsSuccess()) {
           AND_WHEN("the version is cached from source") {
             target.update_version(client);
@@ -119,11 +179,12 @@ SCENARIO("Reading and writing versions",
             AND_WHEN("a version record is committed") {
               std::size_t expected_version = num_items_in_commit;
               num_items_in_commit = random_number_generator.get();
-              expected_version += num_items_in_commit;
               commit_outcome = client.TransactWriteItems(
                   Aws::DynamoDB::Model::TransactWriteItemsRequest{}
                       .AddTransactItems(target.version_record(
-                          num_items_in_commit, clock.now())));
+                          target_id, num_items_in_commit, expected_version,
+                          clock.now())));
+              expected_version += num_items_in_commit;
               if (commit_outcome.IsSuccess()) {
                 AND_WHEN("the version is cached from source") {
                   target.update_version(client);
@@ -144,4 +205,80 @@ SCENARIO("Reading and writing versions",
       }
     }
   }
-}
\ No newline at end of file
+}
+
+SCENARIO("The versions of many streams are looked up in batches",
+         "[unit][dynamodb][event_store]") {
+  using target_type = dynamodb::version_lookup<test_event<1>, test_event<2>>;
+  dynamodb::event_log_config const event_log_config{
+      "hk",
+      "sk",
+      "ts",
+      "type",
+      "TestEventLog",
+      "ttl",
+      std::chrono::duration_cast<std::chrono::seconds>(std::chrono::years{1})};
+  Aws::SDKOptions options;
+  dynamodb::aws_sdk_raii aws_sdk{options};
+  Aws::Client::ClientConfiguration client_configuration("default");
+
+  GIVEN("a table holding the versions of some of the streams looked up") {
+    fake_client client{client_configuration, event_log_config};
+    std::vector<std::string> ids;
+    for (std::size_t i = 0; i != 250; ++i) {
+      ids.push_back("stream_" + std::to_string(i));
+      if (0 == i % 2) {
+        client.versions.emplace(ids.back(), i + 1);
+      }
+    }
+
+    WHEN("their versions are looked up") {
+      target_type target{client, event_log_config};
+      auto const versions = target.versions(ids);
+
+      THEN("the keys were requested in batches of at most 100") {
+        REQUIRE(std::vector<std::size_t>{100, 100, 50} ==
+                [&]() {
+                  std::vector<std::size_t> sizes = client.request_sizes;
+                  std::ranges::sort(sizes, std::greater{});
+                  return sizes;
+                }());
+      }
+
+      THEN("streams with a version record resolve to its version and the "
+           "rest to 0") {
+        REQUIRE(std::size(ids) == std::size(versions));
+        for (std::size_t i = 0; i != std::size(ids); ++i) {
+          REQUIRE((0 == i % 2 ? i + 1 : 0) == versions.at(ids[i]));
+        }
+      }
+    }
+
+    WHEN("some keys are left unprocessed") {
+      client.num_unprocessed = 120;
+      target_type target{client, event_log_config};
+      auto const versions = target.versions(ids);
+
+      THEN("they were requested again until processed") {
+        std::size_t num_requested = 0;
+        for (std::size_t const size : client.request_sizes) {
+          num_requested += size;
+        }
+        REQUIRE(std::size(ids) + 120 == num_requested);
+        for (std::size_t i = 0; i != std::size(ids); ++i) {
+          REQUIRE((0 == i % 2 ? i + 1 : 0) == versions.at(ids[i]));
+        }
+      }
+    }
+
+    WHEN("keys are left unprocessed through every attempt") {
+      client.num_unprocessed = std::size(ids) * 3;
+      target_type target{client, event_log_config, no_delay};
+
+      THEN("the lookup fails") {
+        REQUIRE_THROWS_AS(target.versions(ids),
+                          dynamodb::version_lookup_failed);
+      }
+    }
+  }
+}
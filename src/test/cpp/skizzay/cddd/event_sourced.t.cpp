@@ -0,0 +1,190 @@
+#include <skizzay/cddd/event_sourced.h>
+
+#include "skizzay/cddd/aggregate_root.h"
+#include "skizzay/cddd/domain_event.h"
+#include "skizzay/cddd/timestamp.h"
+#include "skizzay/cddd/version.h"
+
+#include <catch.hpp>
+#include <memory>
+#include <span>
+#include <vector>
+
+using namespace skizzay::cddd;
+
+namespace {
+template <std::size_t N>
+struct test_event
+    : basic_domain_event<test_event<N>, std::string, std::size_t,
+                         std::chrono::system_clock::time_point> {};
+
+struct fake_aggregate final {
+  std::string const &id() const noexcept { return id_; }
+  std::size_t version() const noexcept { return version_; }
+
+  template <std::size_t N> void apply(test_event<N> const &event) {
+    version_ = skizzay::cddd::version(event);
+    seen_ += N;
+  }
+
+  std::string id_ = "abcd";
+  std::size_t version_ = 0;
+  std::size_t seen_ = 0;
+};
+
+// Folds runs of the first event type as ranges, recording the length of each
+// run it was handed.
+struct fake_counting_aggregate final {
+  std::string const &id() const noexcept { return id_; }
+  std::size_t version() const noexcept { return version_; }
+
+  void apply_range(std::span<test_event<1> const> const events) {
+    version_ = skizzay::cddd::version(events.back());
+    run_lengths.push_back(std::size(events));
+  }
+
+  template <std::size_t N> void apply(test_event<N> const &event) {
+    version_ = skizzay::cddd::version(event);
+    ++num_applied;
+  }
+
+  std::string id_ = "abcd";
+  std::size_t version_ = 0;
+  std::size_t num_applied = 0;
+  std::vector<std::size_t> run_lengths;
+};
+
+using event_ptr = std::unique_ptr<
+    event_interface<test_event<1>, test_event<2>, test_event<3>, test_event<4>>>;
+
+template <std::size_t N> event_ptr make_event(std::size_t const version) {
+  test_event<N> event;
+  event.version = version;
+  return std::make_unique<event_holder_impl<test_event<N>, test_event<1>,
+                                            test_event<2>, test_event<3>,
+                                            test_event<4>>>(std::move(event));
+}
+
+std::vector<event_ptr> make_history(std::size_t const num_events) {
+  std::vector<event_ptr> history;
+  history.reserve(num_events);
+  for (std::size_t version = 1; version <= num_events; ++version) {
+    switch (version % 4) {
+    case 0:
+      history.push_back(make_event<1>(version));
+      break;
+    case 1:
+      history.push_back(make_event<2>(version));
+      break;
+    case 2:
+      history.push_back(make_event<3>(version));
+      break;
+    default:
+      history.push_back(make_event<4>(version));
+      break;
+    }
+  }
+  return history;
+}
+} // namespace
+
+SCENARIO("Type-erased events are applied through closed-set dispatch",
+         "[unit][event_sourced]") {
+  GIVEN("a history of events of several types") {
+    std::vector<event_ptr> const history = make_history(8);
+
+    WHEN("each event is applied to an aggregate") {
+      fake_aggregate aggregate;
+      for (event_ptr const &event : history) {
+        skizzay::cddd::apply(aggregate, *event);
+      }
+
+      THEN("each event reached the overload for its type") {
+        REQUIRE(8 == aggregate.version());
+        REQUIRE(2 * (1 + 2 + 3 + 4) == aggregate.seen_);
+      }
+
+      THEN("it matches visiting each event") {
+        fake_aggregate visited;
+        auto visitor =
+            as_event_visitor<test_event<1>, test_event<2>, test_event<3>,
+                             test_event<4>>(visited);
+        for (event_ptr const &event : history) {
+          event->accept_event_visitor(visitor);
+        }
+        REQUIRE(visited.version() == aggregate.version());
+        REQUIRE(visited.seen_ == aggregate.seen_);
+      }
+    }
+  }
+}
+
+SCENARIO("Runs of same-typed events are folded as ranges",
+         "[unit][event_sourced]") {
+  GIVEN("an aggregate folding runs of one event type") {
+    fake_counting_aggregate aggregate;
+    auto visitor = as_event_run_visitor<test_event<1>, test_event<2>,
+                                        test_event<3>, test_event<4>>(
+        aggregate);
+
+    WHEN("runs of events are applied through the visitor") {
+      std::size_t version = 0;
+      for (std::size_t const run_length : {3, 1, 2}) {
+        for (std::size_t i = 0; i != run_length; ++i) {
+          test_event<1> event;
+          event.version = ++version;
+          skizzay::cddd::apply(visitor, event);
+        }
+        test_event<2> event;
+        event.version = ++version;
+        skizzay::cddd::apply(visitor, event);
+      }
+      test_event<1> last;
+      last.version = ++version;
+      skizzay::cddd::apply(visitor, last);
+      visitor.flush();
+
+      THEN("each run was handed over whole, in order") {
+        REQUIRE(std::vector<std::size_t>{3, 1, 2, 1} == aggregate.run_lengths);
+        REQUIRE(3 == aggregate.num_applied);
+        REQUIRE(version == aggregate.version());
+      }
+    }
+  }
+
+  GIVEN("an aggregate that has not opted in") {
+    fake_aggregate aggregate;
+    std::vector<test_event<3>> events(4);
+
+    WHEN("a range of events is applied") {
+      skizzay::cddd::apply_range(aggregate,
+                                 std::span<test_event<3> const>{events});
+
+      THEN("each event was applied in turn") {
+        REQUIRE(4 * 3 == aggregate.seen_);
+      }
+    }
+  }
+}
+
+TEST_CASE("Replaying type-erased events", "[.][benchmark][event_sourced]") {
+  std::vector<event_ptr> const history = make_history(4096);
+
+  BENCHMARK("visiting each event") {
+    fake_aggregate aggregate;
+    auto visitor = as_event_visitor<test_event<1>, test_event<2>,
+                                    test_event<3>, test_event<4>>(aggregate);
+    for (event_ptr const &event : history) {
+      event->accept_event_visitor(visitor);
+    }
+    return aggregate.seen_;
+  };
+
+  BENCHMARK("closed-set dispatch") {
+    fake_aggregate aggregate;
+    for (event_ptr const &event : history) {
+      skizzay::cddd::apply(aggregate, *event);
+    }
+    return aggregate.seen_;
+  };
+}
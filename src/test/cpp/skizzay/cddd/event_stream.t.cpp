@@ -0,0 +1,235 @@
+#include <skizzay/cddd/event_stream.h>
+
+#include "skizzay/cddd/commit_failed.h"
+#include "skizzay/cddd/in_memory_event_store.h"
+#include "skizzay/cddd/timestamp.h"
+#include "skizzay/cddd/version.h"
+
+#include <array>
+#include <catch.hpp>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace skizzay::cddd;
+
+namespace {
+struct fake_clock {
+  std::chrono::system_clock::time_point now() noexcept {
+    return skizzay::cddd::now(system_clock);
+  }
+
+  [[no_unique_address]] std::chrono::system_clock system_clock;
+};
+
+template <std::size_t N>
+struct test_event : basic_domain_event<test_event<N>, std::string, std::size_t,
+                                       timestamp_t<fake_clock>> {};
+
+// Too large for the inline buffer of any_event_stream.
+struct fake_large_event_stream {
+  std::size_t version() const noexcept { return version_; }
+
+  template <std::size_t N> void add_event(test_event<N> &&) { ++buffered; }
+
+  void commit_events(std::size_t const expected_version) {
+    REQUIRE(expected_version == version_);
+    version_ += std::exchange(buffered, 0);
+  }
+
+  void rollback() noexcept { buffered = 0; }
+
+  std::size_t version_ = 0;
+  std::size_t buffered = 0;
+  std::array<std::byte, 1024> padding = {};
+};
+
+// Applies its first commit but reports it as failed, as a commit whose
+// acknowledgement was lost would be.
+struct fake_flaky_event_stream
+    : event_stream_base<fake_flaky_event_stream, fake_clock, std::size_t,
+                        test_event<1>, test_event<2>> {
+  fake_flaky_event_stream() : basic_event_stream_base{fake_clock{}} {}
+
+  std::size_t version() const noexcept { return version_; }
+
+  template <std::size_t N> std::size_t make_buffer_element(test_event<N> &&) {
+    return N;
+  }
+
+  void populate_commit_info(timestamp_type const timestamp, std::size_t const,
+                            std::size_t &) {
+    timestamps.push_back(timestamp);
+  }
+
+  void commit_buffered_events(buffer_type &&buffer, timestamp_type const,
+                              std::size_t const expected_version,
+                              commit_id const &commit) {
+    commits.push_back(commit);
+    if (std::ranges::count(commits, commit) == 1) {
+      REQUIRE(expected_version == version_);
+      version_ += std::size(buffer);
+      if (1 == std::size(commits)) {
+        throw commit_failed{"acknowledgement lost"};
+      }
+    }
+  }
+
+  std::size_t version_ = 0;
+  std::vector<commit_id> commits;
+  std::vector<timestamp_type> timestamps;
+};
+
+using any_stream_type = any_event_stream<test_event<1>, test_event<2>>;
+
+using in_memory_event_stream_type =
+    decltype(std::declval<in_memory_event_store<fake_clock, test_event<1>,
+                                                test_event<2>> &>()
+                 .get_event_stream(std::string{}));
+} // namespace
+
+// Erasing the in-memory store's streams must not allocate.
+static_assert(event_stream_details_::fits_inline<in_memory_event_stream_type>);
+
+SCENARIO("Event streams can be held by value behind a uniform interface",
+         "[unit][event_stream]") {
+  in_memory_event_store<fake_clock, test_event<1>, test_event<2>> store;
+  std::string const id = "abc";
+
+  GIVEN("an erased in-memory event stream") {
+    any_stream_type target{store.get_event_stream(id)};
+
+    WHEN("events are added and committed") {
+      add_event(target, test_event<1>{});
+      add_event(target, test_event<2>{});
+      commit_events(target, std::size_t{0});
+
+      THEN("the underlying stream committed them") {
+        REQUIRE(2 == version(target));
+        REQUIRE(store.has_events_for(id));
+      }
+    }
+
+    WHEN("events are added and rolled back") {
+      add_event(target, test_event<1>{});
+      rollback(target);
+      commit_events(target, std::size_t{0});
+
+      THEN("nothing was committed") {
+        REQUIRE(0 == version(target));
+        REQUIRE_FALSE(store.has_events_for(id));
+      }
+    }
+
+    WHEN("events are added and committed asynchronously") {
+      add_event(target, test_event<1>{});
+      std::future<void> committed = commit_events_async(target, std::size_t{0});
+
+      THEN("the underlying stream committed them") {
+        REQUIRE_NOTHROW(committed.get());
+        REQUIRE(1 == version(target));
+      }
+    }
+
+    WHEN("the erased stream is moved") {
+      add_event(target, test_event<1>{});
+      any_stream_type moved{std::move(target)};
+      commit_events(moved, std::size_t{0});
+
+      THEN("the buffered events moved with it") {
+        REQUIRE(1 == version(moved));
+      }
+    }
+  }
+
+  GIVEN("an erased event stream too large to be held inline") {
+    any_stream_type target{fake_large_event_stream{}};
+
+    WHEN("events are added, the stream is moved and then committed") {
+      add_event(target, test_event<1>{});
+      add_event(target, test_event<2>{});
+      any_stream_type moved{fake_large_event_stream{}};
+      moved = std::move(target);
+      commit_events(moved, std::size_t{0});
+
+      THEN("the underlying stream committed them") {
+        REQUIRE(2 == version(moved));
+      }
+    }
+
+    WHEN("events are committed asynchronously") {
+      add_event(target, test_event<1>{});
+      std::future<void> committed = commit_events_async(target, std::size_t{0});
+
+      THEN("the stream, having no asynchronous commit, committed them") {
+        REQUIRE(std::future_status::ready ==
+                committed.wait_for(std::chrono::seconds{0}));
+        REQUIRE(1 == version(target));
+      }
+    }
+  }
+}
+
+SCENARIO("Event streams retry failed commits idempotently",
+         "[unit][event_stream]") {
+  GIVEN("an event stream whose first commit lands but is reported failed") {
+    fake_flaky_event_stream target;
+    add_event(target, test_event<1>{});
+    add_event(target, test_event<2>{});
+
+    WHEN("the events are committed") {
+      REQUIRE_THROWS_AS(commit_events(target, std::size_t{0}), commit_failed);
+
+      AND_WHEN("the commit is retried") {
+        REQUIRE_NOTHROW(commit_events(target, std::size_t{0}));
+
+        THEN("the very same commit was sent again and applied once") {
+          REQUIRE(2 == std::size(target.commits));
+          REQUIRE(target.commits.front() == target.commits.back());
+          REQUIRE(target.timestamps.front() == target.timestamps.back());
+          REQUIRE(2 == version(target));
+        }
+      }
+
+      AND_WHEN("the commit is rolled back instead") {
+        rollback(target);
+        commit_events(target, std::size_t{2});
+
+        THEN("nothing is sent again") {
+          REQUIRE(1 == std::size(target.commits));
+        }
+      }
+
+      AND_WHEN("another event is added and committed instead") {
+        add_event(target, test_event<1>{});
+        REQUIRE_NOTHROW(commit_events(target, std::size_t{2}));
+
+        THEN("only it was sent, as a new commit") {
+          REQUIRE(2 == std::size(target.commits));
+          REQUIRE(target.commits.front() != target.commits.back());
+          REQUIRE(3 == version(target));
+        }
+      }
+
+      AND_WHEN("the events are committed at another expected version") {
+        REQUIRE_NOTHROW(commit_events(target, std::size_t{2}));
+
+        THEN("the failed commit's events were dropped, not sent again") {
+          REQUIRE(1 == std::size(target.commits));
+          REQUIRE(2 == version(target));
+        }
+
+        AND_WHEN("the commit is retried at its own expected version") {
+          REQUIRE_NOTHROW(commit_events(target, std::size_t{0}));
+
+          THEN("nothing is sent again") {
+            REQUIRE(1 == std::size(target.commits));
+          }
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,67 @@
+#include <skizzay/cddd/file_blob_store.h>
+
+#include <algorithm>
+#include <catch.hpp>
+#include <cstddef>
+#include <filesystem>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace skizzay::cddd;
+
+namespace {
+struct temporary_directory {
+  ~temporary_directory() { std::filesystem::remove_all(value); }
+
+  std::filesystem::path value =
+      std::filesystem::temp_directory_path() /
+      ("cddd-blob-store-" + std::to_string(std::random_device{}()));
+};
+
+std::vector<std::byte> bytes_of(std::string const &value) {
+  std::vector<std::byte> result;
+  std::ranges::transform(value, std::back_inserter(result),
+                         [](char const c) { return std::byte(c); });
+  return result;
+}
+
+std::size_t number_of_files(std::filesystem::path const &root) {
+  return static_cast<std::size_t>(std::ranges::count_if(
+      std::filesystem::recursive_directory_iterator{root},
+      [](auto const &entry) { return entry.is_regular_file(); }));
+}
+} // namespace
+
+SCENARIO("Blobs are kept in files of their own", "[unit][blob_store]") {
+  temporary_directory root;
+  file_blob_store target{root.value};
+  std::string const key = "0123456789abcdef";
+  std::vector<std::byte> const data = bytes_of("some large payload");
+
+  GIVEN("a blob that was put") {
+    target.put_blob(key, data);
+
+    WHEN("it is got back") {
+      blob const result = target.get_blob(key);
+
+      THEN("it holds the same bytes") { REQUIRE(data == *result); }
+    }
+
+    WHEN("the same content is put again under its key") {
+      REQUIRE_NOTHROW(target.put_blob(key, data));
+
+      THEN("the blob is unchanged and no other file was left behind") {
+        REQUIRE(data == *target.get_blob(key));
+        REQUIRE(1 == number_of_files(root.value));
+      }
+    }
+  }
+
+  GIVEN("a key that was never put") {
+    THEN("getting it fails") {
+      REQUIRE_THROWS_AS(target.get_blob("fedcba9876543210"), blob_not_found);
+    }
+  }
+}
@@ -7,6 +7,10 @@
 #include "skizzay/cddd/version.h"
 
 #include <catch.hpp>
+#include <future>
+#include <memory_resource>
+#include <stdexcept>
+#include <vector>
 
 using namespace skizzay::cddd;
 
@@ -41,6 +45,27 @@ struct fake_aggregate {
 };
 
 using version_type = version_t<test_event<0>, test_event<1>, test_event<2>>;
+
+struct counting_resource final : std::pmr::memory_resource {
+  std::size_t allocations = 0;
+
+private:
+  void *do_allocate(std::size_t const bytes,
+                    std::size_t const alignment) override {
+    ++allocations;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void *const p, std::size_t const bytes,
+                     std::size_t const alignment) override {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+
+  bool do_is_equal(
+      std::pmr::memory_resource const &other) const noexcept override {
+    return this == &other;
+  }
+};
 } // namespace
 
 SCENARIO("In-memory event store provides an event stream",
@@ -206,4 +231,135 @@ SCENARIO("In-memory event store provides an event source",
       }
     }
   }
-}
\ No newline at end of file
+}
+SCENARIO("In-memory event sources load aggregates as of a time",
+         "[unit][in_memory][event_store][event_source]") {
+  GIVEN("events streamed for id=\"abc\" in two commits") {
+    in_memory_event_store<fake_clock, test_event<1>, test_event<2>> target;
+    std::string id = "abc";
+    {
+      auto event_stream = get_event_stream(target, std::as_const(id));
+      add_event(event_stream, test_event<1>{id});
+      add_event(event_stream, test_event<2>{id});
+      commit_events(event_stream, 0);
+      add_event(event_stream, test_event<1>{id});
+      commit_events(event_stream, 2);
+    }
+    auto event_source = get_event_source(target, id);
+    fake_aggregate latest{id};
+    load_from_history(event_source, latest);
+    REQUIRE(3 == std::size(latest.events));
+    auto const first_commit = std::visit(
+        [](auto const &domain_event) { return timestamp(domain_event); },
+        latest.events[1]);
+    fake_aggregate aggregate{id};
+
+    WHEN("the aggregate is loaded as of the first commit") {
+      load_as_of(event_source, aggregate, first_commit);
+
+      THEN("only the first commit's events were loaded") {
+        REQUIRE(2 == std::size(aggregate.events));
+        REQUIRE(2 == version(aggregate));
+      }
+    }
+
+    WHEN("the aggregate is loaded as of a time before its first commit") {
+      load_as_of(event_source, aggregate,
+                 first_commit - std::chrono::nanoseconds{1});
+
+      THEN("no events were loaded") {
+        REQUIRE(std::empty(aggregate.events));
+        REQUIRE(0 == version(aggregate));
+      }
+    }
+
+    WHEN("the aggregate is loaded as of the last commit") {
+      auto const last_commit = std::visit(
+          [](auto const &domain_event) { return timestamp(domain_event); },
+          latest.events[2]);
+      load_as_of(event_source, aggregate, last_commit);
+
+      THEN("all of the events were loaded") {
+        REQUIRE(3 == version(aggregate));
+      }
+    }
+  }
+}
+
+SCENARIO("In-memory event stores allocate from the given memory resources",
+         "[unit][in_memory][event_store][event_stream]") {
+  GIVEN("an in-memory event store over a memory resource") {
+    counting_resource store_resource;
+    in_memory_event_store<fake_clock, test_event<1>, test_event<2>> target{
+        &store_resource};
+    std::string const id = "abc";
+
+    WHEN("more events than are buffered inline are committed through a "
+         "stream over another resource") {
+      counting_resource command_resource;
+      auto event_stream = target.get_event_stream(id, &command_resource);
+      for (std::size_t i = 0; i != 2 * default_event_buffer_capacity; ++i) {
+        add_event(event_stream, test_event<1>{});
+      }
+      commit_events(event_stream, 0);
+
+      THEN("the uncommitted events were buffered in the stream's resource") {
+        REQUIRE(0 < command_resource.allocations);
+      }
+
+      THEN("the committed events are stored in the store's resource") {
+        REQUIRE(0 < store_resource.allocations);
+        REQUIRE(2 * default_event_buffer_capacity == version(event_stream));
+      }
+    }
+  }
+}
+
+SCENARIO("In-memory event streams commit asynchronously",
+         "[unit][in_memory][event_store][event_stream]") {
+  GIVEN("an in-memory event stream") {
+    in_memory_event_store<fake_clock, test_event<1>, test_event<2>> target;
+    std::string const id = "abc";
+    auto event_stream = target.get_event_stream(id);
+
+    WHEN("several commits are issued without waiting") {
+      std::vector<std::future<void>> commits;
+      for (std::size_t i = 0; i != 8; ++i) {
+        add_event(event_stream, test_event<1>{});
+        add_event(event_stream, test_event<2>{});
+        commits.push_back(commit_events_async(event_stream, 2 * i));
+      }
+
+      THEN("they complete in order") {
+        for (std::future<void> &commit : commits) {
+          REQUIRE_NOTHROW(commit.get());
+        }
+        REQUIRE(16 == version(event_stream));
+      }
+
+      AND_WHEN("the stream commits synchronously") {
+        add_event(event_stream, test_event<1>{});
+
+        THEN("the commit is refused") {
+          REQUIRE_THROWS_AS(commit_events(event_stream, 16), std::logic_error);
+        }
+
+        THEN("the events are still buffered for an asynchronous commit") {
+          REQUIRE_THROWS(commit_events(event_stream, 16));
+          REQUIRE_NOTHROW(commit_events_async(event_stream, 16).get());
+          REQUIRE(17 == version(event_stream));
+        }
+      }
+    }
+
+    WHEN("a commit is issued against a stale version") {
+      add_event(event_stream, test_event<1>{});
+      std::future<void> commit = commit_events_async(event_stream, 3);
+
+      THEN("the collision is reported through the future") {
+        REQUIRE_THROWS_AS(commit.get(), optimistic_concurrency_collision);
+        REQUIRE(0 == version(event_stream));
+      }
+    }
+  }
+}
@@ -0,0 +1,247 @@
+#include <skizzay/cddd/kafka/kafka_event_source.h>
+
+#include "skizzay/cddd/event_sourced.h"
+#include "skizzay/cddd/kafka/kafka_event_store.h"
+#include "kafka_test_fixtures.h"
+#include <catch.hpp>
+#include <thread>
+
+using namespace skizzay::cddd;
+using namespace skizzay::cddd::kafka_test;
+
+namespace {
+struct fake_aggregate final {
+  explicit fake_aggregate(std::string id) : id_{std::move(id)} {}
+
+  std::string const &id() const noexcept { return id_; }
+  std::size_t version() const noexcept { return version_; }
+
+  template <std::size_t N> void apply(test_event<N> const &event) {
+    CHECK(skizzay::cddd::id(event) == skizzay::cddd::id(*this));
+    CHECK(skizzay::cddd::version(event) == version_ + 1);
+    this->version_ = skizzay::cddd::version(event);
+    ++number_of_events_seen;
+  }
+
+  std::string id_;
+  std::size_t version_ = 0;
+  std::size_t number_of_events_seen = 0;
+};
+
+// Reads the first event type straight from its payload, without it being
+// decoded.
+struct fake_view_aggregate final {
+  explicit fake_view_aggregate(std::string id) : id_{std::move(id)} {}
+
+  std::string const &id() const noexcept { return id_; }
+  std::size_t version() const noexcept { return version_; }
+
+  void apply(kafka::event_view<test_event<1>> const &event_view) {
+    CHECK(1 == std::size(event_view.representation()));
+    version_ = skizzay::cddd::version(event_view);
+    ++number_of_views_seen;
+  }
+
+  template <std::size_t N> void apply(test_event<N> const &event) {
+    version_ = skizzay::cddd::version(event);
+    ++number_of_events_seen;
+  }
+
+  std::string id_;
+  std::size_t version_ = 0;
+  std::size_t number_of_views_seen = 0;
+  std::size_t number_of_events_seen = 0;
+};
+} // namespace
+
+SCENARIO("Aggregates can be loaded from a Kafka event source",
+         "[unit][kafka][event_store]") {
+  mock_cluster cluster;
+  kafka::event_log_config const config =
+      kafka::event_log_config{cluster.bootstrap_servers(), "test-event-log"}
+          .with_linger(std::chrono::milliseconds{1});
+  fake_serializer serializer;
+  kafka::event_dispatcher<test_event<1>, test_event<2>> event_dispatcher;
+  event_dispatcher.register_translator("test event 1",
+                                       test_event<1>::from_payload);
+  event_dispatcher.register_translator("test event 2",
+                                       test_event<2>::from_payload);
+  temporary_path index_path;
+  kafka::offset_index index{index_path.value};
+  store_type store{config, serializer, event_dispatcher, index};
+  std::string const aggregate_id = "abcd";
+  fake_aggregate aggregate{aggregate_id};
+
+  GIVEN("a stream with no events") {
+    WHEN("an aggregate is loaded from history") {
+      auto target = store.get_event_source(aggregate_id);
+      skizzay::cddd::load_from_history(target, aggregate);
+
+      THEN("no events have been applied to the aggregate") {
+        CHECK(0 == aggregate.number_of_events_seen);
+      }
+    }
+  }
+
+  GIVEN("events committed for the aggregate and for another one") {
+    auto other_stream = store.get_event_stream(std::string{"other"});
+    auto stream = store.get_event_stream(aggregate_id);
+    for (std::size_t i = 0; i != 5; ++i) {
+      skizzay::cddd::add_event(stream, test_event<1>{});
+      skizzay::cddd::add_event(stream, test_event<2>{});
+      skizzay::cddd::add_event(other_stream, test_event<1>{});
+      skizzay::cddd::commit_events(stream, 2 * i);
+      skizzay::cddd::commit_events(other_stream, i);
+    }
+
+    WHEN("the aggregate is loaded up to a target version") {
+      auto target = store.get_event_source(aggregate_id);
+      skizzay::cddd::load_from_history(target, aggregate, std::size_t{7});
+
+      THEN("only its events up to the target have been applied") {
+        REQUIRE(7 == aggregate.number_of_events_seen);
+        REQUIRE(7 == aggregate.version());
+      }
+    }
+
+    WHEN("an aggregate applying views is loaded from history") {
+      fake_view_aggregate view_aggregate{aggregate_id};
+      auto target = store.get_event_source(aggregate_id);
+      skizzay::cddd::load_from_history(target, view_aggregate);
+
+      THEN("it was handed views of the events it reads from their payload") {
+        REQUIRE(10 == view_aggregate.version());
+        REQUIRE(5 == view_aggregate.number_of_views_seen);
+        REQUIRE(5 == view_aggregate.number_of_events_seen);
+      }
+    }
+
+    WHEN("the aggregate is loaded by a store with an empty index") {
+      temporary_path other_index_path;
+      kafka::offset_index other_index{other_index_path.value};
+      store_type other_store{config, serializer, event_dispatcher,
+                             other_index};
+      other_store.catch_up();
+      auto target = other_store.get_event_source(aggregate_id);
+      skizzay::cddd::load_from_history(target, aggregate);
+
+      THEN("catching up has indexed every event") {
+        REQUIRE(10 == other_index.version(aggregate_id));
+        REQUIRE(5 == other_index.version("other"));
+        REQUIRE(10 == aggregate.number_of_events_seen);
+      }
+
+      THEN("new streams continue from the indexed version") {
+        REQUIRE(10 == skizzay::cddd::version(
+                           other_store.get_event_stream(aggregate_id)));
+      }
+    }
+
+    WHEN("a store that handed out a stream catches up on another's commits") {
+      temporary_path other_index_path;
+      kafka::offset_index other_index{other_index_path.value};
+      store_type other_store{config, serializer, event_dispatcher,
+                             other_index};
+      auto stale_stream = other_store.get_event_stream(aggregate_id);
+      other_store.catch_up();
+
+      THEN("the stream continues from the indexed version") {
+        REQUIRE(10 == skizzay::cddd::version(stale_stream));
+      }
+    }
+
+    WHEN("the aggregate is loaded as of a time after its last commit") {
+      auto target = store.get_event_source(aggregate_id);
+      skizzay::cddd::load_as_of(target, aggregate,
+                                std::chrono::system_clock::now());
+
+      THEN("every event has been applied") {
+        REQUIRE(10 == aggregate.version());
+      }
+    }
+
+    WHEN("the index is reopened from disk") {
+      kafka::offset_index reopened_index{index_path.value};
+
+      THEN("it holds the offsets recorded on delivery") {
+        REQUIRE(10 == reopened_index.version(aggregate_id));
+        REQUIRE(index.offsets(aggregate_id, 1, 10) ==
+                reopened_index.offsets(aggregate_id, 1, 10));
+      }
+    }
+
+    WHEN("the index is reopened after an append was cut short") {
+      index.flush();
+      std::filesystem::resize_file(
+          index_path.value, std::filesystem::file_size(index_path.value) - 1);
+      kafka::offset_index reopened_index{index_path.value};
+      store_type other_store{config, serializer, event_dispatcher,
+                             reopened_index};
+
+      THEN("it is stale") { REQUIRE(reopened_index.stale()); }
+
+      AND_WHEN("the store catches up") {
+        other_store.catch_up();
+
+        THEN("the offsets cut from the file have been indexed again") {
+          REQUIRE_FALSE(reopened_index.stale());
+          REQUIRE(10 == reopened_index.version(aggregate_id));
+          REQUIRE(index.offsets(aggregate_id, 1, 10) ==
+                  reopened_index.offsets(aggregate_id, 1, 10));
+        }
+      }
+    }
+
+    WHEN("a store catches up from past the aggregate's first versions") {
+      temporary_path other_index_path;
+      kafka::offset_index other_index{other_index_path.value};
+      std::int32_t const partition = *index.partition(aggregate_id);
+      other_index.checkpoint(partition,
+                             index.offsets(aggregate_id, 6, 6).front());
+      store_type other_store{config, serializer, event_dispatcher,
+                             other_index};
+      other_store.catch_up();
+
+      THEN("the aggregate's later versions have been skipped") {
+        REQUIRE(0 == other_index.version(aggregate_id));
+        REQUIRE(index.offsets(aggregate_id, 10, 10).front() <
+                *other_index.next_offset(partition));
+      }
+    }
+  }
+
+  GIVEN("events committed for the aggregate before and after a point in "
+        "time") {
+    auto stream = store.get_event_stream(aggregate_id);
+    skizzay::cddd::add_event(stream, test_event<1>{});
+    skizzay::cddd::add_event(stream, test_event<2>{});
+    skizzay::cddd::commit_events(stream, std::size_t{0});
+    skizzay::cddd::add_event(stream, test_event<1>{});
+    skizzay::cddd::commit_events(stream, std::size_t{2});
+    std::this_thread::sleep_for(std::chrono::milliseconds{5});
+    auto const as_of = std::chrono::system_clock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds{5});
+    skizzay::cddd::add_event(stream, test_event<2>{});
+    skizzay::cddd::commit_events(stream, std::size_t{3});
+
+    WHEN("the aggregate is loaded as of that time") {
+      auto target = store.get_event_source(aggregate_id);
+      skizzay::cddd::load_as_of(target, aggregate, as_of);
+
+      THEN("only the events committed by then have been applied") {
+        REQUIRE(3 == aggregate.number_of_events_seen);
+        REQUIRE(3 == aggregate.version());
+      }
+    }
+
+    WHEN("the aggregate is loaded as of a time before any commit") {
+      auto target = store.get_event_source(aggregate_id);
+      skizzay::cddd::load_as_of(target, aggregate,
+                                as_of - std::chrono::hours{1});
+
+      THEN("no events have been applied") {
+        REQUIRE(0 == aggregate.number_of_events_seen);
+      }
+    }
+  }
+}
@@ -0,0 +1,110 @@
+#include <skizzay/cddd/kafka/kafka_event_store.h>
+
+#include "skizzay/cddd/event_stream.h"
+#include "skizzay/cddd/optimistic_concurrency_collision.h"
+#include "skizzay/cddd/timestamp.h"
+#include "skizzay/cddd/version.h"
+#include "kafka_test_fixtures.h"
+#include <catch.hpp>
+#include <future>
+
+using namespace skizzay::cddd;
+using namespace skizzay::cddd::kafka_test;
+
+// Erasing the Kafka store's streams must not allocate.
+static_assert(event_stream_details_::fits_inline<
+              kafka::event_stream<fake_clock, test_event<1>, test_event<2>>>);
+
+SCENARIO("Events can be streamed to Kafka", "[unit][kafka][event_store]") {
+  fake_serializer serializer;
+  kafka::event_dispatcher<test_event<1>, test_event<2>> event_dispatcher;
+  temporary_path index_path;
+  kafka::offset_index index{index_path.value};
+  std::string const target_id = "target_id_value";
+
+  GIVEN("an event store backed by a mock Kafka cluster") {
+    mock_cluster cluster;
+    kafka::event_log_config const config =
+        kafka::event_log_config{cluster.bootstrap_servers(), "test-event-log"}
+            .with_linger(std::chrono::milliseconds{1});
+    store_type store{config, serializer, event_dispatcher, index};
+    auto target = store.get_event_stream(target_id);
+
+    THEN("the stream starts empty") {
+      REQUIRE(0 == skizzay::cddd::version(target));
+    }
+
+    AND_GIVEN("events have been added") {
+      skizzay::cddd::add_event(target, test_event<1>{});
+      skizzay::cddd::add_event(target, test_event<2>{});
+      skizzay::cddd::add_event(target, test_event<1>{});
+
+      WHEN("events are committed") {
+        skizzay::cddd::commit_events(target, std::size_t{0});
+
+        THEN("the stream version accounts for the delivered events") {
+          REQUIRE(3 == skizzay::cddd::version(target));
+          REQUIRE(3 == skizzay::cddd::version(
+                           store.get_event_stream(target_id)));
+        }
+
+        THEN("the delivered events are indexed") {
+          REQUIRE(3 == index.version(target_id));
+        }
+
+        AND_WHEN("more events are committed against a stale version") {
+          skizzay::cddd::add_event(target, test_event<2>{});
+
+          THEN("an optimistic concurrency collision is reported") {
+            REQUIRE_THROWS_AS(
+                skizzay::cddd::commit_events(target, std::size_t{1}),
+                optimistic_concurrency_collision);
+            REQUIRE(3 == skizzay::cddd::version(target));
+          }
+        }
+      }
+
+      WHEN("events are committed asynchronously, followed by more") {
+        std::future<void> first =
+            skizzay::cddd::commit_events_async(target, std::size_t{0});
+        skizzay::cddd::add_event(target, test_event<2>{});
+        std::future<void> second =
+            skizzay::cddd::commit_events_async(target, std::size_t{3});
+
+        THEN("both commits complete, in order") {
+          REQUIRE_NOTHROW(first.get());
+          REQUIRE_NOTHROW(second.get());
+          REQUIRE(4 == skizzay::cddd::version(target));
+          REQUIRE(4 == index.version(target_id));
+        }
+      }
+    }
+  }
+
+  GIVEN("an event store whose broker cannot be reached") {
+    kafka::event_log_config const config =
+        kafka::event_log_config{"127.0.0.1:1", "test-event-log"}
+            .with_delivery_timeout(std::chrono::milliseconds{100});
+    store_type store{config, serializer, event_dispatcher, index};
+    auto target = store.get_event_stream(target_id);
+    skizzay::cddd::add_event(target, test_event<1>{});
+
+    WHEN("events are committed") {
+      THEN("the commit fails once delivery times out") {
+        REQUIRE_THROWS_AS(skizzay::cddd::commit_events(target, std::size_t{0}),
+                          commit_failed);
+        REQUIRE(0 == skizzay::cddd::version(target));
+      }
+    }
+
+    WHEN("events are committed asynchronously") {
+      std::future<void> committed =
+          skizzay::cddd::commit_events_async(target, std::size_t{0});
+
+      THEN("the failure is reported through the future") {
+        REQUIRE_THROWS_AS(committed.get(), commit_failed);
+        REQUIRE(0 == skizzay::cddd::version(target));
+      }
+    }
+  }
+}
@@ -0,0 +1,147 @@
+#include <skizzay/cddd/kafka/kafka_projection_runner.h>
+
+#include "skizzay/cddd/event_stream.h"
+#include "skizzay/cddd/kafka/kafka_event_store.h"
+#include "skizzay/cddd/timestamp.h"
+#include "skizzay/cddd/version.h"
+#include "kafka_test_fixtures.h"
+#include <catch.hpp>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <thread>
+
+using namespace skizzay::cddd;
+using namespace skizzay::cddd::kafka_test;
+
+namespace {
+// Records the versions projected per aggregate, and whether any batch ever
+// held two runs for the same aggregate.
+struct fake_projection : kafka::projection<test_event<1>, test_event<2>> {
+  void project(std::span<kafka::event_run<test_event<1>, test_event<2>>> const
+                   runs) override {
+    std::lock_guard l_{m};
+    std::set<std::string> ids;
+    for (auto const &run : runs) {
+      split_runs = split_runs || not ids.insert(run.id).second;
+      for (auto const &event : run.events) {
+        versions[run.id].push_back(event->version());
+      }
+      num_events += std::size(run.events);
+    }
+    cv.notify_all();
+  }
+
+  bool wait_for(std::size_t const expected_num_events) {
+    std::unique_lock l_{m};
+    return cv.wait_for(l_, std::chrono::seconds{30}, [&, this]() {
+      return expected_num_events <= num_events;
+    });
+  }
+
+  std::mutex m;
+  std::condition_variable cv;
+  std::map<std::string, std::vector<std::size_t>> versions;
+  std::size_t num_events = 0;
+  bool split_runs = false;
+};
+
+using runner_type = kafka::projection_runner<test_event<1>, test_event<2>>;
+
+struct running_projection {
+  running_projection(kafka::event_log_config const &config,
+                     kafka::projection_config const &options,
+                     kafka::event_dispatcher<test_event<1>, test_event<2>> const
+                         &event_dispatcher,
+                     fake_projection &target)
+      : runner{config, options, event_dispatcher, target},
+        thread{[this]() { runner.run(); }} {}
+
+  ~running_projection() {
+    runner.stop();
+    thread.join();
+  }
+
+  runner_type runner;
+  std::thread thread;
+};
+
+void commit_test_events(store_type &store, std::string const &id,
+                        std::size_t const num_events) {
+  auto stream = store.get_event_stream(id);
+  std::size_t const expected_version = skizzay::cddd::version(stream);
+  for (std::size_t i = 0; i != num_events; ++i) {
+    skizzay::cddd::add_event(stream, test_event<1>{});
+    skizzay::cddd::add_event(stream, test_event<2>{});
+  }
+  skizzay::cddd::commit_events(stream, expected_version);
+}
+} // namespace
+
+SCENARIO("Events can be projected from a Kafka event log",
+         "[unit][kafka][projection]") {
+  mock_cluster cluster;
+  kafka::event_log_config const config =
+      kafka::event_log_config{cluster.bootstrap_servers(), "test-event-log"}
+          .with_linger(std::chrono::milliseconds{1});
+  // The mock cluster only lets a restarted projection rejoin its group once
+  // the session of the member that left has expired.
+  kafka::projection_config const options =
+      kafka::projection_config{"test-projection"}
+          .with_max_batch_size(16)
+          .with_property("session.timeout.ms", "6000");
+  fake_serializer serializer;
+  kafka::event_dispatcher<test_event<1>, test_event<2>> event_dispatcher;
+  event_dispatcher.register_translator("test event 1",
+                                       test_event<1>::from_payload);
+  event_dispatcher.register_translator("test event 2",
+                                       test_event<2>::from_payload);
+  temporary_path index_path;
+  kafka::offset_index index{index_path.value};
+  store_type store{config, serializer, event_dispatcher, index};
+
+  GIVEN("events committed for several aggregates") {
+    for (std::size_t i = 0; i != 8; ++i) {
+      commit_test_events(store, "aggregate-" + std::to_string(i), 5);
+    }
+
+    WHEN("a projection runs over the event log") {
+      fake_projection target;
+      {
+        running_projection running{config, options, event_dispatcher, target};
+        REQUIRE(target.wait_for(80));
+      }
+
+      THEN("every aggregate's events were projected once, in order") {
+        REQUIRE(8 == std::size(target.versions));
+        for (auto const &[id, versions] : target.versions) {
+          std::vector<std::size_t> expected(10);
+          std::iota(std::begin(expected), std::end(expected), 1);
+          REQUIRE(expected == versions);
+        }
+      }
+
+      THEN("each batch held one run per aggregate") {
+        REQUIRE_FALSE(target.split_runs);
+      }
+
+      AND_WHEN("the projection restarts after more events are committed") {
+        commit_test_events(store, "aggregate-0", 1);
+        fake_projection restarted;
+        {
+          running_projection running{config, options, event_dispatcher,
+                                     restarted};
+          REQUIRE(restarted.wait_for(2));
+        }
+
+        THEN("it resumes from the committed offsets") {
+          REQUIRE(1 == std::size(restarted.versions));
+          REQUIRE(std::vector<std::size_t>{11, 12} ==
+                  restarted.versions["aggregate-0"]);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,113 @@
+#include <skizzay/cddd/kafka/kafka_snapshot_store.h>
+
+#include "skizzay/cddd/event_sourced.h"
+#include "skizzay/cddd/kafka/kafka_event_store.h"
+#include "kafka_test_fixtures.h"
+#include <catch.hpp>
+#include <cstring>
+
+using namespace skizzay::cddd;
+using namespace skizzay::cddd::kafka_test;
+
+namespace {
+struct fake_aggregate final {
+  explicit fake_aggregate(std::string id) : id_{std::move(id)} {}
+
+  std::string const &id() const noexcept { return id_; }
+  std::size_t version() const noexcept { return version_; }
+
+  template <std::size_t N> void apply(test_event<N> const &event) {
+    CHECK(skizzay::cddd::id(event) == skizzay::cddd::id(*this));
+    CHECK(skizzay::cddd::version(event) == version_ + 1);
+    this->version_ = skizzay::cddd::version(event);
+    ++number_of_events_seen;
+  }
+
+  std::string id_;
+  std::size_t version_ = 0;
+  std::size_t number_of_events_seen = 0;
+};
+
+// Snapshots hold nothing but the aggregate's version.
+struct fake_snapshot_serializer : kafka::snapshot_serializer<fake_aggregate> {
+  std::pmr::vector<std::byte>
+  serialize(fake_aggregate const &aggregate,
+            std::pmr::memory_resource *const resource) const override {
+    std::pmr::vector<std::byte> result(sizeof(aggregate.version_), resource);
+    std::memcpy(std::data(result), &aggregate.version_, std::size(result));
+    return result;
+  }
+
+  void deserialize(std::span<std::byte const> const payload,
+                   fake_aggregate &aggregate) const override {
+    REQUIRE(sizeof(aggregate.version_) == std::size(payload));
+    std::memcpy(&aggregate.version_, std::data(payload), std::size(payload));
+  }
+};
+} // namespace
+
+SCENARIO("Aggregates can be loaded from a Kafka snapshot topic",
+         "[unit][kafka][snapshot]") {
+  mock_cluster cluster{{"test-event-log", "test-event-log.snapshots"}};
+  kafka::event_log_config const config =
+      kafka::event_log_config{cluster.bootstrap_servers(), "test-event-log"}
+          .with_linger(std::chrono::milliseconds{1});
+  fake_serializer serializer;
+  fake_snapshot_serializer snapshot_serializer;
+  kafka::event_dispatcher<test_event<1>, test_event<2>> event_dispatcher;
+  event_dispatcher.register_translator("test event 1",
+                                       test_event<1>::from_payload);
+  event_dispatcher.register_translator("test event 2",
+                                       test_event<2>::from_payload);
+  temporary_path index_path;
+  kafka::offset_index index{index_path.value};
+  store_type store{config, serializer, event_dispatcher, index};
+  kafka::snapshot_store<fake_aggregate> snapshots{snapshot_serializer, config};
+  std::string const aggregate_id = "abcd";
+  fake_aggregate aggregate{aggregate_id};
+
+  GIVEN("ten events committed and a snapshot taken at version six") {
+    auto stream = store.get_event_stream(aggregate_id);
+    for (std::size_t i = 0; i != 5; ++i) {
+      skizzay::cddd::add_event(stream, test_event<1>{});
+      skizzay::cddd::add_event(stream, test_event<2>{});
+      skizzay::cddd::commit_events(stream, 2 * i);
+    }
+    fake_aggregate snapshotted{aggregate_id};
+    snapshotted.version_ = 6;
+    snapshots.save_snapshot(snapshotted);
+
+    WHEN("the aggregate is loaded from the snapshot and history") {
+      auto target = store.get_event_source(aggregate_id);
+      target.load_from_snapshot_and_history(snapshots, aggregate,
+                                            std::size_t{10});
+
+      THEN("only the events after the snapshot have been replayed") {
+        REQUIRE(10 == aggregate.version());
+        REQUIRE(4 == aggregate.number_of_events_seen);
+      }
+    }
+
+    WHEN("the aggregate is loaded to a version before the snapshot") {
+      auto target = store.get_event_source(aggregate_id);
+      target.load_from_snapshot_and_history(snapshots, aggregate,
+                                            std::size_t{5});
+
+      THEN("the snapshot is ignored") {
+        REQUIRE(5 == aggregate.version());
+        REQUIRE(5 == aggregate.number_of_events_seen);
+      }
+    }
+
+    WHEN("another snapshot store catches up on the snapshot topic") {
+      kafka::snapshot_store<fake_aggregate> other_snapshots{
+          snapshot_serializer, config};
+      other_snapshots.catch_up();
+
+      THEN("it finds the latest snapshot") {
+        REQUIRE(6 == other_snapshots.apply_snapshot(aggregate, 10));
+        REQUIRE(6 == aggregate.version());
+      }
+    }
+  }
+}
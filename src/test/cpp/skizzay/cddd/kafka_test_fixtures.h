@@ -0,0 +1,112 @@
+#pragma once
+
+#include "skizzay/cddd/domain_event.h"
+#include "skizzay/cddd/kafka/kafka_event_store.h"
+#include "skizzay/cddd/timestamp.h"
+
+#include <catch.hpp>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <initializer_list>
+#include <librdkafka/rdkafka.h>
+#include <librdkafka/rdkafka_mock.h>
+#include <memory_resource>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The clock, events, serializer and mock cluster the Kafka tests share.
+namespace skizzay::cddd::kafka_test {
+
+// Kafka timestamps are in milliseconds, so the clock is too.
+struct fake_clock {
+  std::chrono::system_clock::time_point now() noexcept {
+    return std::chrono::time_point_cast<std::chrono::milliseconds>(
+        skizzay::cddd::now(system_clock));
+  }
+
+  [[no_unique_address]] std::chrono::system_clock system_clock;
+};
+
+// Serialized as N bytes.
+template <std::size_t N>
+struct test_event : basic_domain_event<test_event<N>, std::string, std::size_t,
+                                       timestamp_t<fake_clock>> {
+  static test_event<N> from_payload(std::span<std::byte const> const payload) {
+    CHECK(N == std::size(payload));
+    return {};
+  }
+};
+
+struct fake_serializer : kafka::serializer<test_event<1>, test_event<2>> {
+  std::pmr::vector<std::byte>
+  serialize(test_event<1> const &,
+            std::pmr::memory_resource *const resource) const override {
+    return std::pmr::vector<std::byte>({std::byte{1}}, resource);
+  }
+  std::string_view
+  message_type(event_type<test_event<1>> const) const noexcept override {
+    return "test event 1";
+  }
+
+  std::pmr::vector<std::byte>
+  serialize(test_event<2> const &,
+            std::pmr::memory_resource *const resource) const override {
+    return std::pmr::vector<std::byte>({std::byte{2}, std::byte{2}}, resource);
+  }
+  std::string_view
+  message_type(event_type<test_event<2>> const) const noexcept override {
+    return "test event 2";
+  }
+};
+
+// A single broker with four partitions for each of the topics.
+struct mock_cluster {
+  explicit mock_cluster(
+      std::initializer_list<char const *> const topics = {"test-event-log"}) {
+    char error_message[512];
+    handle = rd_kafka_new(RD_KAFKA_PRODUCER, rd_kafka_conf_new(), error_message,
+                          sizeof(error_message));
+    cluster = rd_kafka_mock_cluster_new(handle, 1);
+    for (char const *const topic : topics) {
+      rd_kafka_mock_topic_create(cluster, topic, 4, 1);
+    }
+  }
+
+  mock_cluster(mock_cluster const &) = delete;
+  mock_cluster &operator=(mock_cluster const &) = delete;
+
+  ~mock_cluster() {
+    rd_kafka_mock_cluster_destroy(cluster);
+    rd_kafka_destroy(handle);
+  }
+
+  std::string bootstrap_servers() const {
+    return rd_kafka_mock_cluster_bootstraps(cluster);
+  }
+
+  rd_kafka_t *handle;
+  rd_kafka_mock_cluster_t *cluster;
+};
+
+struct temporary_path {
+  ~temporary_path() { std::filesystem::remove(value); }
+
+  std::filesystem::path value =
+      std::filesystem::temp_directory_path() /
+      ("cddd-offset-index-" + std::to_string(std::random_device{}()));
+};
+
+struct temporary_directory {
+  ~temporary_directory() { std::filesystem::remove_all(value); }
+
+  std::filesystem::path value =
+      std::filesystem::temp_directory_path() /
+      ("cddd-offset-index-dir-" + std::to_string(std::random_device{}()));
+};
+
+using store_type = kafka::event_store<fake_clock, test_event<1>, test_event<2>>;
+} // namespace skizzay::cddd::kafka_test
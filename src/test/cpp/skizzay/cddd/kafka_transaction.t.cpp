@@ -0,0 +1,152 @@
+#include <skizzay/cddd/kafka/kafka_transaction.h>
+
+#include "skizzay/cddd/event_stream.h"
+#include "skizzay/cddd/kafka/kafka_event_store.h"
+#include "skizzay/cddd/optimistic_concurrency_collision.h"
+#include "skizzay/cddd/timestamp.h"
+#include "skizzay/cddd/version.h"
+#include "kafka_test_fixtures.h"
+#include <catch.hpp>
+#include <filesystem>
+#include <thread>
+
+using namespace skizzay::cddd;
+using namespace skizzay::cddd::kafka_test;
+
+SCENARIO("Events for several aggregates can be committed atomically",
+         "[unit][kafka][event_store]") {
+  mock_cluster cluster;
+  kafka::event_log_config const config =
+      kafka::event_log_config{cluster.bootstrap_servers(), "test-event-log"}
+          .with_linger(std::chrono::milliseconds{1})
+          .with_transactional_id("test-transactional-id");
+  fake_serializer serializer;
+  kafka::event_dispatcher<test_event<1>, test_event<2>> event_dispatcher;
+  temporary_path index_path;
+  kafka::offset_index index{index_path.value};
+  store_type store{config, serializer, event_dispatcher, index};
+
+  GIVEN("a transaction with events staged for two aggregates") {
+    auto transaction = store.begin_transaction();
+    auto first = store.get_event_stream(std::string{"first"}, transaction);
+    auto second = store.get_event_stream(std::string{"second"}, transaction);
+    skizzay::cddd::add_event(first, test_event<1>{});
+    skizzay::cddd::add_event(first, test_event<2>{});
+    skizzay::cddd::add_event(second, test_event<1>{});
+    skizzay::cddd::commit_events(first, std::size_t{0});
+    skizzay::cddd::commit_events(second, std::size_t{0});
+
+    THEN("nothing is published before the transaction commits") {
+      REQUIRE(0 == skizzay::cddd::version(first));
+      REQUIRE(0 == index.version("second"));
+    }
+
+    WHEN("the transaction commits") {
+      transaction.commit();
+
+      THEN("both streams have been published") {
+        REQUIRE(2 == skizzay::cddd::version(first));
+        REQUIRE(1 == skizzay::cddd::version(second));
+        REQUIRE(2 == index.version("first"));
+        REQUIRE(1 == index.version("second"));
+      }
+    }
+
+    WHEN("one of the aggregates has moved on before the transaction commits") {
+      auto other = store.get_event_stream(std::string{"second"});
+      skizzay::cddd::add_event(other, test_event<2>{});
+      skizzay::cddd::commit_events(other, std::size_t{0});
+
+      THEN("none of the staged events are published") {
+        REQUIRE_THROWS_AS(transaction.commit(),
+                          optimistic_concurrency_collision);
+        REQUIRE(0 == skizzay::cddd::version(first));
+        REQUIRE(0 == index.version("first"));
+        REQUIRE(1 == index.version("second"));
+      }
+    }
+  }
+
+  GIVEN("transactions committed concurrently") {
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i != 8; ++i) {
+      threads.emplace_back([&store, i]() {
+        for (;;) {
+          auto transaction = store.begin_transaction();
+          auto own = store.get_event_stream(std::to_string(i), transaction);
+          auto shared =
+              store.get_event_stream(std::string{"shared"}, transaction);
+          skizzay::cddd::add_event(own, test_event<1>{});
+          skizzay::cddd::add_event(shared, test_event<2>{});
+          skizzay::cddd::commit_events(own, skizzay::cddd::version(own));
+          skizzay::cddd::commit_events(shared, skizzay::cddd::version(shared));
+          try {
+            transaction.commit();
+            return;
+          } catch (optimistic_concurrency_collision const &) {
+          }
+        }
+      });
+    }
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+
+    THEN("every transaction has been published") {
+      for (std::size_t i = 0; i != 8; ++i) {
+        REQUIRE(1 == index.version(std::to_string(i)));
+      }
+      REQUIRE(8 == index.version("shared"));
+    }
+  }
+
+  GIVEN("an event store without a transactional id") {
+    kafka::event_log_config const other_config{cluster.bootstrap_servers(),
+                                               "test-event-log"};
+    temporary_path other_index_path;
+    kafka::offset_index other_index{other_index_path.value};
+    store_type other_store{other_config, serializer, event_dispatcher,
+                           other_index};
+
+    THEN("no transaction can be started") {
+      REQUIRE_THROWS_AS(other_store.begin_transaction(), std::logic_error);
+    }
+  }
+
+  GIVEN("an offset index that cannot be written to") {
+    kafka::event_log_config const other_config =
+        kafka::event_log_config{cluster.bootstrap_servers(), "test-event-log"}
+            .with_linger(std::chrono::milliseconds{1})
+            .with_transactional_id("other-transactional-id");
+    temporary_directory missing_directory;
+    kafka::offset_index other_index{missing_directory.value / "index"};
+    store_type other_store{other_config, serializer, event_dispatcher,
+                           other_index};
+    auto transaction = other_store.begin_transaction();
+    auto stream =
+        other_store.get_event_stream(std::string{"unindexed"}, transaction);
+    skizzay::cddd::add_event(stream, test_event<1>{});
+    skizzay::cddd::commit_events(stream, std::size_t{0});
+
+    WHEN("the transaction commits") {
+      REQUIRE_NOTHROW(transaction.commit());
+
+      THEN("the stream has been published and the index is stale") {
+        REQUIRE(1 == skizzay::cddd::version(stream));
+        REQUIRE(other_index.stale());
+      }
+
+      AND_WHEN("the index can be written to again and is caught up") {
+        std::filesystem::create_directories(missing_directory.value);
+        other_store.catch_up();
+
+        THEN("it is no longer stale") {
+          REQUIRE_FALSE(other_index.stale());
+          REQUIRE(1 == other_index.version("unindexed"));
+          REQUIRE(1 == kafka::offset_index{missing_directory.value / "index"}
+                           .version("unindexed"));
+        }
+      }
+    }
+  }
+}
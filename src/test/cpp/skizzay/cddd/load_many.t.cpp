@@ -0,0 +1,138 @@
+#include <skizzay/cddd/load_many.h>
+
+#include "skizzay/cddd/event_store.h"
+#include "skizzay/cddd/executor.h"
+#include "skizzay/cddd/in_memory_event_store.h"
+#include "skizzay/cddd/thread_pool.h"
+#include "skizzay/cddd/timestamp.h"
+
+#include <catch.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <string>
+#include <vector>
+
+using namespace skizzay::cddd;
+
+namespace {
+struct fake_clock {
+  std::chrono::system_clock::time_point now() noexcept {
+    return skizzay::cddd::now(system_clock);
+  }
+
+  [[no_unique_address]] std::chrono::system_clock system_clock;
+};
+
+template <std::size_t N>
+struct test_event : basic_domain_event<test_event<N>, std::string, std::size_t,
+                                       timestamp_t<fake_clock>> {};
+
+struct fake_aggregate {
+  void apply(test_event<1> const &event) {
+    version = skizzay::cddd::version(event);
+  }
+
+  std::string id;
+  std::size_t version = {};
+};
+} // namespace
+
+SCENARIO("Many aggregates are hydrated concurrently", "[unit][load_many]") {
+  GIVEN("an event store with the histories of several aggregates") {
+    in_memory_event_store<fake_clock, test_event<1>> store;
+    std::vector<std::string> ids;
+    for (std::size_t i = 0; i != 20; ++i) {
+      ids.push_back(std::to_string(i));
+      auto event_stream = get_event_stream(store, ids.back());
+      for (std::size_t n = 0; n != i + 1; ++n) {
+        add_event(event_stream, test_event<1>{});
+      }
+      commit_events(event_stream, 0);
+    }
+    thread_pool pool{4};
+
+    WHEN("they are loaded to their latest versions") {
+      std::vector<fake_aggregate> const aggregates =
+          load_many<fake_aggregate>(store, pool, ids, 3).get();
+
+      THEN("each was hydrated with its whole history, in the order of the "
+           "ids") {
+        REQUIRE(std::size(ids) == std::size(aggregates));
+        for (std::size_t i = 0; i != std::size(ids); ++i) {
+          REQUIRE(ids[i] == aggregates[i].id);
+          REQUIRE(i + 1 == aggregates[i].version);
+        }
+      }
+    }
+
+    WHEN("they are loaded to target versions") {
+      std::vector<std::size_t> const target_versions(std::size(ids), 5);
+      std::vector<fake_aggregate> const aggregates =
+          load_many<fake_aggregate>(store, pool, ids, target_versions, 3)
+              .get();
+
+      THEN("none was hydrated beyond its target version") {
+        for (std::size_t i = 0; i != std::size(ids); ++i) {
+          REQUIRE(std::min<std::size_t>(i + 1, 5) == aggregates[i].version);
+        }
+      }
+    }
+
+    WHEN("they are loaded as each completes") {
+      std::vector<std::size_t> positions;
+      std::promise<void> done;
+      load_many<fake_aggregate>(
+          store, pool, ids, 2,
+          [&](std::size_t const i, fake_aggregate &&aggregate,
+              std::exception_ptr const error) {
+            if (nullptr == error && ids[i] == aggregate.id) {
+              positions.push_back(i);
+            }
+            if (std::size(ids) == std::size(positions)) {
+              done.set_value();
+            }
+          });
+      done.get_future().get();
+
+      THEN("each was handed over once") {
+        std::ranges::sort(positions);
+        for (std::size_t i = 0; i != std::size(ids); ++i) {
+          REQUIRE(i == positions[i]);
+        }
+      }
+    }
+
+    WHEN("many are loaded one at a time on an inline executor") {
+      inline_executor executor;
+      std::vector<std::string> const many_ids(10000, "abc");
+      std::size_t num_loaded = 0;
+      std::uintptr_t shallowest = 0;
+      std::uintptr_t deepest = std::numeric_limits<std::uintptr_t>::max();
+      load_many<fake_aggregate>(
+          store, executor, many_ids, 1,
+          [&](std::size_t, fake_aggregate &&, std::exception_ptr) {
+            char const frame = {};
+            auto const address = reinterpret_cast<std::uintptr_t>(&frame);
+            shallowest = std::max(shallowest, address);
+            deepest = std::min(deepest, address);
+            ++num_loaded;
+          });
+
+      THEN("each was loaded without the stack growing with the ids") {
+        REQUIRE(std::size(many_ids) == num_loaded);
+        REQUIRE(shallowest - deepest < 4096);
+      }
+    }
+
+    WHEN("the target versions do not match the ids") {
+      THEN("loading is refused") {
+        REQUIRE_THROWS_AS(load_many<fake_aggregate>(
+                              store, pool, ids, std::vector<std::size_t>{1}, 2),
+                          std::invalid_argument);
+      }
+    }
+  }
+}
@@ -0,0 +1,91 @@
+#include <skizzay/cddd/lru_blob_cache.h>
+
+#include <catch.hpp>
+#include <cstddef>
+#include <map>
+#include <span>
+#include <string>
+#include <vector>
+
+using namespace skizzay::cddd;
+
+namespace {
+struct fake_blob_store final : blob_store {
+  void put_blob(std::string const &key,
+                std::span<std::byte const> const data) override {
+    blobs.insert_or_assign(key, make_blob(data));
+  }
+
+  blob get_blob(std::string const &key) override {
+    ++number_of_gets;
+    if (auto const entry = blobs.find(key); std::end(blobs) != entry) {
+      return entry->second;
+    }
+    throw blob_not_found{"Could not find blob '" + key + "'"};
+  }
+
+  std::map<std::string, blob> blobs;
+  std::size_t number_of_gets = 0;
+};
+
+std::vector<std::byte> bytes_of_size(std::size_t const size) {
+  return std::vector<std::byte>(size, std::byte{42});
+}
+} // namespace
+
+SCENARIO("Blobs are cached least recently used first",
+         "[unit][blob_store]") {
+  fake_blob_store backing_store;
+  lru_blob_cache target{backing_store, 10};
+
+  GIVEN("two blobs put through the cache") {
+    target.put_blob("a", bytes_of_size(4));
+    target.put_blob("b", bytes_of_size(4));
+
+    THEN("both were written through and are cached") {
+      REQUIRE(2 == std::size(backing_store.blobs));
+      REQUIRE(8 == target.size_in_bytes());
+      target.get_blob("a");
+      target.get_blob("b");
+      REQUIRE(0 == backing_store.number_of_gets);
+    }
+
+    WHEN("the first is used and a third is put past the capacity") {
+      target.get_blob("a");
+      target.put_blob("c", bytes_of_size(4));
+
+      THEN("the least recently used one was evicted") {
+        REQUIRE(8 == target.size_in_bytes());
+        target.get_blob("a");
+        target.get_blob("c");
+        REQUIRE(0 == backing_store.number_of_gets);
+        target.get_blob("b");
+        REQUIRE(1 == backing_store.number_of_gets);
+      }
+    }
+
+    WHEN("a blob larger than the capacity is put") {
+      target.put_blob("d", bytes_of_size(11));
+
+      THEN("it is written through without being cached") {
+        REQUIRE(8 == target.size_in_bytes());
+        REQUIRE(11 == std::size(*target.get_blob("d")));
+        REQUIRE(1 == backing_store.number_of_gets);
+      }
+    }
+  }
+
+  GIVEN("a blob only in the backing store") {
+    backing_store.put_blob("e", bytes_of_size(6));
+
+    WHEN("it is got twice") {
+      target.get_blob("e");
+      target.get_blob("e");
+
+      THEN("it was read through once and cached") {
+        REQUIRE(1 == backing_store.number_of_gets);
+        REQUIRE(6 == target.size_in_bytes());
+      }
+    }
+  }
+}
@@ -0,0 +1,44 @@
+#include <skizzay/cddd/retry_policy.h>
+
+#include <catch.hpp>
+#include <chrono>
+#include <cstddef>
+
+using namespace skizzay::cddd;
+
+SCENARIO("Retries back off with full jitter", "[unit][retry_policy]") {
+  GIVEN("a retry policy") {
+    retry_policy const target{10, std::chrono::microseconds{100},
+                              std::chrono::microseconds{1'000}};
+
+    WHEN("delays are drawn for each failed attempt") {
+      THEN("each is at most the base delay doubled per attempt before it") {
+        for (std::size_t failed_attempts = 1; failed_attempts != 5;
+             ++failed_attempts) {
+          for (int i = 0; i != 100; ++i) {
+            auto const delay = backoff_delay(target, failed_attempts);
+            REQUIRE(std::chrono::microseconds::zero() <= delay);
+            REQUIRE(target.base_delay * (1 << (failed_attempts - 1)) >= delay);
+          }
+        }
+      }
+
+      THEN("none exceeds the maximum delay, however many attempts failed") {
+        for (std::size_t const failed_attempts : {5, 20, 64, 1'000}) {
+          for (int i = 0; i != 100; ++i) {
+            REQUIRE(target.max_delay >= backoff_delay(target, failed_attempts));
+          }
+        }
+      }
+    }
+  }
+
+  GIVEN("a retry policy without delays") {
+    retry_policy const target{3, std::chrono::microseconds{0},
+                              std::chrono::microseconds{0}};
+
+    THEN("no delay is drawn") {
+      REQUIRE(std::chrono::microseconds::zero() == backoff_delay(target, 3));
+    }
+  }
+}
@@ -0,0 +1,137 @@
+#include <skizzay/cddd/small_vector.h>
+
+#include <array>
+#include <catch.hpp>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <string>
+
+using namespace skizzay::cddd;
+
+SCENARIO("Small vectors keep few elements inline", "[unit][small_vector]") {
+  GIVEN("an empty small vector") {
+    small_vector<std::unique_ptr<std::string>, 2> target;
+
+    THEN("it holds nothing, inline") {
+      REQUIRE(target.empty());
+      REQUIRE(target.is_inline());
+      REQUIRE(2 == target.capacity());
+    }
+
+    WHEN("elements within the inline capacity are added") {
+      target.emplace_back(std::make_unique<std::string>("a"));
+      target.push_back(std::make_unique<std::string>("b"));
+
+      THEN("they are held inline, in order") {
+        REQUIRE(target.is_inline());
+        REQUIRE(2 == std::size(target));
+        REQUIRE("a" == *target.front());
+        REQUIRE("b" == *target.back());
+      }
+
+      AND_WHEN("the vector is moved") {
+        auto moved = std::move(target);
+
+        THEN("the elements moved with it") {
+          REQUIRE(moved.is_inline());
+          REQUIRE(2 == std::size(moved));
+          REQUIRE("a" == *moved[0]);
+          REQUIRE(target.empty());
+        }
+      }
+    }
+
+    WHEN("more elements than the inline capacity are added") {
+      for (char c = 'a'; c != 'f'; ++c) {
+        target.emplace_back(std::make_unique<std::string>(1, c));
+      }
+
+      THEN("they spill to the heap, in order") {
+        REQUIRE_FALSE(target.is_inline());
+        REQUIRE(5 == std::size(target));
+        REQUIRE(5 <= target.capacity());
+        REQUIRE("a" == *target.front());
+        REQUIRE("e" == *target.back());
+      }
+
+      AND_WHEN("the vector is cleared") {
+        auto const capacity = target.capacity();
+        target.clear();
+
+        THEN("the heap storage is kept for reuse") {
+          REQUIRE(target.empty());
+          REQUIRE_FALSE(target.is_inline());
+          REQUIRE(capacity == target.capacity());
+        }
+      }
+
+      AND_WHEN("the vector is moved") {
+        auto moved = std::move(target);
+
+        THEN("its heap storage moved with it") {
+          REQUIRE_FALSE(moved.is_inline());
+          REQUIRE(5 == std::size(moved));
+          REQUIRE(target.is_inline());
+          REQUIRE(target.empty());
+        }
+      }
+    }
+  }
+
+  GIVEN("a full small vector of copyable elements") {
+    small_vector<std::string, 2> target;
+    target.push_back("a");
+    target.push_back("b");
+
+    WHEN("one of its own elements is appended") {
+      target.push_back(target.front());
+
+      THEN("the copy was made before the elements moved") {
+        REQUIRE(3 == std::size(target));
+        REQUIRE("a" == target.back());
+      }
+    }
+  }
+}
+
+SCENARIO("Small vectors spill into the memory resource they are given",
+         "[unit][small_vector]") {
+  using vector_type =
+      small_vector<int, 2, std::pmr::polymorphic_allocator<int>>;
+
+  GIVEN("a small vector over an arena") {
+    std::array<std::byte, 256> storage;
+    std::pmr::monotonic_buffer_resource arena{
+        storage.data(), storage.size(), std::pmr::null_memory_resource()};
+    vector_type target{&arena};
+
+    WHEN("more elements than the inline capacity are added") {
+      for (int i = 0; i != 5; ++i) {
+        target.push_back(i);
+      }
+
+      THEN("they spill into the arena") {
+        REQUIRE_FALSE(target.is_inline());
+        REQUIRE(&arena == target.get_allocator().resource());
+        auto const *const address =
+            reinterpret_cast<std::byte const *>(target.data());
+        REQUIRE(storage.data() <= address);
+        REQUIRE(address < storage.data() + storage.size());
+      }
+
+      AND_WHEN("it is moved into a vector over another resource") {
+        vector_type moved{std::pmr::new_delete_resource()};
+        moved = std::move(target);
+
+        THEN("the elements were moved rather than the arena's storage") {
+          REQUIRE(std::pmr::new_delete_resource() ==
+                  moved.get_allocator().resource());
+          REQUIRE(5 == std::size(moved));
+          REQUIRE(4 == moved.back());
+          REQUIRE(target.empty());
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,154 @@
+#include <skizzay/cddd/task.h>
+
+#include "skizzay/cddd/event_loop.h"
+#include "skizzay/cddd/event_sourced.h"
+#include "skizzay/cddd/event_store.h"
+#include "skizzay/cddd/event_stream.h"
+#include "skizzay/cddd/in_memory_event_store.h"
+#include "skizzay/cddd/optimistic_concurrency_collision.h"
+#include "skizzay/cddd/timestamp.h"
+
+#include <catch.hpp>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+using namespace skizzay::cddd;
+
+namespace {
+struct fake_clock {
+  std::chrono::system_clock::time_point now() noexcept {
+    return skizzay::cddd::now(system_clock);
+  }
+
+  [[no_unique_address]] std::chrono::system_clock system_clock;
+};
+
+template <std::size_t N>
+struct test_event : basic_domain_event<test_event<N>, std::string, std::size_t,
+                                       timestamp_t<fake_clock>> {};
+
+struct fake_aggregate {
+  template <std::size_t N>
+  requires(1 == N) || (2 == N) void apply(test_event<N> const &event) {
+    version = skizzay::cddd::version(event);
+    ++num_events;
+  }
+
+  std::string id;
+  std::size_t version = {};
+  std::size_t num_events = {};
+};
+
+using store_type =
+    in_memory_event_store<fake_clock, test_event<1>, test_event<2>>;
+
+task<int> answer() { co_return 42; }
+
+task<int> doubled_answer() { co_return 2 * co_await answer(); }
+
+task<> fail() {
+  throw std::runtime_error{"failed"};
+  co_return;
+}
+
+// Completes on another thread, as a backend's I/O would.
+auto complete_elsewhere() {
+  return completion_awaiter{
+      [](std::function<void(std::exception_ptr)> completed) {
+        std::thread{[completed = std::move(completed)]() {
+          completed(nullptr);
+        }}.detach();
+      }};
+}
+} // namespace
+
+SCENARIO("Tasks run on an event loop", "[unit][task]") {
+  GIVEN("an event loop") {
+    event_loop loop;
+
+    WHEN("a task awaiting other tasks is spawned and the loop is run") {
+      int result = 0;
+      spawn(loop, [](int &result) -> task<> {
+        result = co_await doubled_answer();
+      }(result));
+      loop.run();
+
+      THEN("the task ran to completion") { REQUIRE(84 == result); }
+    }
+
+    WHEN("a spawned task awaits an operation completing on another thread") {
+      std::thread::id resumed_on;
+      spawn(loop, [](std::thread::id &resumed_on) -> task<> {
+        co_await complete_elsewhere();
+        resumed_on = std::this_thread::get_id();
+      }(resumed_on));
+      loop.run();
+
+      THEN("it was resumed on the thread running the loop") {
+        REQUIRE(std::this_thread::get_id() == resumed_on);
+      }
+    }
+
+    WHEN("a spawned task fails") {
+      spawn(loop, fail());
+
+      THEN("running the loop rethrows the failure") {
+        REQUIRE_THROWS_AS(loop.run(), std::runtime_error);
+      }
+    }
+  }
+}
+
+SCENARIO("Event stores can be awaited from tasks",
+         "[unit][task][in_memory][event_stream][event_source]") {
+  GIVEN("an in-memory event store and an event loop") {
+    store_type store;
+    event_loop loop;
+    std::string const id = "abc";
+
+    WHEN("a task commits events and then loads them into an aggregate") {
+      fake_aggregate aggregate{id};
+      spawn(loop, [](store_type &store, std::string const &id,
+                     fake_aggregate &aggregate) -> task<> {
+        auto event_stream = store.get_event_stream(id);
+        for (std::size_t i = 0; i != 4; ++i) {
+          add_event(event_stream, test_event<1>{});
+          add_event(event_stream, test_event<2>{});
+          co_await co_commit_events(event_stream, 2 * i);
+        }
+        auto event_source = get_event_source(store, id);
+        co_await co_load_from_history(event_source, aggregate);
+      }(store, id, aggregate));
+      loop.run();
+
+      THEN("the aggregate loaded every committed event") {
+        REQUIRE(8 == aggregate.num_events);
+        REQUIRE(8 == aggregate.version);
+      }
+    }
+
+    WHEN("a task commits against a stale version") {
+      std::vector<bool> collided;
+      spawn(loop, [](store_type &store, std::string const &id,
+                     std::vector<bool> &collided) -> task<> {
+        auto event_stream = store.get_event_stream(id);
+        add_event(event_stream, test_event<1>{});
+        try {
+          co_await co_commit_events(event_stream, 3);
+        } catch (optimistic_concurrency_collision const &) {
+          collided.push_back(true);
+        }
+      }(store, id, collided));
+      loop.run();
+
+      THEN("the collision was thrown into the task") {
+        REQUIRE(1 == std::size(collided));
+        REQUIRE(0 == version(store.get_event_stream(id)));
+      }
+    }
+  }
+}
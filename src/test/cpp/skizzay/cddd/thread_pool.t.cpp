@@ -0,0 +1,121 @@
+#include <skizzay/cddd/thread_pool.h>
+
+#include "skizzay/cddd/executor.h"
+
+#include <catch.hpp>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace skizzay::cddd;
+
+static_assert(concepts::executor<thread_pool>);
+
+SCENARIO("Work is spread across the threads of a pool",
+         "[unit][thread_pool]") {
+  GIVEN("a pool of several threads") {
+    std::atomic<std::size_t> num_run = 0;
+
+    WHEN("work is posted, some of it from the pool's own threads") {
+      {
+        thread_pool target{4};
+        for (std::size_t i = 0; i != 100; ++i) {
+          target.post([&]() {
+            target.post([&]() { ++num_run; });
+            ++num_run;
+          });
+        }
+      }
+
+      THEN("all of it was run before the pool was destroyed") {
+        REQUIRE(200 == num_run);
+      }
+    }
+
+    WHEN("work is posted with keys") {
+      std::mutex m;
+      std::vector<std::size_t> abc;
+      std::vector<std::size_t> def;
+      {
+        thread_pool target{4};
+        for (std::size_t i = 0; i != 100; ++i) {
+          target.post(std::string{"abc"}, [&, i]() {
+            std::lock_guard l_{m};
+            abc.push_back(i);
+          });
+          target.post(std::string{"def"}, [&, i]() {
+            std::lock_guard l_{m};
+            def.push_back(i);
+          });
+        }
+      }
+
+      THEN("the work for each key was run in the order it was posted") {
+        REQUIRE(100 == std::size(abc));
+        REQUIRE(100 == std::size(def));
+        for (std::size_t i = 0; i != 100; ++i) {
+          REQUIRE(i == abc[i]);
+          REQUIRE(i == def[i]);
+        }
+      }
+    }
+
+    WHEN("work is posted one item at a time, once the last has run") {
+      thread_pool target{4};
+      for (std::size_t i = 0; i != 100; ++i) {
+        std::promise<void> ran;
+        std::future<void> result = ran.get_future();
+        target.post([&]() {
+          ++num_run;
+          ran.set_value();
+        });
+        REQUIRE_NOTHROW(result.get());
+      }
+
+      THEN("each woke a parked thread to run it") { REQUIRE(100 == num_run); }
+    }
+
+    WHEN("a thread keeps posting work after other work was queued") {
+      constexpr std::size_t num_hops = 100000;
+      std::atomic<std::size_t> hops = 0;
+      std::size_t hops_before_queued_ran = num_hops;
+      std::function<void()> hop;
+      {
+        std::promise<void> started;
+        std::promise<void> queued;
+        thread_pool target{1};
+        hop = [&]() {
+          if (num_hops != ++hops) {
+            target.post(hop);
+          }
+        };
+        target.post([&]() {
+          started.set_value();
+          queued.get_future().wait();
+          target.post(hop);
+        });
+        started.get_future().wait();
+        target.post([&]() { hops_before_queued_ran = hops; });
+        queued.set_value();
+      }
+
+      THEN("the queued work was not held up until the posting stopped") {
+        REQUIRE(num_hops == hops);
+        REQUIRE(num_hops > hops_before_queued_ran);
+      }
+    }
+
+    WHEN("the pool's threads are pinned") {
+      std::promise<void> ran;
+      std::future<void> result = ran.get_future();
+      thread_pool target{2, true};
+      target.post([&ran]() { ran.set_value(); });
+
+      THEN("work is still run") { REQUIRE_NOTHROW(result.get()); }
+    }
+  }
+}